@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+#include "pmm_mngr.h"
+#include "vmm_mngr.h"
+#include "vmm_mngr_utils.h"
+#include "kstack.h"
+#include "string.h"
+#include "fpu.h"
+#include "cpu.h"
+
+// Micro-benchmarks for the hosted kernel code. Figures are cycles from the
+// TSC plus wall-clock rates, so runs on one machine compare directly.
+
+#define BENCH_VIRT 0xFFFF910000000000ULL
+
+static uint8_t bench_src[1 << 20] __attribute__((aligned(4096)));
+static uint8_t bench_dst[1 << 20] __attribute__((aligned(4096)));
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_pmm(void) {
+    const uint64_t count = 8192;
+    static uint64_t frames[8192];
+
+    host_memory_init();
+    uint64_t ns = now_ns(), start = rdtsc();
+    for (uint64_t i = 0; i < count; i++)
+        frames[i] = pmm_alloc();
+    uint64_t alloc_cycles = rdtsc() - start, alloc_ns = now_ns() - ns;
+
+    ns = now_ns();
+    start = rdtsc();
+    for (uint64_t i = 0; i < count; i++)
+        pmm_free(frames[i]);
+    uint64_t free_cycles = rdtsc() - start, free_ns = now_ns() - ns;
+
+    printf("pmm_alloc      %8lu cycles/op %12.0f ops/s\n",
+           alloc_cycles / count, count * 1e9 / alloc_ns);
+    printf("pmm_free       %8lu cycles/op %12.0f ops/s\n",
+           free_cycles / count, count * 1e9 / free_ns);
+}
+
+static void bench_vmm(void) {
+    const size_t pages = 4096;
+
+    host_memory_init();
+    uint64_t ns = now_ns(), start = rdtsc();
+    vmm_map_range(BENCH_VIRT, pages * PAGE_SIZE, 0x1000000, PAGE_WRITE);
+    uint64_t map_cycles = rdtsc() - start, map_ns = now_ns() - ns;
+
+    ns = now_ns();
+    start = rdtsc();
+    vmm_unmap_range(BENCH_VIRT, pages * PAGE_SIZE);
+    uint64_t unmap_cycles = rdtsc() - start, unmap_ns = now_ns() - ns;
+
+    printf("vmm_map_range  %8lu cycles/page %10.0f pages/s\n",
+           map_cycles / pages, pages * 1e9 / map_ns);
+    printf("vmm_unmap_range%8lu cycles/page %10.0f pages/s\n",
+           unmap_cycles / pages, pages * 1e9 / unmap_ns);
+}
+
+// Stack churn as thread creation sees it: served by the per-CPU cache, and
+// with more stacks in flight than the cache holds, mapped and unmapped
+static void bench_kstack(void) {
+    const uint64_t count = 4096;
+    const int depth = 4 * KSTACK_CACHE_SIZE;
+    uint64_t tops[4 * KSTACK_CACHE_SIZE];
+
+    host_memory_init();
+    uint64_t ns = now_ns(), start = rdtsc();
+    for (uint64_t i = 0; i < count; i++)
+        kstack_free(kstack_alloc());
+    uint64_t cached_cycles = rdtsc() - start, cached_ns = now_ns() - ns;
+
+    ns = now_ns();
+    start = rdtsc();
+    for (uint64_t i = 0; i < count / depth; i++) {
+        for (int j = 0; j < depth; j++)
+            tops[j] = kstack_alloc();
+        for (int j = 0; j < depth; j++)
+            kstack_free(tops[j]);
+    }
+    uint64_t mapped_cycles = rdtsc() - start, mapped_ns = now_ns() - ns;
+
+    printf("kstack cached  %8lu cycles/op %12.0f ops/s\n",
+           cached_cycles / count, count * 1e9 / cached_ns);
+    printf("kstack churn   %8lu cycles/op %12.0f ops/s\n",
+           mapped_cycles / count, count * 1e9 / mapped_ns);
+}
+
+static void bench_copy(const char *name, size_t size, bool fill) {
+    // Enough repetitions to move ~64 MiB per measurement
+    size_t reps = (64u << 20) / size;
+    uint64_t start = rdtsc();
+    for (size_t r = 0; r < reps; r++) {
+        if (fill)
+            memset(bench_dst, (int)r, size);
+        else
+            memcpy(bench_dst, bench_src + (r & 63), size);
+        asm volatile ("" : : : "memory");
+    }
+    uint64_t cycles = rdtsc() - start;
+    printf("%-7s %7zu B  %6.2f bytes/cycle\n", name, size, (double)size * reps / cycles);
+}
+
+static void bench_pages(void) {
+    const size_t pages = sizeof(bench_dst) / 4096;
+    uint64_t start = rdtsc();
+    for (int r = 0; r < 16; r++)
+        for (size_t i = 0; i < pages; i++)
+            clear_page(bench_dst + i * 4096);
+    uint64_t clear_cycles = rdtsc() - start;
+
+    start = rdtsc();
+    for (int r = 0; r < 16; r++)
+        for (size_t i = 0; i < pages; i++)
+            copy_page(bench_dst + i * 4096, bench_src + i * 4096);
+    uint64_t copy_cycles = rdtsc() - start;
+
+    printf("clear_page     %8lu cycles/page\n", clear_cycles / (16 * pages));
+    printf("copy_page      %8lu cycles/page\n", copy_cycles / (16 * pages));
+}
+
+static void bench_string(void) {
+    static const size_t sizes[] = { 16, 64, 256, 1024, 4096, 65536, 1 << 20 };
+    const size_t count = sizeof(sizes) / sizeof(sizes[0]);
+
+    bool levels[][2] = { { false, false }, { true, false }, { true, true } };
+    for (size_t l = 0; l < 3; l++) {
+        if (levels[l][1] && !__builtin_cpu_supports("avx"))
+            continue;
+        fpu_has_sse2 = levels[l][0];
+        fpu_has_avx = levels[l][1];
+        string_init();
+        printf("-- string: %s\n", string_impl_name());
+        for (size_t i = 0; i < count; i++)
+            bench_copy("memcpy", sizes[i], false);
+        for (size_t i = 0; i < count; i++)
+            bench_copy("memset", sizes[i], true);
+        bench_pages();
+    }
+}
+
+int main(void) {
+    bench_pmm();
+    bench_vmm();
+    bench_kstack();
+    bench_string();
+    return 0;
+}
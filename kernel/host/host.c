@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <sys/mman.h>
+#include "limine_requests.h"
+#include "pmm_mngr.h"
+#include "vmm_mngr.h"
+#include "string.h"
+#include "idt.h"
+#include "apic.h"
+#include "clocksource.h"
+#include "isr.h"
+#include "percpu.h"
+#include "fpu.h"
+#include "sched.h"
+#include "softirq.h"
+#include "serial.h"
+#include "klog.h"
+
+uint8_t *host_phys;
+uint64_t host_cr3;
+int host_verbose;
+
+// What limine_requests.c, fpu.c and idt.c provide in the kernel
+volatile struct limine_memmap_request memmap_request;
+volatile struct limine_hhdm_request hhdm_request;
+bool fpu_has_sse2 = true;
+bool fpu_has_avx;
+volatile uint32_t irq_nesting[MAX_CPUS];
+
+// What fpu.c provides: the vector registers belong to the process, so only
+// simulated interrupt context has to stay scalar
+bool kernel_fpu_begin(void) {
+    return !in_interrupt();
+}
+
+void kernel_fpu_end(void) {
+}
+
+// A simulated clock and APIC timer for timer.c
+uint64_t host_ktime_ns;
+void (*host_timer_fn)(void);
+uint64_t host_timer_deadline = UINT64_MAX;
+
+uint64_t ktime_get_ns(void) {
+    return host_ktime_ns;
+}
+
+void apic_timer_init(void (*fn)(void)) {
+    host_timer_fn = fn;
+}
+
+void apic_timer_set_ns(uint64_t ns) {
+    host_timer_deadline = host_ktime_ns + ns;
+}
+
+void apic_timer_cancel(void) {
+    host_timer_deadline = UINT64_MAX;
+}
+
+// synchronize_rcu() yields while it waits; there is nothing else to run
+void sched_yield(void) {
+}
+
+// What softirq.c and workqueue.c need from sched.c. Threads only run when
+// a test calls host_run_thread(), and blocking returns to that test.
+uint64_t host_wakeups;
+static jmp_buf *host_block_env;
+static struct thread host_threads[2 * MAX_CPUS];
+static uint32_t host_threads_used;
+
+struct thread *thread_create_pinned(void (*fn)(void *arg), void *arg, const char *name) {
+    if (host_threads_used == sizeof(host_threads) / sizeof(host_threads[0]))
+        return NULL;
+    struct thread *thread = &host_threads[host_threads_used++];
+    thread->fn = fn;
+    thread->arg = arg;
+    thread->name = name;
+    return thread;
+}
+
+void sched_block(void) {
+    if (host_block_env)
+        longjmp(*host_block_env, 1);
+}
+
+bool host_run_thread(const char *name) {
+    for (uint32_t i = host_threads_used; i-- > 0;) {
+        struct thread *thread = &host_threads[i];
+        if (__builtin_strcmp(thread->name, name))
+            continue;
+
+        jmp_buf env;
+        host_block_env = &env;
+        if (!setjmp(env))
+            thread->fn(thread->arg);
+        host_block_env = NULL;
+        return true;
+    }
+    return false;
+}
+
+void sched_wake(struct thread *thread) {
+    (void)thread;
+    host_wakeups++;
+}
+
+void host_interrupt(void (*fn)(void)) {
+    irq_enter();
+    fn();
+    softirq_irq_exit();
+    irq_exit();
+}
+
+// What gen-ksyms would make for three functions of 0x100 bytes each
+const uint64_t ksyms_count = 3;
+const uint64_t ksyms_text_end = 0x1300;
+const uint64_t ksyms_addrs[] = { 0x1000, 0x1100, 0x1200 };
+const uint32_t ksyms_name_offsets[] = { 0, 6, 11 };
+const char ksyms_names[] = "alpha\0beta\0gamma";
+
+// What profile.c needs from isr.c, sched.c, serial.c and klog.c: tests
+// fill in the interrupted frame and read back what went to COM1
+struct isr_frame *isr_irq_frame[MAX_CPUS];
+char host_serial[HOST_SERIAL_SIZE];
+size_t host_serial_len;
+
+struct thread *current_thread(void) {
+    return NULL;
+}
+
+void serial_write(const char *buf, size_t len) {
+    for (size_t i = 0; i < len && host_serial_len < HOST_SERIAL_SIZE - 1; i++)
+        host_serial[host_serial_len++] = buf[i];
+    host_serial[host_serial_len] = '\0';
+}
+
+void klog_drain(void) {
+}
+
+// What tlb.c needs from isr.c, apic.c and percpu.c. There is no other CPU
+// to answer an IPI, so tests must never leave one in TLB_ACTIVE.
+struct percpu percpu_areas[MAX_CPUS];
+uint64_t host_ipis_sent;
+
+isr_handler_t isr_register(uint8_t vector, isr_handler_t handler) {
+    (void)vector;
+    (void)handler;
+    return NULL;
+}
+
+void apic_send_ipi(uint32_t apic_id, uint8_t vector) {
+    (void)apic_id;
+    (void)vector;
+    host_ipis_sent++;
+}
+
+void apic_eoi(void) {
+}
+
+// Allocator state owned by pmm_mngr.c, reset between runs
+extern uint64_t pmm_used_frames;
+
+#define PTE_ADDR_MASK 0x000FFFFFFFFFF000ULL
+
+// A small PC: real-mode hole, a reserved block in the middle, 64 MiB in all
+static struct limine_memmap_entry host_memmap[] = {
+    { 0x0000000, 0x009F000, LIMINE_MEMMAP_USABLE },
+    { 0x009F000, 0x0061000, LIMINE_MEMMAP_RESERVED },
+    { 0x0100000, 0x1F00000, LIMINE_MEMMAP_USABLE },
+    { 0x2000000, 0x0200000, LIMINE_MEMMAP_RESERVED },
+    { 0x2200000, 0x1E00000, LIMINE_MEMMAP_USABLE },
+};
+#define HOST_MEMMAP_ENTRIES (sizeof(host_memmap) / sizeof(host_memmap[0]))
+
+static struct limine_memmap_entry *host_memmap_ptrs[HOST_MEMMAP_ENTRIES];
+static struct limine_memmap_response host_memmap_response;
+static struct limine_hhdm_response host_hhdm_response;
+
+void kprintf(const char *fmt, ...) {
+    if (!host_verbose)
+        return;
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+void panic(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    abort();
+}
+
+uint64_t *host_recursive_table(uint64_t pml4_idx, uint64_t pdpt_idx, uint64_t pd_idx) {
+    const uint64_t index[4] = { RECURSIVE_INDEX, pml4_idx, pdpt_idx, pd_idx };
+    uint64_t table = host_cr3;
+
+    for (int level = 0; level < 4; level++) {
+        uint64_t entry = ((uint64_t *)(host_phys + table))[index[level] & 0x1FF];
+        if (!(entry & PAGE_PRESENT)) {
+            fprintf(stderr, "host: page fault walking RECURSIVE_PT(%lu, %lu, %lu) at level %d\n",
+                    pml4_idx, pdpt_idx, pd_idx, level);
+            abort();
+        }
+        table = entry & PTE_ADDR_MASK;
+        if (table >= HOST_PHYS_SIZE) {
+            fprintf(stderr, "host: table 0x%lx outside simulated memory\n", table);
+            abort();
+        }
+    }
+    return (uint64_t *)(host_phys + table);
+}
+
+void host_memory_init(void) {
+    if (!host_phys) {
+        host_phys = mmap(NULL, HOST_PHYS_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (host_phys == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+    } else {
+        // Hand the pages back so every run starts from zeroed memory
+        madvise(host_phys, HOST_PHYS_SIZE, MADV_DONTNEED);
+    }
+
+    for (size_t i = 0; i < HOST_MEMMAP_ENTRIES; i++)
+        host_memmap_ptrs[i] = &host_memmap[i];
+    host_memmap_response.entry_count = HOST_MEMMAP_ENTRIES;
+    host_memmap_response.entries = host_memmap_ptrs;
+    memmap_request.response = &host_memmap_response;
+
+    host_hhdm_response.offset = (uint64_t)(uintptr_t)host_phys;
+    hhdm_request.response = &host_hhdm_response;
+
+    string_init();
+
+    pmm_used_frames = 0;
+    pmm_init(memmap_request, hhdm_request);
+
+    // Fresh address space containing only the recursive slot
+    host_cr3 = pmm_alloc();
+    uint64_t *pml4 = (uint64_t *)(host_phys + host_cr3);
+    pml4[RECURSIVE_INDEX] = host_cr3 | PAGE_PRESENT | PAGE_WRITE;
+}
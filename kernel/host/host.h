@@ -0,0 +1,97 @@
+#ifndef HOST_H
+#define HOST_H
+
+/*
+ * Forced into every translation unit of the hosted test build (-include).
+ * Kernel sources are compiled unchanged for a Linux process: physical memory
+ * is one anonymous mapping, the HHDM offset points at it, and the recursive
+ * page-table window is replaced by a software walk of the simulated tables.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Simulated physical memory: [0, HOST_PHYS_SIZE) backed by host_phys
+#define HOST_PHYS_SIZE (64ULL << 20)
+
+extern uint8_t *host_phys;
+
+// Physical address of the active PML4 (stands in for CR3)
+extern uint64_t host_cr3;
+
+/**
+ * host_recursive_table - Resolve a recursive-mapping address in software.
+ *
+ * Walks the simulated tables from host_cr3 the way the MMU would for
+ * RECURSIVE_PT(@pml4_idx, @pdpt_idx, @pd_idx): first through the recursive
+ * PML4 slot, then one level per index. Reaching a non-present entry is what
+ * would be a page fault in the kernel; it aborts the test run.
+ */
+uint64_t *host_recursive_table(uint64_t pml4_idx, uint64_t pdpt_idx, uint64_t pd_idx);
+
+#define RECURSIVE_PT(pml4_idx, pdpt_idx, pd_idx) \
+    host_recursive_table((pml4_idx), (pdpt_idx), (pd_idx))
+
+/**
+ * host_memory_init - (Re)build the simulated machine.
+ *
+ * Clears physical memory, hands a Limine-style memory map with a low-memory
+ * hole and a reserved block to pmm_init() and installs a fresh PML4 with the
+ * recursive slot. Tests call this to start from a known state.
+ */
+void host_memory_init(void);
+
+/*
+ * Simulated time for the timer wheel: ktime_get_ns() returns host_ktime_ns,
+ * and the APIC timer stubs record the armed deadline (UINT64_MAX when off)
+ * and the callback to run when a test advances the clock past it. The
+ * callback is the hard-IRQ half; call it through host_interrupt().
+ */
+extern uint64_t host_ktime_ns;
+extern uint64_t host_timer_deadline;
+extern void (*host_timer_fn)(void);
+
+// IPIs the apic_send_ipi() stub was asked to send
+extern uint64_t host_ipis_sent;
+
+// sched_wake() calls; threads from thread_create_pinned() do not run by themselves
+extern uint64_t host_wakeups;
+
+/**
+ * host_run_thread - Run a thread's function until it calls sched_block().
+ *
+ * @name: Name given to thread_create_pinned(); the newest such thread runs.
+ *
+ * Returns false if there is no such thread.
+ */
+bool host_run_thread(const char *name);
+
+/**
+ * host_interrupt - Run @fn the way isr_dispatch() runs a device interrupt.
+ *
+ * @fn: Hard-IRQ half, e.g. host_timer_fn.
+ *
+ * Pending softirqs run on the way out, as on the outermost kernel exit.
+ */
+void host_interrupt(void (*fn)(void));
+
+// serial_write() output since the test last cleared host_serial_len,
+// NUL-terminated; the rest is cut off
+#define HOST_SERIAL_SIZE (64 * 1024)
+
+extern char host_serial[HOST_SERIAL_SIZE];
+extern size_t host_serial_len;
+
+// Print kernel kprintf() output (off by default to keep test output short)
+extern int host_verbose;
+
+// Kernel string routines keep their own names so they do not replace libc's
+#define memcpy  kernel_memcpy
+#define memmove kernel_memmove
+#define memset  kernel_memset
+#define memcmp  kernel_memcmp
+#define strlen  kernel_strlen
+#define strcpy  kernel_strcpy
+
+#endif // HOST_H
@@ -0,0 +1,30 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+// Failed CHECKs so far; test_main exits non-zero if any
+extern int test_failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n",                    \
+                    __FILE__, __LINE__, #cond);                             \
+            test_failures++;                                                \
+        }                                                                   \
+    } while (0)
+
+void test_pmm(void);
+void test_vmm(void);
+void test_string(void);
+void test_timer(void);
+void test_spinlock(void);
+void test_rcu(void);
+void test_tlb(void);
+void test_kstack(void);
+void test_softirq(void);
+void test_profile(void);
+void test_printf(void);
+
+#endif // TEST_H
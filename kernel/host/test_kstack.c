@@ -0,0 +1,65 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "test.h"
+#include "kstack.h"
+#include "pmm_mngr.h"
+#include "vmm_mngr.h"
+#include "vmm_mngr_utils.h"
+
+static bool mapped(uint64_t virt_addr) {
+    return vmm_query_mapping(virt_addr).flags & PAGE_PRESENT;
+}
+
+void test_kstack(void) {
+    host_memory_init();
+    struct kstack_stats before, after;
+    kstack_get_stats(&before);
+
+    // A fresh stack is mapped whole, with nothing mapped right below or above
+    uint64_t top = kstack_alloc();
+    CHECK(top != 0 && top % PAGE_SIZE == 0);
+    for (uint64_t addr = top - KSTACK_SIZE; addr < top; addr += PAGE_SIZE)
+        CHECK(mapped(addr));
+    CHECK(!mapped(top - KSTACK_SIZE - PAGE_SIZE));
+    CHECK(!mapped(top));
+
+    // Freeing parks it in the cache, mapped, and the next allocation reuses it
+    uint64_t used = get_used_frame_count();
+    kstack_free(top);
+    CHECK(get_used_frame_count() == used);
+    CHECK(mapped(top - PAGE_SIZE));
+    CHECK(kstack_alloc() == top);
+    kstack_get_stats(&after);
+    CHECK(after.cache_hits == before.cache_hits + 1);
+
+    // Past the cache, frees unmap and return the frames, and the slots are
+    // handed out again
+    uint64_t tops[KSTACK_CACHE_SIZE + 2];
+    tops[0] = top;
+    for (int i = 1; i < KSTACK_CACHE_SIZE + 2; i++) {
+        tops[i] = kstack_alloc();
+        CHECK(tops[i] != 0 && tops[i] != tops[i - 1]);
+    }
+    used = get_used_frame_count();
+    for (int i = 0; i < KSTACK_CACHE_SIZE + 2; i++)
+        kstack_free(tops[i]);
+    CHECK(get_used_frame_count() == used - 2 * KSTACK_SIZE / PAGE_SIZE);
+    CHECK(!mapped(tops[KSTACK_CACHE_SIZE + 1] - PAGE_SIZE));
+    kstack_get_stats(&after);
+    CHECK(after.unmaps == before.unmaps + 2);
+
+    // Drain the cache; then the unmapped slots come back, mapped anew
+    for (int i = 0; i < KSTACK_CACHE_SIZE + 2; i++)
+        tops[i] = kstack_alloc();
+    CHECK(mapped(tops[KSTACK_CACHE_SIZE + 1] - PAGE_SIZE));
+    for (int i = 0; i < KSTACK_CACHE_SIZE + 2; i++)
+        kstack_free(tops[i]);
+
+    // Permanent stacks of any size get a guard page as well
+    uint64_t permanent = kstack_alloc_permanent(3 * PAGE_SIZE);
+    uint64_t next = kstack_alloc_permanent(PAGE_SIZE);
+    CHECK(mapped(permanent - 3 * PAGE_SIZE) && mapped(permanent - PAGE_SIZE));
+    CHECK(!mapped(permanent - 4 * PAGE_SIZE));
+    CHECK(!mapped(next - 2 * PAGE_SIZE));
+    CHECK(next - PAGE_SIZE == permanent + PAGE_SIZE);
+}
@@ -0,0 +1,33 @@
+#include <stdio.h>
+#include "test.h"
+
+int test_failures;
+
+static const struct {
+    const char *name;
+    void (*run)(void);
+} tests[] = {
+    { "pmm", test_pmm },
+    { "vmm", test_vmm },
+    { "string", test_string },
+    { "timer", test_timer },
+    { "spinlock", test_spinlock },
+    { "rcu", test_rcu },
+    { "tlb", test_tlb },
+    { "kstack", test_kstack },
+    { "softirq", test_softirq },
+    { "profile", test_profile },
+    { "printf", test_printf },
+};
+
+int main(int argc, char **argv) {
+    if (argc > 1 && argv[1][0] == '-' && argv[1][1] == 'v')
+        host_verbose = 1;
+
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        int before = test_failures;
+        tests[i].run();
+        printf("%-8s %s\n", tests[i].name, test_failures == before ? "ok" : "FAILED");
+    }
+    return test_failures ? 1 : 0;
+}
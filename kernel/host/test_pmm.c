@@ -0,0 +1,112 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include "test.h"
+#include "pmm_mngr.h"
+#include "limine_requests.h"
+
+// True if [phys, phys + PAGE_SIZE) lies inside a usable memmap entry
+static bool frame_is_usable(uint64_t phys) {
+    struct limine_memmap_response *memmap = memmap_request.response;
+    for (uint64_t i = 0; i < memmap->entry_count; i++) {
+        struct limine_memmap_entry *entry = memmap->entries[i];
+        if (entry->type == LIMINE_MEMMAP_USABLE &&
+            phys >= entry->base && phys + PAGE_SIZE <= entry->base + entry->length)
+            return true;
+    }
+    return false;
+}
+
+static void test_alloc_free_counts(void) {
+    host_memory_init();
+    uint64_t used = get_used_frame_count();
+    uint64_t free = get_free_frame_count();
+
+    uint64_t a = pmm_alloc();
+    uint64_t b = pmm_alloc();
+    CHECK(a != 0 && b != 0 && a != b);
+    CHECK(get_used_frame_count() == used + 2);
+    CHECK(get_free_frame_count() == free - 2);
+
+    pmm_free(a);
+    CHECK(get_used_frame_count() == used + 1);
+
+    // First fit: the lowest free frame comes back first
+    CHECK(pmm_alloc() == a);
+    pmm_free(a);
+    pmm_free(b);
+    CHECK(get_used_frame_count() == used);
+}
+
+static void test_alloc_contig(void) {
+    host_memory_init();
+    uint64_t used = get_used_frame_count();
+
+    // A run of frames that are all free, usable and in order
+    uint64_t base = pmm_alloc_contig(16);
+    CHECK(base != 0 && base % PAGE_SIZE == 0);
+    for (uint64_t i = 0; i < 16; i++)
+        CHECK(frame_is_usable(base + i * PAGE_SIZE));
+    CHECK(get_used_frame_count() == used + 16);
+
+    // None of them is handed out again
+    uint64_t single = pmm_alloc();
+    CHECK(single < base || single >= base + 16 * PAGE_SIZE);
+    pmm_free(single);
+
+    // A hole too short for the run is skipped
+    uint64_t a = pmm_alloc();
+    uint64_t b = pmm_alloc();
+    pmm_free(a);
+    uint64_t run = pmm_alloc_contig(2);
+    CHECK(run != a);
+    CHECK(pmm_alloc() == a);
+
+    CHECK(pmm_alloc_contig(0) == 0);
+    CHECK(pmm_alloc_contig(HOST_PHYS_SIZE / PAGE_SIZE) == 0);
+
+    pmm_free(a);
+    pmm_free(b);
+    pmm_free(run);
+    pmm_free(run + PAGE_SIZE);
+    for (uint64_t i = 0; i < 16; i++)
+        pmm_free(base + i * PAGE_SIZE);
+    CHECK(get_used_frame_count() == used);
+}
+
+static void test_frames_valid(void) {
+    host_memory_init();
+    uint64_t frames = get_total_frame_count();
+    uint8_t *seen = calloc(HOST_PHYS_SIZE / PAGE_SIZE, 1);
+    uint64_t count = 0;
+
+    // Drain the allocator, then check every frame it handed out
+    for (uint64_t phys; (phys = pmm_alloc()) != 0; count++) {
+        CHECK(phys % PAGE_SIZE == 0);
+        CHECK(phys >= 0x100000);
+        CHECK(phys < HOST_PHYS_SIZE && frame_is_usable(phys));
+        if (phys < HOST_PHYS_SIZE) {
+            CHECK(!seen[phys / PAGE_SIZE]);
+            seen[phys / PAGE_SIZE] = 1;
+        }
+        if (count > frames)
+            break;
+    }
+    CHECK(count > 0 && count <= frames);
+
+    // Everything freed is available again
+    for (uint64_t f = 0; f < HOST_PHYS_SIZE / PAGE_SIZE; f++)
+        if (seen[f])
+            pmm_free(f * PAGE_SIZE);
+    uint64_t again = 0;
+    while (pmm_alloc() != 0 && again <= count)
+        again++;
+    CHECK(again == count);
+
+    free(seen);
+}
+
+void test_pmm(void) {
+    test_alloc_free_counts();
+    test_alloc_contig();
+    test_frames_valid();
+}
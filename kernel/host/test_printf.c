@@ -0,0 +1,86 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include "test.h"
+#include "printf.h"
+#include "string.h"
+
+// True if the kernel's vsnprintf() produces @expected, and returns its length
+static bool fmt_is(const char *expected, const char *fmt, ...) {
+    char buf[128];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+
+    if (len == (int)strlen(expected) && !__builtin_strcmp(buf, expected))
+        return true;
+    fprintf(stderr, "\"%s\": got \"%s\" (%d), want \"%s\"\n", fmt, buf, len, expected);
+    return false;
+}
+
+static void check_integers(void) {
+    CHECK(fmt_is("-9223372036854775808", "%ld", (long)INT64_MIN));
+    CHECK(fmt_is("-9223372036854775808", "%lld", (long long)INT64_MIN));
+    CHECK(fmt_is("-9223372036854775808", "%jd", (intmax_t)INT64_MIN));
+    CHECK(fmt_is("18446744073709551615", "%lu", (unsigned long)UINT64_MAX));
+    CHECK(fmt_is("ffffffffffffffff", "%lx", (unsigned long)UINT64_MAX));
+    CHECK(fmt_is("ABC", "%X", 0xABC));
+    CHECK(fmt_is("-2147483648", "%d", INT32_MIN));
+
+    // Length modifiers truncate before converting
+    CHECK(fmt_is("44", "%hhd", 300));
+    CHECK(fmt_is("-1", "%hhd", 255));
+    CHECK(fmt_is("4464", "%hu", 70000));
+    CHECK(fmt_is("12345", "%zu", (size_t)12345));
+    CHECK(fmt_is("-7", "%td", (ptrdiff_t)-7));
+}
+
+static void check_flags_and_width(void) {
+    CHECK(fmt_is("42   |", "%-*d|", 5, 42));
+    CHECK(fmt_is("42   |", "%*d|", -5, 42));   // A negative '*' width left-justifies
+    CHECK(fmt_is("   42", "%5d", 42));
+    CHECK(fmt_is("-0042", "%05d", -42));
+    CHECK(fmt_is("+5  5", "%+d % d", 5, 5));
+    CHECK(fmt_is("0x00ff", "%#06x", 0xFF));
+    CHECK(fmt_is("0xff", "%#x", 0xFF));
+    CHECK(fmt_is("0", "%#x", 0));
+    CHECK(fmt_is("0", "%#o", 0));
+    CHECK(fmt_is("010", "%#o", 8));
+    CHECK(fmt_is("0x1234", "%p", (void *)0x1234));
+    CHECK(fmt_is("x  |%", "%-3c|%%", 'x'));
+}
+
+static void check_precision(void) {
+    CHECK(fmt_is("", "%.0d", 0));
+    CHECK(fmt_is("     ", "%5.0d", 0));
+    CHECK(fmt_is("00042", "%.5d", 42));
+    CHECK(fmt_is("-00042", "%.5d", -42));
+    CHECK(fmt_is("     042", "%08.3d", 42));  // '0' is ignored with a precision
+    CHECK(fmt_is("abc", "%.3s", "abcdef"));
+    CHECK(fmt_is("ab   |", "%-5.*s|", 2, "abcdef"));
+}
+
+static void check_truncation(void) {
+    char buf[8];
+    memset(buf, 'x', sizeof(buf));
+    CHECK(snprintf(buf, sizeof(buf), "%s", "hello world") == 11);
+    CHECK(!__builtin_strcmp(buf, "hello w"));
+
+    memset(buf, 'x', sizeof(buf));
+    CHECK(snprintf(buf, 1, "%d", 12345) == 5);
+    CHECK(buf[0] == '\0' && buf[1] == 'x');
+
+    // Only the length is wanted
+    CHECK(snprintf(NULL, 0, "%ld-%s", (long)INT64_MIN, "tail") == 25);
+    memset(buf, 'x', sizeof(buf));
+    CHECK(snprintf(buf, 0, "abc") == 3);
+    CHECK(buf[0] == 'x');
+}
+
+void test_printf(void) {
+    check_integers();
+    check_flags_and_width();
+    check_precision();
+    check_truncation();
+}
@@ -0,0 +1,168 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "test.h"
+#include "profile.h"
+#include "ksyms.h"
+#include "isr.h"
+#include "percpu.h"
+#include "timer.h"
+
+// host.c's symbol table: alpha at 0x1000, beta at 0x1100, gamma at 0x1200
+static void check_ksyms(void) {
+    uint64_t offset = 0;
+    CHECK(!ksym_lookup(0xFFF, &offset));
+    CHECK(!__builtin_strcmp(ksym_lookup(0x1000, &offset), "alpha") && offset == 0);
+    CHECK(!__builtin_strcmp(ksym_lookup(0x10FF, &offset), "alpha") && offset == 0xFF);
+    CHECK(!__builtin_strcmp(ksym_lookup(0x1100, &offset), "beta") && offset == 0);
+    CHECK(!__builtin_strcmp(ksym_lookup(0x12FF, NULL), "gamma"));
+    CHECK(!ksym_lookup(0x1300, &offset));
+}
+
+/*
+ * An interrupted context: the frame the entry stub saved, and above it the
+ * stack it interrupted with three frames, alpha called from gamma called
+ * from beta called from alpha.
+ */
+static struct {
+    struct isr_frame frame;
+    uint64_t stack[64];
+} fake;
+
+#define STACK_END ((uint64_t)&fake.stack[64])
+
+static void fake_stack(void) {
+    memset(&fake, 0, sizeof(fake));
+    fake.frame.rip = 0x1010;
+    fake.frame.rbp = (uint64_t)&fake.stack[8];
+    fake.stack[8] = (uint64_t)&fake.stack[20];
+    fake.stack[9] = 0x1205;
+    fake.stack[20] = (uint64_t)&fake.stack[40];
+    fake.stack[21] = 0x1105;
+    fake.stack[40] = 0;
+    fake.stack[41] = 0x1050;
+}
+
+static uint32_t walk(uint64_t hi, uint64_t *pcs, uint32_t max) {
+    return backtrace_walk(fake.frame.rip, fake.frame.rbp, (uint64_t)&fake.frame, hi, pcs, max);
+}
+
+static void check_backtrace(void) {
+    uint64_t pcs[PROFILE_DEPTH];
+
+    fake_stack();
+    CHECK(walk(STACK_END, pcs, PROFILE_DEPTH) == 4);
+    CHECK(pcs[0] == 0x1010 && pcs[1] == 0x1205 && pcs[2] == 0x1105 && pcs[3] == 0x1050);
+    CHECK(walk(STACK_END, pcs, 2) == 2);
+    CHECK(walk(STACK_END, pcs, 0) == 0);
+
+    // A frame that reaches past the end of the stack is not read
+    CHECK(walk((uint64_t)&fake.stack[21], pcs, PROFILE_DEPTH) == 2);
+
+    // Nor is one below the start, or a misaligned one
+    CHECK(backtrace_walk(0x1010, (uint64_t)&fake.stack[8], (uint64_t)&fake.stack[9],
+                         STACK_END, pcs, PROFILE_DEPTH) == 1);
+    CHECK(backtrace_walk(0x1010, (uint64_t)&fake.stack[8] + 4, (uint64_t)&fake.frame,
+                         STACK_END, pcs, PROFILE_DEPTH) == 1);
+
+    // A chain that points back down ends instead of looping
+    fake.stack[20] = (uint64_t)&fake.stack[8];
+    CHECK(walk(STACK_END, pcs, PROFILE_DEPTH) == 3);
+
+    // So does a zero return address
+    fake_stack();
+    fake.stack[21] = 0;
+    CHECK(walk(STACK_END, pcs, PROFILE_DEPTH) == 2);
+}
+
+// Jump to the next profiler tick and take the timer interrupt there
+static void tick(struct isr_frame *frame) {
+    host_ktime_ns = host_timer_deadline;
+    host_timer_deadline = UINT64_MAX;
+    isr_irq_frame[0] = frame;
+    host_interrupt(host_timer_fn);
+    isr_irq_frame[0] = NULL;
+}
+
+static void check_sampling(void) {
+    struct profile_stats stats;
+    host_ktime_ns = 1000000000;
+    timer_init();
+    fake_stack();
+    percpu_areas[0].stack_top = STACK_END;
+
+    profile_start();
+    CHECK(host_timer_deadline != UINT64_MAX);
+    CHECK(host_timer_deadline - host_ktime_ns <= 1000000000 / PROFILE_HZ + (1 << TIMER_TICK_SHIFT));
+
+    // The same stack five times, then a shorter one from a function that
+    // returns to the first byte after alpha, i.e. to alpha
+    for (int i = 0; i < 5; i++)
+        tick(&fake.frame);
+    fake.frame.rip = 0x5000;
+    fake.stack[9] = 0x1100;
+    fake.stack[8] = 0;
+    for (int i = 0; i < 3; i++)
+        tick(&fake.frame);
+
+    // Run outside an interrupt, there is nothing to sample
+    tick(NULL);
+
+    profile_get_stats(0, &stats);
+    CHECK(stats.samples == 8);
+    CHECK(stats.stacks == 2);
+    CHECK(stats.missed == 1);
+    CHECK(stats.dropped == 0);
+
+    host_serial_len = 0;
+    profile_dump();
+    CHECK(!__builtin_strncmp(host_serial, "PROFILE-BEGIN 997\n", 18));
+    CHECK(__builtin_strstr(host_serial, "\nalpha;beta;gamma;alpha 5\n") != NULL);
+    CHECK(__builtin_strstr(host_serial, "\nalpha;0x5000 3\n") != NULL);
+    CHECK(__builtin_strstr(host_serial, "\nPROFILE-END 8 0 1\n") != NULL);
+
+    // Stopped: further ticks neither sample nor re-arm
+    if (host_timer_deadline != UINT64_MAX)
+        tick(&fake.frame);
+    profile_get_stats(0, &stats);
+    CHECK(stats.samples == 8);
+    CHECK(host_timer_deadline == UINT64_MAX);
+    percpu_areas[0].stack_top = 0;
+}
+
+static void check_record(void) {
+    struct profile_stats stats;
+    uint64_t pcs[PROFILE_DEPTH + 4];
+    for (int i = 0; i < PROFILE_DEPTH + 4; i++)
+        pcs[i] = 0x1000 + i;
+
+    profile_start();
+    profile_stop();
+
+    // Deeper stacks are cut to PROFILE_DEPTH, so these two are the same
+    profile_record(pcs, PROFILE_DEPTH + 4);
+    profile_record(pcs, PROFILE_DEPTH);
+    profile_get_stats(0, &stats);
+    CHECK(stats.samples == 2 && stats.stacks == 1);
+
+    // One stack more than fits is dropped; known stacks are still counted
+    for (uint64_t i = 1; i <= PROFILE_STACKS; i++) {
+        pcs[0] = 0x2000 + i;
+        profile_record(pcs, 2);
+    }
+    profile_get_stats(0, &stats);
+    CHECK(stats.stacks == PROFILE_STACKS);
+    CHECK(stats.dropped == 1);
+    pcs[0] = 0x2001;
+    profile_record(pcs, 2);
+    profile_get_stats(0, &stats);
+    CHECK(stats.samples == PROFILE_STACKS + 2);
+    CHECK(stats.dropped == 1);
+}
+
+void test_profile(void) {
+    check_ksyms();
+    check_backtrace();
+    check_sampling();
+    check_record();
+}
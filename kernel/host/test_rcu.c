@@ -0,0 +1,74 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "test.h"
+#include "rcu.h"
+#include "idt.h"
+#include "timer.h"
+
+static struct rcu_head heads[3];
+static int invoked;
+static int order[3];
+
+static void record_callback(struct rcu_head *head) {
+    order[invoked++] = (int)(head - heads);
+}
+
+// The host is CPU 0; CPU 1 is simulated by editing its rcu_cpus entry
+void test_rcu(void) {
+    timer_init();
+    rcu_init_cpu();
+    struct rcu_cpu *other = &rcu_cpus[1];
+    other->online = true;
+    other->dynticks = 1;
+    other->qs_gp = 0;
+
+    // A busy CPU that never reports holds the grace period back
+    uint64_t completed = rcu_completed();
+    call_rcu(&heads[0], record_callback);
+    call_rcu(&heads[1], record_callback);
+    rcu_poll();
+    rcu_poll();
+    CHECK(invoked == 0);
+    CHECK(rcu_completed() == completed);
+
+    // Its context switch ends the grace period. The second callback came
+    // while that one was already running, so it waits for the next one,
+    // which needs another report from this CPU.
+    other->qs_gp = UINT64_MAX;
+    rcu_poll();
+    CHECK(invoked == 1);
+    rcu_poll();
+    CHECK(rcu_completed() > completed);
+    CHECK(invoked == 2);
+    CHECK(order[0] == 0 && order[1] == 1);
+
+    // An idle CPU needs no report, until an interrupt makes it a reader
+    other->qs_gp = 0;
+    other->dynticks = 2;
+    completed = rcu_completed();
+    call_rcu(&heads[2], record_callback);
+    rcu_poll();
+    CHECK(invoked == 3);
+    CHECK(rcu_completed() > completed);
+
+    // Interrupts on this CPU while it idles count as active, and undo
+    // that on the way out
+    rcu_idle_enter();
+    CHECK(!(rcu_cpus[0].dynticks & 1));
+    irq_enter();
+    CHECK(rcu_cpus[0].dynticks & 1);
+    irq_enter();
+    irq_exit();
+    CHECK(rcu_cpus[0].dynticks & 1);
+    irq_exit();
+    CHECK(!(rcu_cpus[0].dynticks & 1));
+    rcu_idle_exit();
+    CHECK(rcu_cpus[0].dynticks & 1);
+
+    // synchronize_rcu() returns once a new grace period has completed
+    completed = rcu_completed();
+    synchronize_rcu();
+    CHECK(rcu_completed() > completed);
+
+    other->online = false;
+}
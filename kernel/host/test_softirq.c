@@ -0,0 +1,181 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "test.h"
+#include "softirq.h"
+#include "workqueue.h"
+#include "idt.h"
+
+// Stands in for a device vector; serial.c is not part of the host build
+#define TEST_VECTOR SOFTIRQ_SERIAL
+
+#define WORK_ITEMS 40
+
+static int runs;
+static int reraise;             // Times the handler raises itself again
+static uint64_t advance_ns;     // Simulated time each run takes
+static bool ran_in_interrupt = true;
+
+static void test_handler(void) {
+    runs++;
+    if (!in_interrupt())
+        ran_in_interrupt = false;
+    host_ktime_ns += advance_ns;
+    if (reraise > 0) {
+        reraise--;
+        raise_softirq(TEST_VECTOR);
+    }
+}
+
+static void raise_twice(void) {
+    raise_softirq(TEST_VECTOR);
+    raise_softirq(TEST_VECTOR);
+}
+
+static void no_irq_work(void) {
+}
+
+static void check_softirq(void) {
+    struct softirq_stats before, after;
+    open_softirq(TEST_VECTOR, test_handler);
+    softirq_init_cpu();
+    host_ktime_ns = 1000000000;
+
+    // Raised twice by the hard half, run once on the way out
+    softirq_get_stats(0, &before);
+    runs = 0;
+    host_interrupt(raise_twice);
+    softirq_get_stats(0, &after);
+    CHECK(runs == 1);
+    CHECK(ran_in_interrupt);
+    CHECK(!softirq_pending[0]);
+    CHECK(after.raised[TEST_VECTOR] - before.raised[TEST_VECTOR] == 2);
+    CHECK(after.runs[TEST_VECTOR] - before.runs[TEST_VECTOR] == 1);
+
+    // A handler that raises more work is restarted within the same exit
+    softirq_get_stats(0, &before);
+    runs = 0;
+    reraise = SOFTIRQ_MAX_RESTART - 1;
+    host_interrupt(raise_twice);
+    softirq_get_stats(0, &after);
+    CHECK(runs == SOFTIRQ_MAX_RESTART);
+    CHECK(after.restarts - before.restarts == SOFTIRQ_MAX_RESTART - 1);
+    CHECK(after.deferrals == before.deferrals);
+
+    // Out of passes: the rest goes to ksoftirqd, and until that has run,
+    // each interrupt makes one pass
+    uint64_t wakeups = host_wakeups;
+    runs = 0;
+    reraise = SOFTIRQ_MAX_RESTART + 5;
+    host_interrupt(raise_twice);
+    softirq_get_stats(0, &after);
+    CHECK(runs == SOFTIRQ_MAX_RESTART);
+    CHECK(softirq_pending[0]);
+    CHECK(after.deferrals - before.deferrals == 1);
+    CHECK(host_wakeups - wakeups == 1);
+
+    host_interrupt(no_irq_work);
+    host_interrupt(no_irq_work);
+    CHECK(runs == SOFTIRQ_MAX_RESTART + 2);
+    CHECK(host_wakeups - wakeups == 1);
+
+    // ksoftirqd finishes the remaining four runs, still in interrupt
+    // context, then blocks
+    ran_in_interrupt = true;
+    CHECK(host_run_thread("ksoftirqd"));
+    softirq_get_stats(0, &after);
+    CHECK(runs == SOFTIRQ_MAX_RESTART + 6);
+    CHECK(!softirq_pending[0]);
+    CHECK(ran_in_interrupt);
+    CHECK(!in_interrupt());
+    CHECK(after.thread_runs - before.thread_runs == 1);
+
+    // The time budget ends an exit early too
+    softirq_get_stats(0, &before);
+    wakeups = host_wakeups;
+    runs = 0;
+    reraise = SOFTIRQ_MAX_RESTART;
+    advance_ns = SOFTIRQ_BUDGET_NS / 2;
+    host_interrupt(raise_twice);
+    softirq_get_stats(0, &after);
+    CHECK(runs == 2);
+    CHECK(after.deferrals - before.deferrals == 1);
+    CHECK(host_wakeups - wakeups == 1);
+    advance_ns = 0;
+    CHECK(host_run_thread("ksoftirqd"));
+    CHECK(runs == SOFTIRQ_MAX_RESTART + 1);
+
+    // Raised outside an interrupt: nothing runs until ksoftirqd does
+    wakeups = host_wakeups;
+    runs = 0;
+    raise_softirq(TEST_VECTOR);
+    CHECK(runs == 0);
+    CHECK(host_wakeups - wakeups == 1);
+    CHECK(host_run_thread("ksoftirqd"));
+    CHECK(runs == 1);
+}
+
+static struct work items[WORK_ITEMS];
+static int order[WORK_ITEMS * 2];
+static int done;
+static bool requeued;
+
+static void work_fn(struct work *work) {
+    int i = (int)(uintptr_t)work->data;
+    order[done++] = i;
+
+    // Pending is already clear, so an item can queue itself again
+    if (i == 0 && !requeued) {
+        requeued = true;
+        CHECK(queue_work(work));
+    }
+}
+
+static void queue_from_irq(void) {
+    for (int i = 0; i < WORK_ITEMS; i++)
+        queue_work(&items[i]);
+}
+
+static void check_workqueue(void) {
+    struct workqueue_stats before, after;
+    workqueue_init_cpu();
+    workqueue_get_stats(0, &before);
+    for (int i = 0; i < WORK_ITEMS; i++)
+        work_setup(&items[i], work_fn, (void *)(uintptr_t)i);
+
+    // Queued from an interrupt; only the first item wakes the worker and a
+    // second queue_work() of a pending item does nothing
+    uint64_t wakeups = host_wakeups;
+    done = 0;
+    requeued = false;
+    host_interrupt(queue_from_irq);
+    CHECK(!queue_work(&items[3]));
+    CHECK(host_wakeups - wakeups == 1);
+    workqueue_get_stats(0, &after);
+    CHECK(after.depth == WORK_ITEMS);
+    CHECK(after.max_depth >= WORK_ITEMS);
+
+    // The worker runs them in queue order, yielding between batches
+    CHECK(host_run_thread("kworker"));
+    workqueue_get_stats(0, &after);
+    CHECK(done == WORK_ITEMS + 1);
+    for (int i = 0; i < WORK_ITEMS; i++)
+        CHECK(order[i] == i);
+    CHECK(order[WORK_ITEMS] == 0);
+    CHECK(after.depth == 0);
+    CHECK(after.run - before.run == WORK_ITEMS + 1);
+    CHECK(after.queued - before.queued == WORK_ITEMS + 1);
+    CHECK(after.batches - before.batches == (WORK_ITEMS + 1) / WORK_BATCH);
+
+    // A flush runs the queue in the caller
+    done = 0;
+    CHECK(queue_work(&items[5]));
+    CHECK(queue_work(&items[7]));
+    workqueue_flush();
+    CHECK(done == 2 && order[0] == 5 && order[1] == 7);
+    CHECK(!items[5].pending && !items[7].pending);
+}
+
+void test_softirq(void) {
+    check_softirq();
+    check_workqueue();
+}
@@ -0,0 +1,94 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "test.h"
+#include "spinlock.h"
+
+#define LOCK_THREADS_MAX 4
+#define LOCK_ROUNDS      100000
+
+// Spinning threads that outnumber the host's CPUs wait out whole time slices
+// for a preempted holder, so oversubscribed hosts only get a short run
+#define LOCK_ROUNDS_SHORT   2000
+
+static int lock_threads;
+static int lock_rounds;
+
+static LOCK_CLASS(test_ticket_class, "test-ticket");
+static LOCK_CLASS(test_mcs_class, "test-mcs");
+static struct ticket_lock ticket = TICKET_LOCK_INIT(test_ticket_class);
+static struct mcs_lock mcs = MCS_LOCK_INIT(test_mcs_class);
+
+// Updated non-atomically in two steps, so a lost update or a torn pair
+// shows up if two threads are ever inside at once
+static volatile uint64_t counter;
+static volatile uint64_t shadow;
+static volatile bool overlap;
+
+static void critical_section(void) {
+    uint64_t value = counter;
+    if (shadow != value)
+        overlap = true;
+    counter = value + 1;
+    shadow = value + 1;
+}
+
+static void *ticket_worker(void *arg) {
+    (void)arg;
+    for (int i = 0; i < lock_rounds; i++) {
+        ticket_lock(&ticket);
+        critical_section();
+        ticket_unlock(&ticket);
+    }
+    return NULL;
+}
+
+static void *mcs_worker(void *arg) {
+    (void)arg;
+    struct mcs_node node;
+    for (int i = 0; i < lock_rounds; i++) {
+        mcs_lock(&mcs, &node);
+        critical_section();
+        mcs_unlock(&mcs, &node);
+    }
+    return NULL;
+}
+
+static void run_threads(void *(*worker)(void *)) {
+    pthread_t threads[LOCK_THREADS_MAX];
+    counter = 0;
+    shadow = 0;
+    overlap = false;
+    for (int i = 0; i < lock_threads; i++)
+        CHECK(pthread_create(&threads[i], NULL, worker, NULL) == 0);
+    for (int i = 0; i < lock_threads; i++)
+        pthread_join(threads[i], NULL);
+    CHECK(counter == (uint64_t)lock_threads * lock_rounds);
+    CHECK(!overlap);
+}
+
+void test_spinlock(void) {
+    // Single-threaded behaviour
+    CHECK(!ticket_is_locked(&ticket));
+    CHECK(ticket_trylock(&ticket));
+    CHECK(ticket_is_locked(&ticket));
+    CHECK(!ticket_trylock(&ticket));
+    ticket_unlock(&ticket);
+    CHECK(!ticket_is_locked(&ticket));
+
+    struct mcs_node node;
+    mcs_lock(&mcs, &node);
+    CHECK(mcs.tail == &node);
+    mcs_unlock(&mcs, &node);
+    CHECK(mcs.tail == NULL);
+
+    // Mutual exclusion under contention
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    lock_threads = cpus < 2 ? 2 : cpus > LOCK_THREADS_MAX ? LOCK_THREADS_MAX : (int)cpus;
+    lock_rounds = cpus < lock_threads ? LOCK_ROUNDS_SHORT : LOCK_ROUNDS;
+    run_threads(ticket_worker);
+    run_threads(mcs_worker);
+    CHECK(!ticket_is_locked(&ticket));
+    CHECK(mcs.tail == NULL);
+}
@@ -0,0 +1,147 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "test.h"
+#include "string.h"
+#include "fpu.h"
+#include "idt.h"
+
+static uint8_t src_buf[8192 + 64];
+static uint8_t dst_buf[8192 + 64];
+static uint8_t page_a[4096] __attribute__((aligned(4096)));
+static uint8_t page_b[4096] __attribute__((aligned(4096)));
+
+static const size_t big_lengths[] = { 1000, 2047, 2048, 2049, 4095, 4096, 8191 };
+#define LENGTHS (300 + sizeof(big_lengths) / sizeof(big_lengths[0]))
+
+static size_t test_length(size_t n) {
+    return n < 300 ? n : big_lengths[n - 300];
+}
+
+static void check_copy_and_fill(void) {
+    int wrong = 0;
+
+    for (size_t i = 0; i < sizeof(src_buf); i++)
+        src_buf[i] = (uint8_t)(i * 7 + 3);
+
+    for (size_t so = 0; so < 16; so++) {
+        for (size_t dof = 0; dof < 16; dof++) {
+            for (size_t n = 0; n < LENGTHS; n++) {
+                size_t len = test_length(n);
+
+                for (size_t i = 0; i < len + 32; i++)
+                    dst_buf[i] = (uint8_t)(i ^ 0xA5);
+                memcpy(dst_buf + dof, src_buf + so, len);
+                for (size_t i = 0; i < len + 32; i++) {
+                    uint8_t expect = (i >= dof && i < dof + len) ? (uint8_t)((i - dof + so) * 7 + 3) : (uint8_t)(i ^ 0xA5);
+                    if (dst_buf[i] != expect) {
+                        wrong++;
+                        break;
+                    }
+                }
+
+                memset(dst_buf + dof, (int)so * 13, len);
+                for (size_t i = 0; i < len + 32; i++) {
+                    uint8_t expect = (i >= dof && i < dof + len) ? (uint8_t)(so * 13) : (uint8_t)(i ^ 0xA5);
+                    if (dst_buf[i] != expect) {
+                        wrong++;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    CHECK(wrong == 0);
+}
+
+static void check_move(void) {
+    int wrong = 0;
+
+    for (int delta = -300; delta <= 300; delta++) {
+        for (size_t len = 0; len < 1200; len += 13) {
+            size_t s = 2048, d = 2048 + delta;
+
+            for (size_t i = 0; i < 4096; i++)
+                dst_buf[i] = (uint8_t)(i * 11 + 1);
+            memmove(dst_buf + d, dst_buf + s, len);
+            for (size_t i = 0; i < 4096; i++) {
+                uint8_t expect = (i >= d && i < d + len) ? (uint8_t)((i - d + s) * 11 + 1) : (uint8_t)(i * 11 + 1);
+                if (dst_buf[i] != expect) {
+                    wrong++;
+                    break;
+                }
+            }
+        }
+    }
+    CHECK(wrong == 0);
+}
+
+static void check_compare(void) {
+    int wrong = 0;
+
+    for (size_t len = 1; len < 100; len++) {
+        for (size_t k = 0; k < len; k++) {
+            for (size_t i = 0; i < len; i++)
+                dst_buf[i + 3] = src_buf[i];
+            if (memcmp(dst_buf + 3, src_buf, len) != 0)
+                wrong++;
+
+            dst_buf[k + 3]++;
+            int expect = dst_buf[k + 3] > src_buf[k] ? 1 : -1;
+            if (memcmp(dst_buf + 3, src_buf, len) != expect ||
+                memcmp(src_buf, dst_buf + 3, len) != -expect)
+                wrong++;
+        }
+    }
+    CHECK(wrong == 0);
+}
+
+static void check_pages(void) {
+    for (size_t i = 0; i < 4096; i++) {
+        page_a[i] = (uint8_t)(i * 5 + 1);
+        page_b[i] = 0xCC;
+    }
+
+    copy_page(page_b, page_a);
+    int wrong = 0;
+    for (size_t i = 0; i < 4096; i++)
+        if (page_b[i] != page_a[i])
+            wrong++;
+    CHECK(wrong == 0);
+
+    clear_page(page_a);
+    for (size_t i = 0; i < 4096; i++)
+        if (page_a[i] != 0)
+            wrong++;
+    CHECK(wrong == 0);
+}
+
+static void run_checks(void) {
+    check_copy_and_fill();
+    check_move();
+    check_compare();
+    check_pages();
+}
+
+void test_string(void) {
+    // Scalar paths, as taken before fpu_init() and inside interrupt handlers
+    fpu_has_sse2 = false;
+    fpu_has_avx = false;
+    string_init();
+    run_checks();
+
+    irq_nesting[0] = 1;
+    fpu_has_sse2 = true;
+    string_init();
+    run_checks();
+    irq_nesting[0] = 0;
+
+    run_checks();
+
+    if (__builtin_cpu_supports("avx")) {
+        fpu_has_avx = true;
+        string_init();
+        run_checks();
+        fpu_has_avx = false;
+    }
+    string_init();
+}
@@ -0,0 +1,146 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "test.h"
+#include "timer.h"
+
+#define TIMER_COUNT 3000
+#define TICK_NS (1ULL << TIMER_TICK_SHIFT)
+
+static struct timer timers[TIMER_COUNT];
+static uint64_t fired_at[TIMER_COUNT];
+static int fired;
+static uint64_t last_fired_tick;
+static bool out_of_order;
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static void record_fire(struct timer *timer) {
+    size_t i = timer - timers;
+    fired_at[i] = host_ktime_ns;
+    fired++;
+
+    // Timers that were already due all fire together on the first tick
+    if (i % 5 == 0)
+        return;
+    if (timer->tick < last_fired_tick)
+        out_of_order = true;
+    last_fired_tick = timer->tick;
+}
+
+// Jump to each armed deadline like the hardware would, up to @limit events
+static void run_until_idle(int limit) {
+    while (host_timer_deadline != UINT64_MAX && limit--) {
+        // The one-shot disarms itself when it fires
+        host_ktime_ns = host_timer_deadline;
+        host_timer_deadline = UINT64_MAX;
+        host_interrupt(host_timer_fn);
+    }
+}
+
+// Timers spread from the past to far beyond the top level; every 7th cancelled
+static void check_random_expiries(void) {
+    host_ktime_ns = 5000000;
+    timer_init();
+    fired = 0;
+    last_fired_tick = 0;
+    out_of_order = false;
+
+    for (int i = 0; i < TIMER_COUNT; i++) {
+        uint64_t expires;
+        switch (i % 5) {
+        case 0:  expires = host_ktime_ns - rng() % host_ktime_ns; break;  // already due
+        case 1:  expires = host_ktime_ns + rng() % (64 * TICK_NS); break;
+        case 2:  expires = host_ktime_ns + rng() % (1ULL << 32); break;
+        case 3:  expires = host_ktime_ns + rng() % (1ULL << 48); break;
+        default: expires = host_ktime_ns + (rng() >> 2); break;             // clamped
+        }
+        timer_setup(&timers[i], record_fire, NULL);
+        fired_at[i] = 0;
+        timer_add(&timers[i], expires);
+    }
+
+    int cancelled = 0;
+    for (int i = 0; i < TIMER_COUNT; i += 7) {
+        CHECK(timer_cancel(&timers[i]));
+        CHECK(!timer_cancel(&timers[i]));
+        cancelled++;
+    }
+
+    run_until_idle(1000000);
+
+    CHECK(host_timer_deadline == UINT64_MAX);
+    CHECK(fired == TIMER_COUNT - cancelled);
+    CHECK(!out_of_order);
+    CHECK(timer_next_expiry() == UINT64_MAX);
+
+    int early = 0, late = 0;
+    for (int i = 0; i < TIMER_COUNT; i++) {
+        if (i % 7 == 0) {
+            CHECK(fired_at[i] == 0);
+            continue;
+        }
+        CHECK(!timer_pending(&timers[i]));
+        if (fired_at[i] < timers[i].expires)
+            early++;
+        // Only the already-due timers may fire more than a tick late
+        if (i % 5 != 0 && fired_at[i] - timers[i].expires >= TICK_NS)
+            late++;
+    }
+    CHECK(early == 0);
+    CHECK(late == 0);
+}
+
+static int periodic_runs;
+
+static void periodic(struct timer *timer) {
+    if (++periodic_runs < 100)
+        timer_add(timer, host_ktime_ns + 1000000);
+}
+
+static struct timer victim;
+
+static void victim_fired(struct timer *timer) {
+    (void)timer;
+    fired++;
+}
+
+static void cancel_victim(struct timer *timer) {
+    (void)timer;
+    timer_cancel(&victim);
+}
+
+// Callbacks may re-arm themselves and cancel timers due in the same tick
+static void check_callbacks(void) {
+    host_ktime_ns = 1000;
+    timer_init();
+    fired = 0;
+
+    periodic_runs = 0;
+    timer_setup(&timers[0], periodic, NULL);
+    timer_add(&timers[0], host_ktime_ns + 1000000);
+    uint64_t start = host_ktime_ns;
+    run_until_idle(1000);
+    CHECK(periodic_runs == 100);
+    CHECK(host_ktime_ns - start >= 100 * 1000000ULL);
+    CHECK(host_ktime_ns - start < 100 * (1000000ULL + TICK_NS));
+
+    timer_setup(&timers[1], cancel_victim, NULL);
+    timer_setup(&victim, victim_fired, NULL);
+    timer_add(&victim, host_ktime_ns + 10);
+    timer_add(&timers[1], host_ktime_ns + 10);
+    run_until_idle(10);
+    CHECK(fired == 0);
+    CHECK(!timer_pending(&victim));
+}
+
+void test_timer(void) {
+    check_random_expiries();
+    check_callbacks();
+}
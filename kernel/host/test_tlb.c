@@ -0,0 +1,79 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "test.h"
+#include "tlb.h"
+#include "idt.h"
+#include "pmm_mngr.h"
+#include "vmm_mngr.h"
+#include "vmm_mngr_utils.h"
+
+// A canonical higher-half address in a PML4 slot nothing else uses
+#define TEST_VIRT 0xFFFF920000000000ULL
+
+// The host is CPU 0; CPU 1 is simulated by editing its tlb_cpus entry. It
+// stays lazy, since an active CPU would need an answer to its IPI.
+void test_tlb(void) {
+    host_memory_init();
+    tlb_init_cpu();
+    struct tlb_cpu *self = &tlb_cpus[0];
+    struct tlb_cpu *other = &tlb_cpus[1];
+    CHECK(self->state == TLB_ACTIVE);
+    other->state = TLB_LAZY;
+
+    // Filling empty slots caches nothing anywhere, so there is nothing to send
+    vmm_map_range(TEST_VIRT, 40 * PAGE_SIZE, 0x400000, PAGE_WRITE);
+    CHECK(self->count == 0 && !self->full);
+    CHECK(other->state == TLB_LAZY);
+
+    // A batch collects every page and sends once, at the outermost end
+    tlb_batch_begin();
+    tlb_batch_begin();
+    vmm_unmap_recursive(TEST_VIRT);
+    vmm_change_flags(TEST_VIRT + PAGE_SIZE, 0);
+    tlb_batch_end();
+    CHECK(self->count == 2);
+    CHECK(other->state == TLB_LAZY);
+    tlb_batch_end();
+    CHECK(self->count == 0);
+
+    // The idle CPU got no IPI, only the mark that makes it flush on waking
+    CHECK(other->state == TLB_LAZY_STALE);
+    CHECK(host_ipis_sent == 0 && self->shootdowns == 0);
+
+    // Replacing a present mapping needs a shootdown too
+    other->state = TLB_LAZY;
+    vmm_map_recursive(TEST_VIRT + PAGE_SIZE, 0x500000, PAGE_WRITE);
+    CHECK(other->state == TLB_LAZY_STALE);
+
+    // More pages than a batch holds turn into a full flush
+    tlb_batch_begin();
+    vmm_unmap_range(TEST_VIRT + 2 * PAGE_SIZE, 38 * PAGE_SIZE);
+    CHECK(self->count == TLB_BATCH_MAX && self->full);
+    tlb_batch_end();
+    CHECK(self->count == 0 && !self->full);
+    CHECK(vmm_query_mapping(TEST_VIRT + 39 * PAGE_SIZE).phys_addr == 0);
+
+    // A stale CPU flushes once when an interrupt wakes it, and goes back to
+    // lazy mode when the interrupt returns
+    other->state = TLB_OFFLINE;
+    tlb_idle_enter();
+    CHECK(self->state == TLB_LAZY);
+    self->state = TLB_LAZY_STALE;
+    irq_enter();
+    CHECK(self->state == TLB_ACTIVE && self->lazy_flushes == 1);
+    irq_enter();
+    irq_exit();
+    CHECK(self->state == TLB_ACTIVE);
+    irq_exit();
+    CHECK(self->state == TLB_LAZY);
+    tlb_idle_exit();
+    CHECK(self->state == TLB_ACTIVE && self->lazy_flushes == 1);
+
+    // Leaving a stale idle period flushes as well
+    tlb_idle_enter();
+    self->state = TLB_LAZY_STALE;
+    tlb_idle_exit();
+    CHECK(self->state == TLB_ACTIVE && self->lazy_flushes == 2);
+
+    vmm_unmap_recursive(TEST_VIRT + PAGE_SIZE);
+}
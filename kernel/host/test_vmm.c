@@ -0,0 +1,83 @@
+#include "test.h"
+#include "pmm_mngr.h"
+#include "vmm_mngr.h"
+#include "vmm_mngr_utils.h"
+
+// A canonical higher-half address in a PML4 slot nothing else uses
+#define TEST_VIRT 0xFFFF910000000000ULL
+
+static void test_map_query_unmap(void) {
+    host_memory_init();
+    uint64_t used = get_used_frame_count();
+
+    vmm_map_recursive(TEST_VIRT, 0x345000, PAGE_WRITE);
+
+    // A fresh slot needs a PDPT, a PD and a PT
+    CHECK(get_used_frame_count() == used + 3);
+
+    mapping_info_t info = vmm_query_mapping(TEST_VIRT);
+    CHECK(info.phys_addr == 0x345000);
+    CHECK(info.flags == (PAGE_PRESENT | PAGE_WRITE));
+    CHECK(*get_pte_ptr(TEST_VIRT) == (0x345000 | PAGE_PRESENT | PAGE_WRITE));
+
+    // The neighbour shares all three tables
+    vmm_map_recursive(TEST_VIRT + PAGE_SIZE, 0x346000, 0);
+    CHECK(get_used_frame_count() == used + 3);
+    CHECK(vmm_query_mapping(TEST_VIRT + PAGE_SIZE).flags == PAGE_PRESENT);
+
+    vmm_change_flags(TEST_VIRT, PAGE_USER);
+    info = vmm_query_mapping(TEST_VIRT);
+    CHECK(info.phys_addr == 0x345000);
+    CHECK(info.flags == (PAGE_PRESENT | PAGE_USER));
+
+    vmm_unmap_recursive(TEST_VIRT);
+    info = vmm_query_mapping(TEST_VIRT);
+    CHECK(info.phys_addr == 0 && info.flags == 0);
+    CHECK(vmm_query_mapping(TEST_VIRT + PAGE_SIZE).phys_addr == 0x346000);
+}
+
+static void test_map_range(void) {
+    host_memory_init();
+
+    // Crosses a page-table boundary (512 pages per PT)
+    const size_t pages = 700;
+    virt_addr_t base = TEST_VIRT + 0x1FF000;
+    vmm_map_range(base, pages * PAGE_SIZE, 0x800000, PAGE_WRITE);
+
+    int wrong = 0;
+    for (size_t i = 0; i < pages; i++) {
+        mapping_info_t info = vmm_query_mapping(base + i * PAGE_SIZE);
+        if (info.phys_addr != 0x800000 + i * PAGE_SIZE || info.flags != (PAGE_PRESENT | PAGE_WRITE))
+            wrong++;
+    }
+    CHECK(wrong == 0);
+
+    // New tables are cleared before use, so the next slot over is empty
+    CHECK(vmm_query_mapping(base - PAGE_SIZE).flags == 0);
+
+    vmm_unmap_range(base, pages * PAGE_SIZE);
+    for (size_t i = 0; i < pages; i++)
+        if (vmm_query_mapping(base + i * PAGE_SIZE).flags != 0)
+            wrong++;
+    CHECK(wrong == 0);
+}
+
+static void test_recursive_view(void) {
+    host_memory_init();
+    vmm_map_recursive(TEST_VIRT, 0x345000, PAGE_WRITE);
+
+    // PML4 seen through the recursive slot is the table host_cr3 points at
+    uint64_t *pml4 = RECURSIVE_PML4;
+    CHECK((uint8_t *)pml4 == host_phys + host_cr3);
+    CHECK((pml4[RECURSIVE_INDEX] & ~0xFFFULL) == host_cr3);
+
+    uint16_t pml4_idx = (TEST_VIRT >> 39) & 0x1FF;
+    CHECK(pml4[pml4_idx] & PAGE_PRESENT);
+    CHECK((uint8_t *)RECURSIVE_PDPT(pml4_idx) == host_phys + (pml4[pml4_idx] & ~0xFFFULL));
+}
+
+void test_vmm(void) {
+    test_map_query_unmap();
+    test_map_range();
+    test_recursive_view();
+}
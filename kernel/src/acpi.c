@@ -0,0 +1,121 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "acpi.h"
+#include "ioremap.h"
+#include "limine_requests.h"
+#include "string.h"
+
+struct __attribute__((packed)) acpi_rsdp {
+    char     signature[8];  // "RSD PTR "
+    uint8_t  checksum;
+    char     oem_id[6];
+    uint8_t  revision;      // 0 for ACPI 1.0, 2 and up has the XSDT
+    uint32_t rsdt_address;
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t  extended_checksum;
+    uint8_t  reserved[3];
+};
+
+static bool acpi_checksum_ok(const void *table, size_t length) {
+    const uint8_t *bytes = table;
+    uint8_t sum = 0;
+    for (size_t i = 0; i < length; i++)
+        sum += bytes[i];
+    return sum == 0;
+}
+
+// Map a whole table: the header first to learn its length
+static const struct acpi_sdt_header *acpi_map_table(phys_addr_t phys) {
+    const struct acpi_sdt_header *header =
+        ioremap(phys, sizeof(struct acpi_sdt_header), CACHE_WB);
+    if (!header)
+        return NULL;
+    uint32_t length = header->length;
+    iounmap((void *)header, sizeof(struct acpi_sdt_header));
+
+    if (length < sizeof(struct acpi_sdt_header))
+        return NULL;
+    return ioremap(phys, length, CACHE_WB);
+}
+
+static void acpi_unmap_table(const struct acpi_sdt_header *table) {
+    iounmap((void *)table, table->length);
+}
+
+// Signature, the ACPI 1.0 checksum and, from revision 2, the extended one
+// over the whole structure
+static bool acpi_rsdp_ok(phys_addr_t phys, bool *xsdt, uint64_t *root) {
+    const struct acpi_rsdp *rsdp = ioremap(phys, sizeof(struct acpi_rsdp), CACHE_WB);
+    if (!rsdp)
+        return false;
+
+    bool ok = memcmp(rsdp->signature, "RSD PTR ", 8) == 0 && acpi_checksum_ok(rsdp, 20);
+    uint32_t length = rsdp->length;
+    if (ok) {
+        *xsdt = rsdp->revision >= 2 && rsdp->xsdt_address;
+        *root = *xsdt ? rsdp->xsdt_address : rsdp->rsdt_address;
+    }
+    bool extended = ok && rsdp->revision >= 2;
+    iounmap((void *)rsdp, sizeof(struct acpi_rsdp));
+
+    if (extended) {
+        const void *whole = length >= sizeof(struct acpi_rsdp) ?
+                            ioremap(phys, length, CACHE_WB) : NULL;
+        ok = whole && acpi_checksum_ok(whole, length);
+        if (whole)
+            iounmap((void *)whole, length);
+    }
+    return ok;
+}
+
+const struct acpi_sdt_header *acpi_find_table(const char *signature) {
+    if (!rsdp_request.response || !rsdp_request.response->address)
+        return NULL;
+
+    bool xsdt;
+    uint64_t root_phys;
+    if (!acpi_rsdp_ok((phys_addr_t)rsdp_request.response->address, &xsdt, &root_phys))
+        return NULL;
+
+    const struct acpi_sdt_header *root = acpi_map_table(root_phys);
+    if (!root)
+        return NULL;
+    if (!acpi_checksum_ok(root, root->length)) {
+        acpi_unmap_table(root);
+        return NULL;
+    }
+
+    // The root table is followed by 64-bit (XSDT) or 32-bit (RSDT) pointers
+    size_t entry_size = xsdt ? 8 : 4;
+    size_t entries = (root->length - sizeof(*root)) / entry_size;
+    const uint8_t *pointers = (const uint8_t *)(root + 1);
+    const struct acpi_sdt_header *found = NULL;
+
+    for (size_t i = 0; i < entries && !found; i++) {
+        uint64_t phys = 0;
+        memcpy(&phys, pointers + i * entry_size, entry_size);
+
+        // Only the header is needed to skip a table
+        const struct acpi_sdt_header *header =
+            ioremap(phys, sizeof(struct acpi_sdt_header), CACHE_WB);
+        if (!header)
+            continue;
+        bool match = memcmp(header->signature, signature, 4) == 0;
+        iounmap((void *)header, sizeof(struct acpi_sdt_header));
+        if (!match)
+            continue;
+
+        const struct acpi_sdt_header *table = acpi_map_table(phys);
+        if (!table)
+            continue;
+        if (acpi_checksum_ok(table, table->length))
+            found = table;
+        else
+            acpi_unmap_table(table);
+    }
+
+    acpi_unmap_table(root);
+    return found;
+}
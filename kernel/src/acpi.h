@@ -0,0 +1,41 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+
+// Common header of every ACPI system description table
+struct __attribute__((packed)) acpi_sdt_header {
+    char     signature[4];
+    uint32_t length;        // Including this header
+    uint8_t  revision;
+    uint8_t  checksum;
+    char     oem_id[6];
+    char     oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+};
+
+// Generic address structure, used to describe register blocks
+struct __attribute__((packed)) acpi_gas {
+    uint8_t  address_space;  // 0: system memory, 1: system I/O
+    uint8_t  bit_width;
+    uint8_t  bit_offset;
+    uint8_t  access_size;
+    uint64_t address;
+};
+
+/**
+ * acpi_find_table - Look up an ACPI table by signature.
+ *
+ * @signature: Four character table signature, e.g. "HPET".
+ *
+ * Walks the XSDT (or the RSDT on ACPI 1.0 firmware) found through the Limine
+ * RSDP response and maps the first table with a valid checksum through
+ * ioremap(). Returns NULL if there is no such table. Only the returned
+ * table stays mapped; it is never released, so callers should look tables
+ * up once.
+ */
+const struct acpi_sdt_header *acpi_find_table(const char *signature);
+
+#endif // ACPI_H
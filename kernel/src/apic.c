@@ -0,0 +1,193 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "apic.h"
+#include "cpu.h"
+#include "isr.h"
+#include "ioremap.h"
+#include "clocksource.h"
+#include "klog.h"
+
+// APIC timer calibration interval
+#define CALIBRATE_NS 10000000
+
+bool apic_x2apic = false;
+
+static volatile uint32_t *lapic_mmio;
+
+static bool timer_tsc_deadline;
+static uint64_t tsc_to_count_mult;  // APIC timer counts per TSC cycle, 32.32
+static void (*timer_fn)(void);
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    if (apic_x2apic)
+        return (uint32_t)rdmsr(MSR_X2APIC_BASE + (reg >> 4));
+    return lapic_mmio[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    if (apic_x2apic)
+        wrmsr(MSR_X2APIC_BASE + (reg >> 4), value);
+    else
+        lapic_mmio[reg / 4] = value;
+}
+
+static inline uint64_t mul_shift32(uint64_t a, uint64_t mult) {
+    return (uint64_t)(((unsigned __int128)a * mult) >> 32);
+}
+
+// Spurious interrupts are not in service, so they take no EOI
+static void apic_spurious(struct isr_frame *frame) {
+    (void)frame;
+}
+
+static void apic_timer_irq(struct isr_frame *frame) {
+    (void)frame;
+    apic_eoi();
+    if (timer_fn)
+        timer_fn();
+}
+
+void apic_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+
+    if (!((edx >> 9) & 1))
+        panic("No local APIC\n");
+    bool has_x2apic = (ecx >> 21) & 1;
+
+    uint64_t base = rdmsr(MSR_IA32_APIC_BASE);
+    // xAPIC must be enabled before switching to x2APIC
+    base |= APIC_BASE_ENABLE;
+    wrmsr(MSR_IA32_APIC_BASE, base);
+
+    if (has_x2apic) {
+        wrmsr(MSR_IA32_APIC_BASE, base | APIC_BASE_EXTD);
+        apic_x2apic = true;
+    } else if (!lapic_mmio) {
+        lapic_mmio = ioremap(base & 0x000FFFFFFFFFF000ULL, 4096, CACHE_UC);
+        if (!lapic_mmio)
+            panic("Cannot map the local APIC\n");
+    }
+
+    isr_register(APIC_SPURIOUS_VECTOR, apic_spurious);
+    isr_register(APIC_TIMER_VECTOR, apic_timer_irq);
+
+    // Accept every priority, mask the timer and error LVTs until needed
+    lapic_write(APIC_TPR, 0);
+    lapic_write(APIC_LVT_TIMER, APIC_LVT_MASKED | APIC_TIMER_VECTOR);
+    lapic_write(APIC_LVT_ERROR, APIC_LVT_MASKED);
+
+    // Virtual wire mode: the 8259 interrupts arrive as ExtINT on the BSP's
+    // LINT0; application processors leave it masked
+    lapic_write(APIC_LVT_LINT0, (base & APIC_BASE_BSP) ? APIC_LVT_EXTINT : APIC_LVT_MASKED);
+    lapic_write(APIC_LVT_LINT1, APIC_LVT_NMI);
+
+    // Clearing the error status register takes two writes
+    lapic_write(APIC_ESR, 0);
+    lapic_write(APIC_ESR, 0);
+
+    lapic_write(APIC_SVR, APIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+    apic_eoi();
+}
+
+uint32_t apic_id(void) {
+    if (apic_x2apic)
+        return lapic_read(APIC_ID);
+    return lapic_read(APIC_ID) >> 24;
+}
+
+void apic_eoi(void) {
+    lapic_write(APIC_EOI, 0);
+}
+
+void apic_send_ipi(uint32_t apic_id, uint8_t vector) {
+    uint64_t flags = irq_save();
+    if (apic_x2apic) {
+        // One 64-bit ICR write, destination in the upper half
+        wrmsr(MSR_X2APIC_BASE + (APIC_ICR_LOW >> 4), ((uint64_t)apic_id << 32) | vector);
+    } else {
+        while (lapic_read(APIC_ICR_LOW) & APIC_ICR_PENDING)
+            asm volatile ("pause");
+        lapic_write(APIC_ICR_HIGH, apic_id << 24);
+        lapic_write(APIC_ICR_LOW, vector);
+    }
+    irq_restore(flags);
+}
+
+void apic_send_nmi_all_but_self(void) {
+    uint64_t flags = irq_save();
+    if (apic_x2apic) {
+        wrmsr(MSR_X2APIC_BASE + (APIC_ICR_LOW >> 4), APIC_ICR_ALL_BUT_SELF | APIC_ICR_NMI);
+    } else {
+        while (lapic_read(APIC_ICR_LOW) & APIC_ICR_PENDING)
+            asm volatile ("pause");
+        lapic_write(APIC_ICR_LOW, APIC_ICR_ALL_BUT_SELF | APIC_ICR_NMI);
+    }
+    irq_restore(flags);
+}
+
+void apic_timer_init(void (*fn)(void)) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    timer_tsc_deadline = (ecx >> 24) & 1;
+
+    if (!timer_tsc_deadline) {
+        // Let the APIC timer run down from its maximum against the calibrated TSC
+        lapic_write(APIC_TIMER_DIV, 0xB);    // divide by 1
+        lapic_write(APIC_LVT_TIMER, APIC_LVT_MASKED | APIC_TIMER_ONESHOT | APIC_TIMER_VECTOR);
+        lapic_write(APIC_TIMER_INIT, 0xFFFFFFFF);
+
+        uint64_t tsc_start = rdtsc();
+        uint64_t window = tsc_ns_to_cycles(CALIBRATE_NS);
+        while (rdtsc() - tsc_start < window)
+            asm volatile ("pause");
+        uint32_t remaining = lapic_read(APIC_TIMER_COUNT);
+        uint64_t elapsed = rdtsc() - tsc_start;
+        lapic_write(APIC_TIMER_INIT, 0);
+
+        // APIC timer counts per TSC cycle
+        tsc_to_count_mult = (uint64_t)(((unsigned __int128)(0xFFFFFFFFU - remaining) << 32) / elapsed);
+    }
+
+    timer_fn = fn;
+    if (timer_tsc_deadline) {
+        lapic_write(APIC_LVT_TIMER, APIC_TIMER_TSC_DEADLINE | APIC_TIMER_VECTOR);
+        // Order the LVT write before the first IA32_TSC_DEADLINE write
+        asm volatile ("mfence" : : : "memory");
+    } else {
+        lapic_write(APIC_TIMER_DIV, 0xB);
+        lapic_write(APIC_LVT_TIMER, APIC_TIMER_ONESHOT | APIC_TIMER_VECTOR);
+    }
+}
+
+void apic_timer_set_deadline(uint64_t tsc) {
+    if (timer_tsc_deadline) {
+        // A zero deadline would disarm the timer instead
+        wrmsr(MSR_IA32_TSC_DEADLINE, tsc ? tsc : 1);
+        return;
+    }
+
+    uint64_t now = rdtsc();
+    uint64_t count = tsc > now ? mul_shift32(tsc - now, tsc_to_count_mult) : 0;
+    if (count == 0)
+        count = 1;
+    if (count > 0xFFFFFFFFU)
+        count = 0xFFFFFFFFU;
+    lapic_write(APIC_TIMER_INIT, (uint32_t)count);
+}
+
+void apic_timer_set_ns(uint64_t ns) {
+    apic_timer_set_deadline(rdtsc() + tsc_ns_to_cycles(ns));
+}
+
+void apic_timer_cancel(void) {
+    if (timer_tsc_deadline)
+        wrmsr(MSR_IA32_TSC_DEADLINE, 0);
+    else
+        lapic_write(APIC_TIMER_INIT, 0);
+}
+
+const char *apic_timer_mode_name(void) {
+    return timer_tsc_deadline ? "tsc-deadline" : "one-shot";
+}
@@ -0,0 +1,112 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Vectors owned by the local APIC, above the remapped 8259 range
+#define APIC_TIMER_VECTOR    0xF0
+#define APIC_SPURIOUS_VECTOR 0xFF
+
+// Model specific registers
+#define MSR_IA32_APIC_BASE    0x1B
+#define MSR_IA32_TSC_DEADLINE 0x6E0
+#define MSR_X2APIC_BASE       0x800   // x2APIC register N lives at 0x800 + (N >> 4)
+
+// IA32_APIC_BASE bits
+#define APIC_BASE_BSP    (1ULL << 8)
+#define APIC_BASE_EXTD   (1ULL << 10)  // x2APIC mode
+#define APIC_BASE_ENABLE (1ULL << 11)
+
+// Register offsets in the xAPIC MMIO page
+#define APIC_ID          0x020
+#define APIC_VERSION     0x030
+#define APIC_TPR         0x080
+#define APIC_EOI         0x0B0
+#define APIC_SVR         0x0F0
+#define APIC_ESR         0x280
+#define APIC_ICR_LOW     0x300
+#define APIC_ICR_HIGH    0x310
+#define APIC_LVT_TIMER   0x320
+#define APIC_LVT_LINT0   0x350
+#define APIC_LVT_LINT1   0x360
+#define APIC_LVT_ERROR   0x370
+#define APIC_TIMER_INIT  0x380
+#define APIC_TIMER_COUNT 0x390
+#define APIC_TIMER_DIV   0x3E0
+
+// Local vector table fields
+#define APIC_LVT_MASKED       (1U << 16)
+#define APIC_LVT_EXTINT       (7U << 8)
+#define APIC_LVT_NMI          (4U << 8)
+#define APIC_TIMER_ONESHOT    (0U << 17)
+#define APIC_TIMER_PERIODIC   (1U << 17)
+#define APIC_TIMER_TSC_DEADLINE (2U << 17)
+#define APIC_SVR_ENABLE       (1U << 8)
+#define APIC_ICR_PENDING      (1U << 12)  // xAPIC delivery status
+#define APIC_ICR_NMI          (4U << 8)   // Delivery mode; the vector is ignored
+#define APIC_ICR_ALL_BUT_SELF (3U << 18)  // Destination shorthand
+
+// True once apic_init() switched the local APIC to x2APIC mode
+extern bool apic_x2apic;
+
+/**
+ * apic_init - Enable the local APIC of the executing CPU.
+ *
+ * Uses x2APIC (MSR access) when CPUID advertises it, otherwise maps the xAPIC
+ * page uncached through ioremap(). On the BSP, LINT0 is set to ExtINT so the
+ * 8259, which pic_init() leaves fully masked except for lines drivers unmask,
+ * keeps delivering legacy IRQs in virtual wire mode; LINT1 is the NMI input.
+ * Needs the IDT and, for xAPIC, the recursive mapping.
+ */
+void apic_init(void);
+
+// APIC ID of the executing CPU
+uint32_t apic_id(void);
+
+// Signal end of interrupt for the vector being serviced
+void apic_eoi(void);
+
+/**
+ * apic_send_ipi - Send a fixed inter-processor interrupt.
+ *
+ * @apic_id: Local APIC ID of the target CPU.
+ * @vector:  Vector to raise on the target.
+ */
+void apic_send_ipi(uint32_t apic_id, uint8_t vector);
+
+// Send an NMI to every other CPU, including those with interrupts disabled
+void apic_send_nmi_all_but_self(void);
+
+/**
+ * apic_timer_init - Calibrate and enable the local APIC timer.
+ *
+ * @fn: Called from the timer interrupt (after the EOI) on every expiry.
+ *
+ * Picks TSC-deadline mode when CPUID leaf 1 advertises it and falls back to
+ * one-shot mode otherwise, measuring the APIC timer rate against the TSC.
+ * Needs clocksource_init(). The timer starts disarmed.
+ */
+void apic_timer_init(void (*fn)(void));
+
+/**
+ * apic_timer_set_deadline - Arm the timer to fire at a TSC value.
+ *
+ * @tsc: Absolute TSC deadline; a value in the past fires immediately.
+ *
+ * In TSC-deadline mode this is a single WRMSR. In one-shot mode the remaining
+ * interval is converted to APIC timer counts (one register write). Re-arming
+ * replaces any pending deadline.
+ */
+void apic_timer_set_deadline(uint64_t tsc);
+
+// Arm the timer @ns nanoseconds from now
+void apic_timer_set_ns(uint64_t ns);
+
+// Disarm the timer
+void apic_timer_cancel(void);
+
+// "tsc-deadline" or "one-shot"
+const char *apic_timer_mode_name(void);
+
+#endif // APIC_H
@@ -0,0 +1,271 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bench.h"
+#include "clocksource.h"
+#include "cpu.h"
+#include "limine_requests.h"
+#include "isr.h"
+#include "pmm_mngr.h"
+#include "printf.h"
+#include "serial.h"
+#include "string.h"
+#include "text_renderer.h"
+#include "timer.h"
+#include "vmm_mngr.h"
+
+// Scratch page in PML4 slot 260, unused by the rest of the kernel
+#define BENCH_VIRT 0xFFFF820000000000ULL
+
+static uint64_t bench_frame;
+
+// Frame the bench fault handler maps at the faulting address
+static volatile uint64_t bench_fault_frame;
+static volatile uint64_t bench_faults;
+static isr_handler_t saved_pf_handler;
+
+bool bench_requested(void) {
+    return cmdline_has("bench");
+}
+
+static void pmm_alloc_free(uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; i++)
+        pmm_free(pmm_alloc());
+}
+
+static void scratch_setup(void) {
+    bench_frame = pmm_alloc();
+    // Allocate the intermediate tables once so runs only touch the PTE
+    vmm_map_recursive(BENCH_VIRT, bench_frame, PAGE_WRITE);
+}
+
+static void scratch_teardown(void) {
+    vmm_unmap_recursive(BENCH_VIRT);
+    pmm_free(bench_frame);
+}
+
+// Map, touch (TLB fill), unmap (invlpg)
+static void vmm_map_unmap(uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; i++) {
+        vmm_map_recursive(BENCH_VIRT, bench_frame, PAGE_WRITE);
+        *(volatile uint64_t *)BENCH_VIRT = i;
+        vmm_unmap_recursive(BENCH_VIRT);
+    }
+}
+
+// Demand-maps the faulting page and retries the access
+static void bench_fault_handler(struct isr_frame *frame) {
+    (void)frame;
+
+    uint64_t cr2;
+    asm volatile ("mov %%cr2, %0" : "=r"(cr2));
+    vmm_map_recursive(cr2 & ~0xFFFULL, bench_fault_frame, PAGE_WRITE);
+    bench_faults++;
+}
+
+static void fault_setup(void) {
+    scratch_setup();
+    bench_fault_frame = bench_frame;
+    saved_pf_handler = isr_register(14, bench_fault_handler);
+}
+
+static void fault_teardown(void) {
+    isr_register(14, saved_pf_handler);
+    scratch_teardown();
+}
+
+// Unmap, then let the write fault the page back in
+static void page_fault_roundtrip(uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; i++) {
+        vmm_unmap_recursive(BENCH_VIRT);
+        *(volatile uint64_t *)BENCH_VIRT = i;
+    }
+}
+
+static void snprintf_line(uint64_t iterations) {
+    char buf[128];
+    for (uint64_t i = 0; i < iterations; i++)
+        snprintf(buf, sizeof(buf), "bench %lu: %s 0x%lx %d\n", i, "fmt", i * 4096, -42);
+}
+
+// Formatting into the log ring, plus the drains a full ring forces
+static void kprintf_line(uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; i++)
+        kprintf("bench kprintf %lu\n", i);
+}
+
+// Page clear/copy: the non-temporal clear_page()/copy_page() against rep
+// stosb/movsb. Each run also re-reads a small working set afterwards, so what
+// the stores evicted from the cache is part of the cost per page.
+#define PAGE_BENCH_PAGES 64
+#define PAGE_BENCH_HOT_PAGES 8
+
+static uint64_t page_bench_phys;
+static uint8_t *page_bench_buf;
+static uint8_t *page_bench_hot;
+
+static void touch_hot_set(void) {
+    volatile uint8_t *p = page_bench_hot;
+    for (size_t i = 0; i < PAGE_BENCH_HOT_PAGES * PAGE_SIZE; i += 64)
+        (void)p[i];
+}
+
+static void page_bench_setup(void) {
+    page_bench_phys = pmm_alloc_contig(PAGE_BENCH_PAGES + PAGE_BENCH_HOT_PAGES);
+    page_bench_buf = (uint8_t *)(page_bench_phys + HHDM_OFFSET);
+    page_bench_hot = page_bench_buf + PAGE_BENCH_PAGES * PAGE_SIZE;
+    memset(page_bench_buf, 0, (PAGE_BENCH_PAGES + PAGE_BENCH_HOT_PAGES) * PAGE_SIZE);
+}
+
+static void page_bench_teardown(void) {
+    for (int i = 0; i < PAGE_BENCH_PAGES + PAGE_BENCH_HOT_PAGES; i++)
+        pmm_free(page_bench_phys + i * PAGE_SIZE);
+}
+
+static void rep_stosb_page(void *page) {
+    size_t n = PAGE_SIZE;
+    asm volatile ("rep stosb" : "+D"(page), "+c"(n) : "a"(0) : "memory");
+}
+
+static void rep_movsb_page(void *dst, const void *src) {
+    size_t n = PAGE_SIZE;
+    asm volatile ("rep movsb" : "+D"(dst), "+S"(src), "+c"(n) : : "memory");
+}
+
+static void page_clear_run(uint64_t iterations, void (*clear)(void *)) {
+    touch_hot_set();
+    for (uint64_t i = 0; i < iterations; i++)
+        clear(page_bench_buf + (i % PAGE_BENCH_PAGES) * PAGE_SIZE);
+    touch_hot_set();
+}
+
+// Copies go from the lower half of the buffer to the upper half
+static void page_copy_run(uint64_t iterations, void (*copy)(void *, const void *)) {
+    const uint64_t half = PAGE_BENCH_PAGES / 2;
+    touch_hot_set();
+    for (uint64_t i = 0; i < iterations; i++)
+        copy(page_bench_buf + (half + i % half) * PAGE_SIZE,
+             page_bench_buf + (i % half) * PAGE_SIZE);
+    touch_hot_set();
+}
+
+static void clear_page_nt(uint64_t iterations) {
+    page_clear_run(iterations, clear_page);
+}
+
+static void clear_page_stosb(uint64_t iterations) {
+    page_clear_run(iterations, rep_stosb_page);
+}
+
+static void copy_page_nt(uint64_t iterations) {
+    page_copy_run(iterations, copy_page);
+}
+
+static void copy_page_movsb(uint64_t iterations) {
+    page_copy_run(iterations, rep_movsb_page);
+}
+
+static struct timer bench_timers[64];
+
+static void bench_timer_fn(struct timer *timer) {
+    (void)timer;
+}
+
+// Arm and cancel timers spread over every wheel level
+static void timer_add_cancel(uint64_t iterations) {
+    uint64_t now = ktime_get_ns();
+    for (uint64_t i = 0; i < iterations; i++) {
+        struct timer *timer = &bench_timers[i % 64];
+        timer_setup(timer, bench_timer_fn, NULL);
+        timer_add(timer, now + 1000000000ULL + (i * 0x9E3779B97F4AULL) % (1ULL << 44));
+        if (i % 64 == 63) {
+            for (int j = 0; j < 64; j++)
+                timer_cancel(&bench_timers[j]);
+        }
+    }
+    for (int j = 0; j < 64; j++)
+        timer_cancel(&bench_timers[j]);
+}
+
+// One line of scroll, including repainting the screen
+static void console_scroll(uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; i++) {
+        scroll_screen();
+        console_flush();
+    }
+}
+
+static const struct bench_case bench_cases[] = {
+    { "pmm_alloc_free",       1000, NULL,             pmm_alloc_free,       NULL },
+    { "vmm_map_unmap",        1000, scratch_setup,    vmm_map_unmap,        scratch_teardown },
+    { "page_fault_roundtrip", 1000, fault_setup,      page_fault_roundtrip, fault_teardown },
+    { "clear_page",           2048, page_bench_setup, clear_page_nt,        page_bench_teardown },
+    { "clear_page_stosb",     2048, page_bench_setup, clear_page_stosb,     page_bench_teardown },
+    { "copy_page",            1024, page_bench_setup, copy_page_nt,         page_bench_teardown },
+    { "copy_page_movsb",      1024, page_bench_setup, copy_page_movsb,      page_bench_teardown },
+    { "snprintf",             1000, NULL,             snprintf_line,        NULL },
+    { "kprintf",               100, NULL,             kprintf_line,         NULL },
+    { "console_scroll",         50, NULL,             console_scroll,       NULL },
+    { "console_glyphs",      10000, NULL,             console_bench_glyphs, NULL },
+    { "timer_add_cancel",     1024, NULL,             timer_add_cancel,     NULL },
+};
+
+static void sort_u64(uint64_t *v, size_t n) {
+    for (size_t i = 1; i < n; i++) {
+        uint64_t x = v[i];
+        size_t j = i;
+        for (; j > 0 && v[j - 1] > x; j--)
+            v[j] = v[j - 1];
+        v[j] = x;
+    }
+}
+
+static void bench_emit(const char *line) {
+    serial_write(line, strlen(line));
+}
+
+void bench_run_all(void) {
+    char line[256];
+
+    // Glyph numbers are only comparable between runs with the same blitter
+    snprintf(line, sizeof(line), "BENCH-BEGIN {\"tsc_hz\":%lu,\"runs\":%d,\"blitter\":\"%s\"}\n",
+             tsc_hz(), BENCH_RUNS, console_blitter_name());
+    bench_emit(line);
+
+    for (size_t b = 0; b < sizeof(bench_cases) / sizeof(bench_cases[0]); b++) {
+        const struct bench_case *bc = &bench_cases[b];
+        uint64_t per_op[BENCH_RUNS];
+
+        if (bc->setup)
+            bc->setup();
+        for (int r = 0; r < BENCH_RUNS; r++) {
+            uint64_t start = rdtsc();
+            bc->run(bc->iterations);
+            per_op[r] = (rdtsc() - start) / bc->iterations;
+        }
+        if (bc->teardown)
+            bc->teardown();
+
+        sort_u64(per_op, BENCH_RUNS);
+        uint64_t min = per_op[0], median = per_op[BENCH_RUNS / 2];
+
+        kprintf("bench %-22s %8lu cycles/op (median %lu)\n", bc->name, min, median);
+        snprintf(line, sizeof(line),
+                 "{\"name\":\"%s\",\"iterations\":%lu,\"min_cycles\":%lu,\"median_cycles\":%lu}\n",
+                 bc->name, bc->iterations, min, median);
+        bench_emit(line);
+    }
+
+    snprintf(line, sizeof(line), "BENCH-END {\"page_faults\":%lu}\n", bench_faults);
+    bench_emit(line);
+}
+
+void bench_exit(uint8_t code) {
+    serial_flush_sync();
+    outb(QEMU_DEBUG_EXIT_PORT, code);
+
+    // Not running under QEMU with isa-debug-exit
+    asm volatile ("cli");
+    for (;;)
+        asm volatile ("hlt");
+}
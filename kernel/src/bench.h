@@ -0,0 +1,52 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Timed runs per benchmark; the minimum and median are reported
+#define BENCH_RUNS 7
+
+// isa-debug-exit port configured by `make bench`
+#define QEMU_DEBUG_EXIT_PORT 0xF4
+
+/*
+ * One benchmark. run() performs @iterations operations and is timed as a
+ * whole; setup()/teardown() (optional) bracket all runs and are not timed.
+ */
+struct bench_case {
+    const char *name;
+    uint64_t iterations;
+    void (*setup)(void);
+    void (*run)(uint64_t iterations);
+    void (*teardown)(void);
+};
+
+/**
+ * bench_requested - Check whether the kernel command line asks for bench mode.
+ *
+ * Must be called while the Limine responses are still reachable (before
+ * remap_kernel()).
+ */
+bool bench_requested(void);
+
+/**
+ * bench_run_all - Run every registered benchmark and report the results.
+ *
+ * Results go to COM1 as one JSON object per line between "BENCH-BEGIN" and
+ * "BENCH-END" markers (see tools/bench_compare.py), with a readable summary on
+ * the console. Needs interrupts and the IDT to be set up.
+ */
+void bench_run_all(void);
+
+/**
+ * bench_exit - Flush COM1 and power off QEMU through isa-debug-exit.
+ *
+ * @code: Reported to the host as exit status (code << 1) | 1.
+ *
+ * Halts if the device is absent (e.g. on real hardware).
+ */
+__attribute__((noreturn))
+void bench_exit(uint8_t code);
+
+#endif // BENCH_H
@@ -0,0 +1,116 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "clocksource.h"
+#include "cpu.h"
+#include "hpet.h"
+#include "pit.h"
+#include "klog.h"
+#include "text_renderer.h"
+
+// Length of the calibration window (fits in one PIT one-shot)
+#define CALIBRATE_US 50000
+
+struct clocksource clocksource;
+
+static bool clock_is_tsc;
+static uint64_t clock_base;
+static uint64_t tsc_frequency;
+static uint64_t tsc_to_ns_mult;     // 32.32 fixed point
+static uint64_t ns_to_tsc_mult;     // 32.32 fixed point
+static bool tsc_invariant;
+
+static inline uint64_t mul_shift(uint64_t value, uint64_t mult, uint32_t shift) {
+    return (uint64_t)(((unsigned __int128)value * mult) >> shift);
+}
+
+static uint64_t read_tsc(void) {
+    return rdtsc();
+}
+
+static uint64_t calibrate_tsc_hpet(void) {
+    uint64_t mask = hpet_is_64bit() ? UINT64_MAX : UINT32_MAX;
+    uint64_t ticks = hpet_hz() * CALIBRATE_US / 1000000;
+
+    uint64_t hpet_start = hpet_read();
+    uint64_t tsc_start = rdtsc();
+    uint64_t hpet_end;
+    do {
+        hpet_end = hpet_read();
+    } while (((hpet_end - hpet_start) & mask) < ticks);
+    uint64_t tsc_end = rdtsc();
+
+    return (uint64_t)((unsigned __int128)(tsc_end - tsc_start) * hpet_hz() /
+                      ((hpet_end - hpet_start) & mask));
+}
+
+static uint64_t calibrate_tsc_pit(void) {
+    uint16_t ticks = (uint16_t)((uint64_t)PIT_HZ * CALIBRATE_US / 1000000);
+
+    pit_oneshot_start(ticks);
+    uint64_t tsc_start = rdtsc();
+    while (!pit_oneshot_expired())
+        asm volatile ("pause");
+    uint64_t tsc_end = rdtsc();
+
+    return (tsc_end - tsc_start) * PIT_HZ / ticks;
+}
+
+static void clocksource_set(const char *name, uint64_t (*read)(void), uint64_t hz) {
+    clocksource.name = name;
+    clocksource.read = read;
+    clocksource.hz = hz;
+    clocksource.shift = 32;
+    clocksource.mult = (uint64_t)(((unsigned __int128)NSEC_PER_SEC << 32) / hz);
+}
+
+void clocksource_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0x80000000, 0, &eax, &ebx, &ecx, &edx);
+    if (eax >= 0x80000007) {
+        cpuid(0x80000007, 0, &eax, &ebx, &ecx, &edx);
+        tsc_invariant = (edx >> 8) & 1;
+    }
+
+    bool has_hpet = hpet_init();
+    tsc_frequency = has_hpet ? calibrate_tsc_hpet() : calibrate_tsc_pit();
+    tsc_to_ns_mult = (uint64_t)(((unsigned __int128)NSEC_PER_SEC << 32) / tsc_frequency);
+    ns_to_tsc_mult = (uint64_t)(((unsigned __int128)tsc_frequency << 32) / NSEC_PER_SEC);
+
+    if (!tsc_invariant && has_hpet && hpet_is_64bit()) {
+        clocksource_set("hpet", hpet_read, hpet_hz());
+        clock_is_tsc = false;
+    } else {
+        clocksource_set("tsc", read_tsc, tsc_frequency);
+        clock_is_tsc = true;
+    }
+    clock_base = clocksource.read();
+
+    kprintf("Clocksource: %s%s, TSC %lu.%03lu MHz (calibrated against %s)\n",
+            clocksource.name, tsc_invariant ? "" : " (TSC not invariant)",
+            tsc_frequency / 1000000, tsc_frequency / 1000 % 1000, has_hpet ? "HPET" : "PIT");
+}
+
+uint64_t tsc_hz(void) {
+    return tsc_frequency;
+}
+
+bool tsc_is_invariant(void) {
+    return tsc_invariant;
+}
+
+uint64_t ktime_get_ns(void) {
+    if (__builtin_expect(!clocksource.read, 0))
+        return 0;
+
+    // Avoid the indirect call on the common path
+    uint64_t now = clock_is_tsc ? rdtsc() : clocksource.read();
+    return mul_shift(now - clock_base, clocksource.mult, clocksource.shift);
+}
+
+uint64_t tsc_cycles_to_ns(uint64_t cycles) {
+    return mul_shift(cycles, tsc_to_ns_mult, 32);
+}
+
+uint64_t tsc_ns_to_cycles(uint64_t ns) {
+    return mul_shift(ns, ns_to_tsc_mult, 32);
+}
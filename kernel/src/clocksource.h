@@ -0,0 +1,49 @@
+#ifndef CLOCKSOURCE_H
+#define CLOCKSOURCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+
+// A free running counter and its conversion to nanoseconds
+struct clocksource {
+    const char *name;
+    uint64_t (*read)(void);
+    uint64_t hz;
+    uint64_t mult;      // ns = (cycles * mult) >> shift
+    uint32_t shift;
+};
+
+/**
+ * clocksource_init - Calibrate the TSC and pick the kernel clock.
+ *
+ * Measures the TSC against the HPET when ACPI describes one, or against PIT
+ * channel 2 otherwise. The TSC becomes the clocksource when CPUID reports it
+ * invariant; if it is not, a 64-bit HPET is used instead, and the TSC is
+ * kept as a last resort. Needs the recursive mapping for ioremap().
+ */
+void clocksource_init(void);
+
+// The clocksource selected by clocksource_init()
+extern struct clocksource clocksource;
+
+// Calibrated TSC frequency in Hz (0 before clocksource_init())
+uint64_t tsc_hz(void);
+
+// True when CPUID leaf 0x80000007 reports a constant-rate TSC
+bool tsc_is_invariant(void);
+
+/**
+ * ktime_get_ns - Nanoseconds since clocksource_init().
+ *
+ * One counter read and a 64x64->128 bit multiply-shift; no locks, safe in
+ * any context. Monotonic on a single CPU.
+ */
+uint64_t ktime_get_ns(void);
+
+// Convert a TSC cycle count to nanoseconds and back
+uint64_t tsc_cycles_to_ns(uint64_t cycles);
+uint64_t tsc_ns_to_cycles(uint64_t ns);
+
+#endif // CLOCKSOURCE_H
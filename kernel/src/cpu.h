@@ -0,0 +1,196 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Upper bound on the number of CPUs the kernel keeps per-CPU state for
+#define MAX_CPUS 32
+
+// Index of the executing CPU, read from its per-CPU area (struct percpu,
+// field cpu_id at offset 8) through GS. Hosted test builds are one CPU.
+static inline uint32_t this_cpu_id(void) {
+#ifdef HOST_TEST
+    return 0;
+#else
+    uint32_t id;
+    asm volatile ("movl %%gs:8, %0" : "=r"(id));
+    return id;
+#endif
+}
+
+// Model specific registers
+#define MSR_IA32_PAT 0x277
+#define MSR_IA32_XSS 0xDA0
+
+// Control register bits
+#define CR0_MP         (1ULL << 1)
+#define CR0_EM         (1ULL << 2)
+#define CR0_TS         (1ULL << 3)
+#define CR4_OSFXSR     (1ULL << 9)
+#define CR4_OSXMMEXCPT (1ULL << 10)
+#define CR4_OSXSAVE    (1ULL << 18)
+
+// XCR0 state components
+#define XCR0_X87 (1ULL << 0)
+#define XCR0_SSE (1ULL << 1)
+#define XCR0_AVX (1ULL << 2)
+
+// Write a byte to an I/O port
+static inline void outb(uint16_t port, uint8_t val) {
+    asm volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+// Read a byte from an I/O port
+static inline uint8_t inb(uint16_t port) {
+    uint8_t ret;
+    asm volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+// Short delay for slow legacy devices (write to the POST port)
+static inline void io_wait(void) {
+    outb(0x80, 0);
+}
+
+// Disable interrupts and return the previous RFLAGS. Hosted unit test
+// builds (HOST_TEST) run in user mode, where CLI would fault.
+static inline uint64_t irq_save(void) {
+    uint64_t flags;
+#ifdef HOST_TEST
+    flags = 0;
+#else
+    asm volatile ("pushfq\n\tpop %0\n\tcli" : "=r"(flags) : : "memory");
+#endif
+    return flags;
+}
+
+// Restore the interrupt flag saved by irq_save()
+static inline void irq_restore(uint64_t flags) {
+    if (flags & (1 << 9))
+        asm volatile ("sti" : : : "memory");
+}
+
+// Unconditionally enable or disable interrupts (no-ops under HOST_TEST)
+static inline void irq_enable(void) {
+#ifndef HOST_TEST
+    asm volatile ("sti" : : : "memory");
+#endif
+}
+
+static inline void irq_disable(void) {
+#ifndef HOST_TEST
+    asm volatile ("cli" : : : "memory");
+#endif
+}
+
+// Read a model specific register
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    asm volatile ("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Write a model specific register
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    asm volatile ("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)) : "memory");
+}
+
+// Execute CPUID for the given leaf and subleaf
+static inline void cpuid(uint32_t leaf, uint32_t subleaf,
+                         uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+    asm volatile ("cpuid"
+                  : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                  : "a"(leaf), "c"(subleaf));
+}
+
+static inline uint64_t read_cr0(void) {
+    uint64_t cr0;
+    asm volatile ("mov %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+static inline void write_cr0(uint64_t cr0) {
+    asm volatile ("mov %0, %%cr0" : : "r"(cr0) : "memory");
+}
+
+// Clear CR0.TS: vector instructions run again without #NM
+static inline void clts(void) {
+    asm volatile ("clts" : : : "memory");
+}
+
+static inline uint64_t read_cr4(void) {
+    uint64_t cr4;
+    asm volatile ("mov %%cr4, %0" : "=r"(cr4));
+    return cr4;
+}
+
+static inline void write_cr4(uint64_t cr4) {
+    asm volatile ("mov %0, %%cr4" : : "r"(cr4) : "memory");
+}
+
+// Read an extended control register (requires CR4.OSXSAVE)
+static inline uint64_t xgetbv(uint32_t index) {
+    uint32_t lo, hi;
+    asm volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(index));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void xsetbv(uint32_t index, uint64_t value) {
+    asm volatile ("xsetbv" : : "c"(index), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+// Read the time stamp counter
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/*
+ * TSC frequency as reported by CPUID leaves 0x15/0x16, or 0 if the CPU (or
+ * hypervisor) does not enumerate it.
+ */
+static inline uint64_t tsc_hz_from_cpuid(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+    uint32_t max_leaf = eax;
+
+    if (max_leaf >= 0x15) {
+        cpuid(0x15, 0, &eax, &ebx, &ecx, &edx);
+        if (eax && ebx && ecx)
+            return (uint64_t)ecx * ebx / eax;
+    }
+    if (max_leaf >= 0x16) {
+        cpuid(0x16, 0, &eax, &ebx, &ecx, &edx);
+        if (eax & 0xFFFF)
+            return (uint64_t)(eax & 0xFFFF) * 1000000;
+    }
+    return 0;
+}
+
+// Write back and invalidate all caches
+static inline void wbinvd(void) {
+    asm volatile ("wbinvd" : : : "memory");
+}
+
+// Invalidate the TLB entry for one page. Hosted unit test builds
+// (HOST_TEST) have no TLB to maintain, here or in flush_tlb().
+static inline void invlpg(uint64_t virt_addr) {
+#ifdef HOST_TEST
+    (void)virt_addr;
+#else
+    asm volatile ("invlpg (%0)" : : "r"(virt_addr) : "memory");
+#endif
+}
+
+// Flush the whole (non-global) TLB by reloading CR3
+static inline void flush_tlb(void) {
+#ifndef HOST_TEST
+    uint64_t cr3;
+    asm volatile ("mov %%cr3, %0" : "=r"(cr3));
+    asm volatile ("mov %0, %%cr3" : : "r"(cr3) : "memory");
+#endif
+}
+
+#endif // CPU_H
@@ -0,0 +1,245 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "fpu.h"
+#include "cpu.h"
+#include "isr.h"
+#include "idt.h"
+#include "klog.h"
+#include "sched.h"
+#include "text_renderer.h"
+
+// Legacy region and XSAVE header of a state area
+#define FXSAVE_SIZE      512
+#define XSAVE_HEADER     512
+#define XSAVE_HEADER_SIZE 64
+#define XCOMP_BV_COMPACT (1ULL << 63)
+
+// #NM, raised by vector instructions while CR0.TS is set
+#define VECTOR_DEVICE_NOT_AVAILABLE 7
+
+enum fpu_save_mode {
+    FPU_FXSAVE,
+    FPU_XSAVE,
+    FPU_XSAVEOPT,
+    FPU_XSAVES,
+};
+
+struct fpu_cpu {
+    struct thread *owner;       // Thread whose state is in the registers
+    bool ts;                    // CR0.TS as last written
+    bool reload;                // Current thread's state was parked by a section
+    uint32_t depth;             // kernel_fpu_begin() nesting
+    uint64_t traps;
+    uint64_t saves;
+    uint64_t kernel_sections;
+} __attribute__((aligned(64)));
+
+bool fpu_has_sse2 = false;
+bool fpu_has_avx = false;
+uint32_t fpu_state_size = FXSAVE_SIZE;
+
+static enum fpu_save_mode fpu_save_mode = FPU_FXSAVE;
+static uint64_t fpu_xcr0;
+static struct fpu_cpu fpu_cpus[MAX_CPUS];
+
+// Every component in its initial state: x87 and MXCSR defaults, and an
+// XSAVE header that marks nothing as saved
+static uint8_t fpu_init_area[FXSAVE_SIZE + XSAVE_HEADER_SIZE] __attribute__((aligned(64)));
+
+static void fpu_save(void *area) {
+    switch (fpu_save_mode) {
+    case FPU_XSAVES:
+        asm volatile ("xsaves64 (%0)" : : "r"(area), "a"(-1), "d"(-1) : "memory");
+        break;
+    case FPU_XSAVEOPT:
+        asm volatile ("xsaveopt64 (%0)" : : "r"(area), "a"(-1), "d"(-1) : "memory");
+        break;
+    case FPU_XSAVE:
+        asm volatile ("xsave64 (%0)" : : "r"(area), "a"(-1), "d"(-1) : "memory");
+        break;
+    default:
+        asm volatile ("fxsave64 (%0)" : : "r"(area) : "memory");
+        break;
+    }
+}
+
+static void fpu_restore(const void *area) {
+    switch (fpu_save_mode) {
+    case FPU_XSAVES:
+        asm volatile ("xrstors64 (%0)" : : "r"(area), "a"(-1), "d"(-1) : "memory");
+        break;
+    case FPU_XSAVEOPT:
+    case FPU_XSAVE:
+        asm volatile ("xrstor64 (%0)" : : "r"(area), "a"(-1), "d"(-1) : "memory");
+        break;
+    default:
+        asm volatile ("fxrstor64 (%0)" : : "r"(area) : "memory");
+        break;
+    }
+}
+
+static void stts(struct fpu_cpu *fc) {
+    write_cr0(read_cr0() | CR0_TS);
+    fc->ts = true;
+}
+
+// First vector instruction of a thread since it was switched in
+static void fpu_trap(struct isr_frame *frame) {
+    struct fpu_cpu *fc = &fpu_cpus[this_cpu_id()];
+    struct thread *thread = current_thread();
+
+    // isr_dispatch() counts this trap as one level already
+    if (irq_nesting[this_cpu_id()] > 1 || !thread || !thread->fpu_state)
+        panic("Vector registers used outside a thread at RIP 0x%lx\n", frame->rip);
+
+    clts();
+    fc->ts = false;
+    fpu_restore(thread->fpu_used ? thread->fpu_state : fpu_init_area);
+    thread->fpu_used = true;
+    fc->owner = thread;
+    fc->traps++;
+}
+
+void fpu_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+
+    bool has_sse2 = (edx >> 26) & 1;
+    bool has_xsave = (ecx >> 26) & 1;
+    bool has_avx = (ecx >> 28) & 1;
+
+    // Native x87 error reporting, no emulation; TS stays clear until the
+    // first context switch
+    uint64_t cr0 = read_cr0();
+    cr0 |= CR0_MP;
+    cr0 &= ~(CR0_EM | CR0_TS);
+    write_cr0(cr0);
+
+    uint64_t cr4 = read_cr4();
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    if (has_xsave)
+        cr4 |= CR4_OSXSAVE;
+    write_cr4(cr4);
+
+    asm volatile ("fninit");
+
+    fpu_has_sse2 = has_sse2;
+
+    if (has_xsave) {
+        uint64_t xcr0 = xgetbv(0) | XCR0_X87 | XCR0_SSE;
+        if (has_avx) {
+            xcr0 |= XCR0_AVX;
+            fpu_has_avx = true;
+        }
+        xsetbv(0, xcr0);
+        fpu_xcr0 = xcr0;
+
+        // Subleaf 0 EBX: standard-format size for the enabled components;
+        // subleaf 1: XSAVEOPT (EAX bit 0), XSAVES (bit 3) and compacted size
+        uint32_t standard_size;
+        cpuid(0xD, 0, &eax, &standard_size, &ecx, &edx);
+        cpuid(0xD, 1, &eax, &ebx, &ecx, &edx);
+        if ((eax >> 3) & 1) {
+            wrmsr(MSR_IA32_XSS, 0);
+            fpu_save_mode = FPU_XSAVES;
+            fpu_state_size = ebx;
+        } else {
+            fpu_save_mode = (eax & 1) ? FPU_XSAVEOPT : FPU_XSAVE;
+            fpu_state_size = standard_size;
+        }
+    }
+
+    *(uint16_t *)&fpu_init_area[0] = 0x037F;        // FCW: all exceptions masked
+    *(uint32_t *)&fpu_init_area[24] = 0x1F80;       // MXCSR
+    if (fpu_save_mode == FPU_XSAVES)
+        *(uint64_t *)&fpu_init_area[XSAVE_HEADER + 8] = XCOMP_BV_COMPACT | fpu_xcr0;
+
+    struct fpu_cpu *fc = &fpu_cpus[this_cpu_id()];
+    fc->owner = NULL;
+    fc->ts = false;
+    isr_register(VECTOR_DEVICE_NOT_AVAILABLE, fpu_trap);
+}
+
+void fpu_state_init(void *area) {
+    // XRSTOR faults on a header with stray bits; the rest is written by
+    // the first save
+    if (fpu_save_mode != FPU_FXSAVE) {
+        uint64_t *header = (uint64_t *)((uint8_t *)area + XSAVE_HEADER);
+        for (int i = 0; i < XSAVE_HEADER_SIZE / 8; i++)
+            header[i] = 0;
+    }
+}
+
+void fpu_switch(struct thread *prev) {
+    struct fpu_cpu *fc = &fpu_cpus[this_cpu_id()];
+    if (fc->owner == prev) {
+        if (prev->state != THREAD_ZOMBIE) {
+            fpu_save(prev->fpu_state);
+            fc->saves++;
+        }
+        fc->owner = NULL;
+    }
+    if (!fc->ts)
+        stts(fc);
+}
+
+bool kernel_fpu_begin(void) {
+    if (in_interrupt())
+        return false;
+
+    struct fpu_cpu *fc = &fpu_cpus[this_cpu_id()];
+    if (fc->depth++)
+        return true;
+    fc->kernel_sections++;
+
+    // The thread's own registers are parked in its area and come back
+    // through #NM when it uses them next
+    struct thread *thread = current_thread();
+    if (thread && thread->fpu_used) {
+        if (fc->owner == thread) {
+            fpu_save(thread->fpu_state);
+            fc->saves++;
+            fc->owner = NULL;
+        }
+        fc->reload = true;
+    }
+    if (fc->ts) {
+        clts();
+        fc->ts = false;
+    }
+    return true;
+}
+
+void kernel_fpu_end(void) {
+    struct fpu_cpu *fc = &fpu_cpus[this_cpu_id()];
+    if (--fc->depth)
+        return;
+    fc->reload = false;
+    // Unless the thread's own state is loaded, its next vector use must
+    // trap: that loads its state, or catches the idle thread using them
+    if (fc->owner != current_thread())
+        stts(fc);
+}
+
+void fpu_get_stats(uint32_t cpu, struct fpu_stats *stats) {
+    struct fpu_cpu *fc = &fpu_cpus[cpu];
+    stats->traps = fc->traps;
+    stats->saves = fc->saves;
+    stats->kernel_sections = fc->kernel_sections;
+}
+
+void fpu_dump_stats(void) {
+    static const char *names[] = { "fxsave", "xsave", "xsaveopt", "xsaves" };
+    struct fpu_stats total = { 0 };
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        struct fpu_stats stats;
+        fpu_get_stats(cpu, &stats);
+        total.traps += stats.traps;
+        total.saves += stats.saves;
+        total.kernel_sections += stats.kernel_sections;
+    }
+    kprintf("FPU: %s, %u byte areas, %lu lazy loads, %lu saves, %lu kernel sections\n",
+            names[fpu_save_mode], fpu_state_size, total.traps, total.saves,
+            total.kernel_sections);
+}
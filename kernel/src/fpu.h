@@ -0,0 +1,74 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct thread;
+
+// Vector extensions usable by kernel code once fpu_init() has run
+extern bool fpu_has_sse2;
+extern bool fpu_has_avx;
+
+// Bytes of a per-thread extended state area, from CPUID leaf 0xD
+extern uint32_t fpu_state_size;
+
+/**
+ * fpu_init - Enable the x87/SSE units and, when present, AVX.
+ *
+ * Sets CR0.MP, clears CR0.EM/TS, enables FXSR and SIMD exceptions in CR4 and,
+ * if XSAVE and AVX are supported, turns on the AVX state component in XCR0.
+ * Then picks the best save instruction (XSAVES, XSAVEOPT, XSAVE or FXSAVE)
+ * and installs the #NM handler. The kernel is built with -mno-sse, so vector
+ * code is confined to inline assembly that checks the flags above.
+ */
+void fpu_init(void);
+
+/*
+ * Extended state is switched lazily. A thread has state of its own only
+ * once it has used vector registers outside kernel_fpu_begin()/end(): every
+ * switch sets CR0.TS, and the first vector instruction after it traps (#NM)
+ * and loads the thread's area. On the way out, only a thread whose state is
+ * loaded is saved, with XSAVEOPT/XSAVES skipping unmodified and initial
+ * components. Threads that never touch vector registers cost no save and
+ * no restore at all.
+ *
+ * Interrupt and exception handlers must not use vector registers; the
+ * entry code does not save them.
+ */
+
+/**
+ * fpu_state_init - Prepare a thread's state area.
+ *
+ * @area: fpu_state_size bytes, 64-byte aligned.
+ */
+void fpu_state_init(void *area);
+
+// Called by the scheduler before switching away from @prev
+void fpu_switch(struct thread *prev);
+
+/**
+ * kernel_fpu_begin - Claim the vector registers for kernel code.
+ *
+ * Returns false in interrupt context, where the caller must take a scalar
+ * path. Otherwise the registers may be used freely until kernel_fpu_end();
+ * the current thread's own state, if loaded, is saved first. The section
+ * must not block or yield. Sections nest.
+ */
+bool kernel_fpu_begin(void);
+
+// End a section begun by a successful kernel_fpu_begin()
+void kernel_fpu_end(void);
+
+struct fpu_stats {
+    uint64_t traps;             // #NM: lazy loads of a thread's state
+    uint64_t saves;             // Thread states written back
+    uint64_t kernel_sections;   // Outermost kernel_fpu_begin() calls
+};
+
+void fpu_get_stats(uint32_t cpu, struct fpu_stats *stats);
+
+// Print the save instruction, the area size and the counters
+void fpu_dump_stats(void);
+
+#endif // FPU_H
@@ -0,0 +1,60 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "gdt.h"
+#include "percpu.h"
+#include "cpu.h"
+#include "string.h"
+
+// Long mode code (L=1) and data descriptors, present, DPL 0
+#define GDT_CODE64 0x00AF9A000000FFFFULL
+#define GDT_DATA   0x00CF92000000FFFFULL
+
+// Present, 64-bit available TSS
+#define TSS_TYPE   0x89ULL
+
+void gdt_init(struct percpu *cpu) {
+    memset(cpu->gdt, 0, sizeof(cpu->gdt));
+    cpu->gdt[GDT_KERNEL_CODE / 8] = GDT_CODE64;
+    cpu->gdt[GDT_KERNEL_DATA / 8] = GDT_DATA;
+
+    // The TSS descriptor takes two slots to hold a 64-bit base
+    uint64_t base = (uint64_t)&cpu->tss;
+    uint64_t limit = sizeof(cpu->tss) - 1;
+    cpu->gdt[GDT_TSS / 8] = (limit & 0xFFFF) | ((base & 0xFFFFFF) << 16) | (TSS_TYPE << 40) |
+                            (((limit >> 16) & 0xF) << 48) | (((base >> 24) & 0xFF) << 56);
+    cpu->gdt[GDT_TSS / 8 + 1] = base >> 32;
+    cpu->tss.iomap_base = sizeof(cpu->tss);    // No I/O permission bitmap
+
+    struct __attribute__((packed)) {
+        uint16_t limit;
+        uint64_t base;
+    } gdtr = { sizeof(cpu->gdt) - 1, (uint64_t)cpu->gdt };
+
+    // No interrupts while GS has no base: handlers call this_cpu_id()
+    uint64_t flags = irq_save();
+    asm volatile (
+        "lgdt %0\n\t"
+        // Reload CS with a far return to the next instruction
+        "pushq %1\n\t"
+        "leaq 1f(%%rip), %%rax\n\t"
+        "pushq %%rax\n\t"
+        "lretq\n"
+        "1:\n\t"
+        "movl %2, %%eax\n\t"
+        "movl %%eax, %%ds\n\t"
+        "movl %%eax, %%es\n\t"
+        "movl %%eax, %%ss\n\t"
+        "xorl %%eax, %%eax\n\t"
+        "movl %%eax, %%fs\n\t"
+        "movl %%eax, %%gs\n\t"
+        "movw %3, %%ax\n\t"
+        "ltr %%ax"
+        :
+        : "m"(gdtr), "i"(GDT_KERNEL_CODE), "i"(GDT_KERNEL_DATA), "i"(GDT_TSS)
+        : "rax", "memory");
+
+    // Loading GS zeroed its base
+    wrmsr(MSR_GS_BASE, (uint64_t)cpu);
+    wrmsr(MSR_KERNEL_GS_BASE, 0);
+    irq_restore(flags);
+}
@@ -0,0 +1,47 @@
+#ifndef GDT_H
+#define GDT_H
+
+#include <stdint.h>
+
+/*
+ * Segment selectors. The kernel keeps the slots Limine uses for its 64-bit
+ * code and data descriptors, so selectors stay valid across the switch from
+ * the bootloader's GDT to the per-CPU one.
+ */
+#define GDT_KERNEL_CODE 0x28
+#define GDT_KERNEL_DATA 0x30
+#define GDT_TSS         0x38
+
+// Descriptors per CPU: null, 4 unused legacy slots, code, data, TSS (two)
+#define GDT_ENTRIES 9
+
+// Interrupt stack table slots (1-based, as stored in the IDT)
+#define IST_DOUBLE_FAULT 1
+#define IST_NMI          2
+
+// 64-bit task state segment; only the stack pointers matter in long mode
+struct __attribute__((packed)) tss {
+    uint32_t reserved0;
+    uint64_t rsp[3];
+    uint64_t reserved1;
+    uint64_t ist[7];
+    uint64_t reserved2;
+    uint16_t reserved3;
+    uint16_t iomap_base;
+};
+
+struct percpu;
+
+/**
+ * gdt_init - Build and load the executing CPU's GDT and TSS.
+ *
+ * @cpu: Per-CPU area that holds the descriptor table and the TSS. Its IST
+ *       stack pointers must be filled in before the first interrupt that
+ *       uses them.
+ *
+ * Reloads CS, SS and the data segments, loads the task register and points
+ * IA32_GS_BASE at @cpu (reloading GS clears it).
+ */
+void gdt_init(struct percpu *cpu);
+
+#endif // GDT_H
@@ -0,0 +1,69 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "hpet.h"
+#include "acpi.h"
+#include "ioremap.h"
+
+// Register offsets
+#define HPET_CAPABILITIES 0x000
+#define HPET_CONFIG       0x010
+#define HPET_COUNTER      0x0F0
+
+#define HPET_CONFIG_ENABLE (1ULL << 0)
+#define HPET_CAP_64BIT     (1ULL << 13)
+
+struct __attribute__((packed)) acpi_hpet {
+    struct acpi_sdt_header header;
+    uint32_t event_timer_block_id;
+    struct acpi_gas base;
+    uint8_t  hpet_number;
+    uint16_t minimum_tick;
+    uint8_t  page_protection;
+};
+
+static volatile uint64_t *hpet_regs;
+static uint64_t hpet_frequency;
+static bool hpet_64bit;
+
+static inline uint64_t hpet_reg_read(uint32_t reg) {
+    return hpet_regs[reg / 8];
+}
+
+static inline void hpet_reg_write(uint32_t reg, uint64_t value) {
+    hpet_regs[reg / 8] = value;
+}
+
+bool hpet_init(void) {
+    const struct acpi_hpet *table = (const struct acpi_hpet *)acpi_find_table("HPET");
+    if (!table || table->base.address_space != 0)
+        return false;
+
+    hpet_regs = ioremap(table->base.address, 1024, CACHE_UC);
+    if (!hpet_regs)
+        return false;
+
+    // Bits 63:32 hold the counter period in femtoseconds
+    uint64_t caps = hpet_reg_read(HPET_CAPABILITIES);
+    uint64_t period_fs = caps >> 32;
+    if (period_fs == 0 || period_fs > 100000000)
+        return false;
+    hpet_frequency = 1000000000000000ULL / period_fs;
+    hpet_64bit = caps & HPET_CAP_64BIT;
+
+    hpet_reg_write(HPET_CONFIG, hpet_reg_read(HPET_CONFIG) | HPET_CONFIG_ENABLE);
+    return true;
+}
+
+uint64_t hpet_read(void) {
+    if (hpet_64bit)
+        return hpet_reg_read(HPET_COUNTER);
+    return (uint32_t)hpet_reg_read(HPET_COUNTER);
+}
+
+bool hpet_is_64bit(void) {
+    return hpet_64bit;
+}
+
+uint64_t hpet_hz(void) {
+    return hpet_frequency;
+}
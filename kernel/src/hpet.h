@@ -0,0 +1,25 @@
+#ifndef HPET_H
+#define HPET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * hpet_init - Locate the HPET through ACPI and start its main counter.
+ *
+ * Maps the register block uncached and enables the counter without legacy
+ * replacement routing, so the PIT keeps working. Returns false when the
+ * firmware describes no HPET.
+ */
+bool hpet_init(void);
+
+// Main counter value (hpet_init() must have succeeded)
+uint64_t hpet_read(void);
+
+// True if the main counter is 64 bits wide; 32-bit counters wrap in minutes
+bool hpet_is_64bit(void);
+
+// Main counter frequency in Hz
+uint64_t hpet_hz(void);
+
+#endif // HPET_H
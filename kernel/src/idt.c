@@ -1,4 +1,6 @@
 #include "idt.h"
+#include "isr.h"
+#include "gdt.h"
 #include "page_fault_handler.h"
 #include <string.h>
 
@@ -6,6 +8,8 @@
 idt_entry_t idt[IDT_ENTRIES];
 idt_ptr_t idt_ptr;
 
+volatile uint32_t irq_nesting[MAX_CPUS];
+
 void idt_set_gate(uint8_t vector, uint64_t handler, uint16_t selector, uint8_t type_attr) {
     idt[vector].offset_low  = handler & 0xFFFF;
     idt[vector].selector    = selector;
@@ -17,6 +21,14 @@ void idt_set_gate(uint8_t vector, uint64_t handler, uint16_t selector, uint8_t t
 }
 
 
+void idt_set_ist(uint8_t vector, uint8_t ist) {
+    idt[vector].ist = ist;
+}
+
+void idt_load(void) {
+    asm volatile("lidt %0" : : "m"(idt_ptr));
+}
+
 void idt_install(void) {
     // Set up the IDT pointer.
     idt_ptr.limit = sizeof(idt_entry_t) * IDT_ENTRIES - 1;
@@ -25,17 +37,13 @@ void idt_install(void) {
     // Clear the IDT.
     memset(idt, 0, sizeof(idt_entry_t) * IDT_ENTRIES);
 
-    // -- Setup your IDT entries here --
-    // For example, if you have a page fault handler:
-    // extern void page_fault_handler(struct interrupt_frame*, uint64_t);
-    // idt_set_gate(14, (uint64_t)page_fault_handler, 0x08, 0x8E);
-
-    // Set the interrupt gate for the page fault handler
-    idt_set_gate(14, (uint64_t)page_fault_handler, 0x28, 0x8E);
+    // Every vector enters through its stub in isr_stubs.S; handlers are
+    // attached with isr_register()
+    for (int vector = 0; vector < IDT_ENTRIES; vector++)
+        idt_set_gate(vector, (uint64_t)(isr_stubs + vector * ISR_STUB_SIZE), GDT_KERNEL_CODE, 0x8E);
 
-
-    // You can set other handlers (e.g., for general protection faults, timer interrupts, etc.)
+    isr_register(14, page_fault_handler);
 
     // Load the IDT using the lidt instruction.
-    asm volatile("lidt %0" : : "m"(idt_ptr));
+    idt_load();
 }
@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "cpu.h"
+#include "rcu.h"
+#include "tlb.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -40,6 +43,42 @@ extern idt_entry_t idt[IDT_ENTRIES];
  */
 void idt_set_gate(uint8_t vector, uint64_t handler, uint16_t selector, uint8_t type_attr);
 
+/**
+ * idt_set_ist - Run a vector on an interrupt stack table entry.
+ *
+ * @vector: Interrupt vector number (0-255).
+ * @ist:    IST slot (1-7) of the TSS, or 0 for the current stack.
+ */
+void idt_set_ist(uint8_t vector, uint8_t ist);
+
+// Load the shared IDT on the executing CPU (idt_install() does it for the BSP)
+void idt_load(void);
+
+// Interrupt handlers currently running on each CPU (nesting depth)
+extern volatile uint32_t irq_nesting[MAX_CPUS];
+
+// Bracket the body of an interrupt handler. The outermost level also tells
+// RCU and the lazy TLB code, in case the interrupt arrived while the CPU
+// was idle.
+static inline void irq_enter(void) {
+    if (irq_nesting[this_cpu_id()]++ == 0) {
+        rcu_irq_enter();
+        tlb_irq_enter();
+    }
+}
+
+static inline void irq_exit(void) {
+    if (--irq_nesting[this_cpu_id()] == 0) {
+        tlb_irq_exit();
+        rcu_irq_exit();
+    }
+}
+
+// True while an interrupt or exception handler is running on this CPU
+static inline int in_interrupt(void) {
+    return irq_nesting[this_cpu_id()] != 0;
+}
+
 /**
  * idt_install - Install and load the IDT.
  *
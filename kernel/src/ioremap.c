@@ -0,0 +1,70 @@
+#include "ioremap.h"
+#include "vmm_mngr.h"
+#include "vmm_mngr_utils.h"
+#include "cpu.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* The MMIO window covers the whole 512 GiB PML4 slot */
+#define IOREMAP_BASE  (0xFFFF000000000000ULL | ((uint64_t)IOREMAP_INDEX << 39))
+#define IOREMAP_LIMIT (IOREMAP_BASE + (1ULL << 39))
+
+static bool pat_supported = false;
+static virt_addr_t ioremap_next = IOREMAP_BASE;
+
+void pat_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    pat_supported = (edx >> 16) & 1;
+    if (!pat_supported)
+        return;
+
+    // Follow the SDM: no stale lines or translations may survive a type change.
+    wbinvd();
+    wrmsr(MSR_IA32_PAT, PAT_LAYOUT);
+    flush_tlb();
+    wbinvd();
+}
+
+uint64_t cache_type_flags(cache_type_t type) {
+    switch (type) {
+        case CACHE_WT:
+            return PAGE_PWT;                    // PA1
+        case CACHE_UC:
+            return PAGE_PCD | PAGE_PWT;         // PA3
+        case CACHE_WC:
+            if (!pat_supported)
+                return PAGE_PCD | PAGE_PWT;
+            return PAGE_PAT | PAGE_PWT;         // PA5
+        case CACHE_WB:
+        default:
+            return 0;                           // PA0
+    }
+}
+
+void *ioremap(phys_addr_t phys, size_t size, cache_type_t type) {
+    uint64_t offset = phys & (PAGE_SIZE - 1);
+    phys_addr_t phys_base = phys - offset;
+    size_t map_size = (offset + size + PAGE_SIZE - 1) & ~((size_t)PAGE_SIZE - 1);
+
+    if (size == 0 || map_size > IOREMAP_LIMIT - ioremap_next)
+        return NULL;
+
+    virt_addr_t virt = ioremap_next;
+    ioremap_next += map_size;
+
+    vmm_map_range(virt, map_size, phys_base, PAGE_WRITE | cache_type_flags(type));
+    return (void *)(virt + offset);
+}
+
+void iounmap(void *addr, size_t size) {
+    virt_addr_t virt = (virt_addr_t)addr;
+    uint64_t offset = virt & (PAGE_SIZE - 1);
+    size_t map_size = (offset + size + PAGE_SIZE - 1) & ~((size_t)PAGE_SIZE - 1);
+    vmm_unmap_range(virt - offset, offset + size);
+
+    // Short-lived mappings (e.g. table probes) give their space back
+    if (virt - offset + map_size == ioremap_next)
+        ioremap_next = virt - offset;
+}
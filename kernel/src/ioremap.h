@@ -0,0 +1,74 @@
+#ifndef IOREMAP_H
+#define IOREMAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pmm_mngr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Memory types selectable through the page attribute table */
+typedef enum {
+    CACHE_WB = 0,   /* Write-back: normal RAM */
+    CACHE_WT,       /* Write-through */
+    CACHE_UC,       /* Strong uncacheable: MMIO registers */
+    CACHE_WC,       /* Write-combining: framebuffers and other streaming targets */
+} cache_type_t;
+
+/*
+ * IA32_PAT layout programmed by pat_init(). Entries 0-3 keep their power-on
+ * values so PWT/PCD-only mappings behave as before, and entry 5 is WC, which
+ * matches the layout the Limine protocol hands over.
+ *
+ *   PA0 WB   PA1 WT   PA2 UC-   PA3 UC   PA4 WP   PA5 WC   PA6 UC-   PA7 UC
+ */
+#define PAT_LAYOUT 0x0007010500070406ULL
+
+/**
+ * pat_init - Program the IA32_PAT MSR with PAT_LAYOUT.
+ *
+ * Must run on every CPU before any CACHE_WC mapping is created. If the CPU
+ * has no PAT, CACHE_WC mappings silently degrade to CACHE_UC.
+ */
+void pat_init(void);
+
+/**
+ * cache_type_flags - Page table flag bits selecting a memory type.
+ *
+ * @type: The desired memory type.
+ *
+ * Returns the PWT/PCD/PAT bits to OR into a 4 KiB page table entry.
+ */
+uint64_t cache_type_flags(cache_type_t type);
+
+/**
+ * ioremap - Map a physical range into the kernel's MMIO window.
+ *
+ * @phys: Physical start address (need not be page aligned).
+ * @size: Size of the range in bytes.
+ * @type: Memory type for the mapping.
+ *
+ * Allocates virtual space in the IOREMAP_INDEX slot and maps the range on top
+ * of vmm_map_range(). Returns the virtual address corresponding to @phys, or
+ * NULL when the window is exhausted. Requires the recursive mapping.
+ */
+void *ioremap(phys_addr_t phys, size_t size, cache_type_t type);
+
+/**
+ * iounmap - Remove a mapping created by ioremap().
+ *
+ * @addr: Address returned by ioremap().
+ * @size: Size passed to ioremap().
+ *
+ * The virtual space is reused only if this was the latest mapping, so
+ * temporary mappings should be undone in reverse order.
+ */
+void iounmap(void *addr, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOREMAP_H */
@@ -0,0 +1,93 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "isr.h"
+#include "cpu.h"
+#include "idt.h"
+#include "klog.h"
+#include "softirq.h"
+#include "text_renderer.h"
+
+static isr_handler_t isr_handlers[IDT_ENTRIES];
+
+struct isr_stats isr_stats[MAX_CPUS][IDT_ENTRIES];
+
+struct isr_frame *isr_irq_frame[MAX_CPUS];
+
+static const char *const exception_names[ISR_EXCEPTIONS] = {
+    "Divide error", "Debug", "NMI", "Breakpoint",
+    "Overflow", "BOUND range exceeded", "Invalid opcode", "Device not available",
+    "Double fault", "Coprocessor segment overrun", "Invalid TSS", "Segment not present",
+    "Stack-segment fault", "General protection fault", "Page fault", "Reserved",
+    "x87 floating-point error", "Alignment check", "Machine check", "SIMD floating-point error",
+    "Virtualization exception", "Control protection exception", "Reserved", "Reserved",
+    "Reserved", "Reserved", "Reserved", "Reserved",
+    "Hypervisor injection exception", "VMM communication exception", "Security exception", "Reserved",
+};
+
+isr_handler_t isr_register(uint8_t vector, isr_handler_t handler) {
+    uint64_t flags = irq_save();
+    isr_handler_t old = isr_handlers[vector];
+    isr_handlers[vector] = handler;
+    irq_restore(flags);
+    return old;
+}
+
+static void unhandled_exception(struct isr_frame *frame) {
+    uint64_t cr2;
+    asm volatile ("mov %%cr2, %0" : "=r"(cr2));
+
+    kprintf("Exception %lu (%s), error code 0x%lx\n",
+            frame->vector, exception_names[frame->vector], frame->error_code);
+    kprintf("RIP 0x%lx CS 0x%lx RFLAGS 0x%lx RSP 0x%lx CR2 0x%lx\n",
+            frame->rip, frame->cs, frame->rflags, frame->rsp, cr2);
+    kprintf("RAX 0x%lx RBX 0x%lx RCX 0x%lx RDX 0x%lx\n",
+            frame->rax, frame->rbx, frame->rcx, frame->rdx);
+    kprintf("RSI 0x%lx RDI 0x%lx RBP 0x%lx\n", frame->rsi, frame->rdi, frame->rbp);
+    panic("Unhandled %s at RIP 0x%lx\n", exception_names[frame->vector], frame->rip);
+}
+
+void isr_dispatch(struct isr_frame *frame) {
+    uint64_t start = rdtsc();
+    uint8_t vector = (uint8_t)frame->vector;
+    isr_handler_t handler = isr_handlers[vector];
+
+    irq_enter();
+    uint32_t cpu = this_cpu_id();
+    bool outermost = irq_nesting[cpu] == 1;
+    if (outermost)
+        isr_irq_frame[cpu] = frame;
+
+    if (handler)
+        handler(frame);
+    else if (vector < ISR_EXCEPTIONS)
+        unhandled_exception(frame);
+
+    // Hard-IRQ half only; softirq time is counted by softirq.c
+    struct isr_stats *stats = &isr_stats[cpu][vector];
+    stats->count++;
+    stats->cycles += rdtsc() - start;
+
+    // Exceptions may arrive with interrupts disabled, so only device
+    // interrupts and IPIs go on to the deferred halves they raised
+    if (vector >= ISR_EXCEPTIONS)
+        softirq_irq_exit();
+    if (outermost)
+        isr_irq_frame[cpu] = NULL;
+    irq_exit();
+}
+
+void isr_dump_stats(void) {
+    kprintf("Interrupt statistics:\n");
+    for (int vector = 0; vector < IDT_ENTRIES; vector++) {
+        uint64_t count = 0, cycles = 0;
+        for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+            count += isr_stats[cpu][vector].count;
+            cycles += isr_stats[cpu][vector].cycles;
+        }
+        if (!count)
+            continue;
+        kprintf("  vector %3d: %lu calls, %lu cycles avg%s\n", vector, count, cycles / count,
+                isr_handlers[vector] ? "" : " (unhandled)");
+    }
+}
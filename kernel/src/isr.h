@@ -0,0 +1,75 @@
+#ifndef ISR_H
+#define ISR_H
+
+#include <stdint.h>
+#include "cpu.h"
+#include "idt.h"
+
+// Every entry stub in isr_stubs.S is this many bytes long
+#define ISR_STUB_SIZE 16
+
+// Vectors below this are CPU exceptions and take the full-save path
+#define ISR_EXCEPTIONS 32
+
+// Entry stubs, one per vector, at isr_stubs + vector * ISR_STUB_SIZE
+extern char isr_stubs[];
+
+/*
+ * State saved on interrupt entry, lowest address first. The exception path
+ * (vectors 0-31) fills in every field. The IRQ path (vectors 32-255) saves
+ * only the caller-saved registers and rbp (for backtraces): r15, r14, r13,
+ * r12 and rbx are garbage there, and writes to them and to rbp are not
+ * restored.
+ */
+struct isr_frame {
+    uint64_t r15, r14, r13, r12, rbp, rbx;
+    uint64_t r11, r10, r9, r8, rdi, rsi, rdx, rcx, rax;
+    uint64_t vector;
+    uint64_t error_code;    // 0 for vectors without a CPU error code
+    // Pushed by the CPU
+    uint64_t rip, cs, rflags, rsp, ss;
+};
+
+typedef void (*isr_handler_t)(struct isr_frame *frame);
+
+/**
+ * isr_register - Install the handler for an interrupt vector.
+ *
+ * @vector: Vector number (0-255).
+ * @handler: Called from isr_dispatch() with interrupts disabled, or NULL to
+ *           remove the handler.
+ *
+ * Returns the handler that was installed before, so it can be restored.
+ * Handlers run inside irq_enter()/irq_exit(); IRQ handlers still send their
+ * own EOI.
+ */
+isr_handler_t isr_register(uint8_t vector, isr_handler_t handler);
+
+/**
+ * isr_dispatch - Common C entry point for all vectors.
+ *
+ * @frame: State saved by the entry stub.
+ *
+ * Called only from isr_stubs.S. Runs the registered handler and accounts
+ * the call in the per-CPU statistics. An exception without a handler
+ * panics; an IRQ without a handler is counted and otherwise ignored. The
+ * outermost device interrupt or IPI then runs pending softirqs.
+ */
+void isr_dispatch(struct isr_frame *frame);
+
+// Per-vector counters, kept per CPU so the hot path never shares a line
+struct isr_stats {
+    uint64_t count;
+    uint64_t cycles;    // TSC cycles spent in the handler, without softirqs
+};
+
+extern struct isr_stats isr_stats[MAX_CPUS][IDT_ENTRIES];
+
+// Frame of the outermost interrupt on each CPU while its handler and the
+// softirqs it runs are active, NULL otherwise; the profiler samples it
+extern struct isr_frame *isr_irq_frame[MAX_CPUS];
+
+// Print count and average cycles of every vector that has fired
+void isr_dump_stats(void);
+
+#endif // ISR_H
@@ -0,0 +1,328 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include "klog.h"
+#include "cpu.h"
+#include "idt.h"
+#include "serial.h"
+#include "text_renderer.h"
+#include "printf.h"
+#include "workqueue.h"
+#include "apic.h"
+#include "clocksource.h"
+#include "isr.h"
+#include "percpu.h"
+#include "smp.h"
+
+// Record states
+#define KLOG_EMPTY     0
+#define KLOG_WRITING   1
+#define KLOG_COMMITTED 2
+
+#define VECTOR_NMI 2
+
+// How long panic() waits for the other CPUs to halt
+#define PANIC_STOP_TIMEOUT_NS 100000000ULL
+
+/*
+ * Per-CPU ring. Writers reserve at head, the drainer consumes at tail and
+ * marks the slot empty again before it hands it back, so a slot a writer
+ * has reserved but not yet committed never looks committed. Drained
+ * records keep their text until overwritten, which is what klog_dump()
+ * prints.
+ */
+struct klog_ring {
+    struct klog_record rec[KLOG_RING_RECORDS];
+    volatile uint64_t head;
+    volatile uint64_t tail;
+    volatile uint64_t dropped;
+};
+
+static struct klog_ring klog_rings[MAX_CPUS];
+static volatile uint64_t klog_seq = 0;
+static volatile uint8_t klog_draining = 0;
+
+// Set once every CPU has a worker; until then writers drain themselves
+static volatile bool klog_deferred;
+static struct work klog_work;
+
+// Reserve, fill and commit one record. Returns false if the ring is full.
+static bool klog_commit(struct klog_ring *ring, const char *text, size_t len) {
+    uint64_t head;
+
+    for (;;) {
+        head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= KLOG_RING_RECORDS)
+            return false;
+        if (__atomic_compare_exchange_n(&ring->head, &head, head + 1, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            break;
+    }
+
+    // The slot is ours and still KLOG_EMPTY, so the drainer skips it
+    struct klog_record *rec = &ring->rec[head % KLOG_RING_RECORDS];
+    rec->state = KLOG_WRITING;
+    rec->seq = __atomic_fetch_add(&klog_seq, 1, __ATOMIC_RELAXED);
+    rec->tsc = rdtsc();
+    rec->cpu = this_cpu_id();
+    rec->len = len;
+    for (size_t i = 0; i < len; i++)
+        rec->text[i] = text[i];
+
+    __atomic_store_n(&rec->state, KLOG_COMMITTED, __ATOMIC_RELEASE);
+    return true;
+}
+
+void klog_write(const char *msg, size_t len) {
+    struct klog_ring *ring = &klog_rings[this_cpu_id()];
+
+    while (len) {
+        size_t chunk = len < KLOG_TEXT_MAX ? len : KLOG_TEXT_MAX;
+
+        // A full ring is drained by the writer unless it is an interrupt
+        while (!klog_commit(ring, msg, chunk)) {
+            if (in_interrupt()) {
+                __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+                return;
+            }
+            klog_drain();
+        }
+
+        msg += chunk;
+        len -= chunk;
+    }
+
+    if (klog_deferred)
+        queue_work(&klog_work);
+    else if (!in_interrupt())
+        klog_drain();
+}
+
+// Oldest committed, undrained record across all rings, or NULL
+static struct klog_ring *klog_next_ring(void) {
+    struct klog_ring *best = NULL;
+    uint64_t best_seq = 0;
+
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        struct klog_ring *ring = &klog_rings[cpu];
+        uint64_t tail = ring->tail;
+        if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+            continue;
+
+        struct klog_record *rec = &ring->rec[tail % KLOG_RING_RECORDS];
+        if (__atomic_load_n(&rec->state, __ATOMIC_ACQUIRE) != KLOG_COMMITTED)
+            continue;   // Still being written; picked up next time
+        if (!best || rec->seq < best_seq) {
+            best = ring;
+            best_seq = rec->seq;
+        }
+    }
+    return best;
+}
+
+static void klog_drain_locked(void) {
+    struct klog_ring *ring;
+    bool drawn = false;
+
+    while ((ring = klog_next_ring())) {
+        struct klog_record *rec = &ring->rec[ring->tail % KLOG_RING_RECORDS];
+        console_write(rec->text, rec->len);
+        serial_write(rec->text, rec->len);
+        drawn = true;
+        __atomic_store_n(&rec->state, KLOG_EMPTY, __ATOMIC_RELAXED);
+        __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+    }
+
+    if (drawn)
+        console_flush();
+}
+
+void klog_drain(void) {
+    // A record committed after the drainer's last look but before it let
+    // go would otherwise wait for the next message
+    do {
+        if (__atomic_test_and_set(&klog_draining, __ATOMIC_ACQUIRE))
+            return;
+
+        klog_drain_locked();
+        __atomic_clear(&klog_draining, __ATOMIC_SEQ_CST);
+    } while (klog_next_ring());
+}
+
+static void klog_drain_work(struct work *work) {
+    (void)work;
+    klog_drain();
+}
+
+void klog_init_deferred(void) {
+    work_setup(&klog_work, klog_drain_work, NULL);
+    __atomic_store_n(&klog_deferred, true, __ATOMIC_RELEASE);
+}
+
+// Print a decimal or hex number straight to the outputs (used by klog_dump)
+static void klog_emit_num(uint64_t value, int base) {
+    char buf[24];
+    int i = sizeof(buf);
+
+    do {
+        buf[--i] = "0123456789abcdef"[value % base];
+        value /= base;
+    } while (value);
+
+    console_write(&buf[i], sizeof(buf) - i);
+    serial_write(&buf[i], sizeof(buf) - i);
+}
+
+static void klog_emit(const char *s, size_t len) {
+    console_write(s, len);
+    serial_write(s, len);
+}
+
+void klog_dump(void) {
+    // Print everything pending first so the history is complete
+    klog_drain();
+
+    uint64_t next[MAX_CPUS];
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        uint64_t tail = klog_rings[cpu].tail;
+        next[cpu] = tail > KLOG_RING_RECORDS ? tail - KLOG_RING_RECORDS : 0;
+    }
+
+    for (;;) {
+        int best = -1;
+        for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+            struct klog_ring *ring = &klog_rings[cpu];
+            if (next[cpu] >= ring->tail)
+                continue;
+            struct klog_record *rec = &ring->rec[next[cpu] % KLOG_RING_RECORDS];
+            if (best < 0 || rec->seq < klog_rings[best].rec[next[best] % KLOG_RING_RECORDS].seq)
+                best = cpu;
+        }
+        if (best < 0)
+            break;
+
+        struct klog_record *rec = &klog_rings[best].rec[next[best] % KLOG_RING_RECORDS];
+        next[best]++;
+
+        klog_emit("[", 1);
+        klog_emit_num(rec->cpu, 10);
+        klog_emit(" ", 1);
+        klog_emit_num(rec->seq, 10);
+        klog_emit(" ", 1);
+        klog_emit_num(rec->tsc, 16);
+        klog_emit("] ", 2);
+        klog_emit(rec->text, rec->len);
+    }
+
+    console_flush();
+}
+
+uint64_t klog_dropped(void) {
+    uint64_t total = 0;
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++)
+        total += klog_rings[cpu].dropped;
+    return total;
+}
+
+// Set by the first CPU to panic; every other CPU then stops for good
+static volatile int32_t panic_cpu = -1;
+static volatile bool panic_halted[MAX_CPUS];
+
+__attribute__((noreturn))
+static void panic_halt(void) {
+    panic_halted[this_cpu_id()] = true;
+    for (;;) {
+        asm volatile ("cli\n\thlt");
+    }
+}
+
+// Installed by the first panic: NMIs from then on mean "stop"
+static void panic_nmi(struct isr_frame *frame) {
+    (void)frame;
+    panic_halt();
+}
+
+// Stop the other CPUs, even those spinning with interrupts disabled, and
+// wait until they are halted. Returns false if one of them does not stop.
+static bool panic_stop_others(void) {
+    if (smp_cpus_online <= 1)
+        return true;
+
+    isr_register(VECTOR_NMI, panic_nmi);
+    apic_send_nmi_all_but_self();
+
+    uint32_t self = this_cpu_id();
+    uint64_t start = ktime_get_ns();
+    for (;;) {
+        bool all = true;
+        for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++)
+            if (cpu != self && percpu_areas[cpu].online && !panic_halted[cpu])
+                all = false;
+        if (all)
+            return true;
+        if (ktime_get_ns() - start >= PANIC_STOP_TIMEOUT_NS)
+            return false;
+        asm volatile ("pause");
+    }
+}
+
+// A writer that was stopped, or that this panic interrupted, never commits.
+// Its slot would hold back the rest of its ring, so it goes out empty.
+static void klog_skip_unfinished(struct klog_ring *ring) {
+    for (uint64_t i = ring->tail; i != ring->head; i++) {
+        struct klog_record *rec = &ring->rec[i % KLOG_RING_RECORDS];
+        if (rec->state != KLOG_COMMITTED) {
+            rec->len = 0;
+            rec->state = KLOG_COMMITTED;
+        }
+    }
+}
+
+void panic(const char *fmt, ...) {
+    asm volatile ("cli");
+
+    // A second panic, on this CPU or another, only stops where it is
+    int32_t expected = -1;
+    if (!__atomic_compare_exchange_n(&panic_cpu, &expected, (int32_t)this_cpu_id(), false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        panic_halt();
+
+    char line[KLOG_MSG_MAX];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (len > (int)sizeof(line) - 1)
+        len = sizeof(line) - 1;
+
+    // Once the others are halted nothing else runs, so the drain and the
+    // output locks are ours even if the holder was stopped in between
+    bool stopped = panic_stop_others();
+    __atomic_store_n(&klog_draining, 1, __ATOMIC_SEQ_CST);
+    console_panic_unlock();
+    serial_panic_unlock();
+
+    if (stopped) {
+        for (int cpu = 0; cpu < MAX_CPUS; cpu++)
+            klog_skip_unfinished(&klog_rings[cpu]);
+    } else {
+        klog_skip_unfinished(&klog_rings[this_cpu_id()]);
+    }
+    klog_drain_locked();
+
+    // The panic message bypasses the rings, so neither a full ring nor a
+    // record stuck in another ring can hold it back
+    console_write("PANIC: ", 7);
+    console_write(line, len);
+    console_flush();
+    serial_flush_sync();
+    for (const char *p = "PANIC: "; *p; p++)
+        serial_putc_sync(*p);
+    for (int i = 0; i < len; i++)
+        serial_putc_sync(line[i]);
+
+    for (;;) {
+        asm volatile ("hlt");
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef KLOG_H
+#define KLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cpu.h"
+
+// Longest message kprintf() formats; longer output is truncated
+#define KLOG_MSG_MAX 512
+
+// Text carried by one record; longer messages span several records
+#define KLOG_TEXT_MAX 108
+
+// Records per CPU ring (power of two)
+#define KLOG_RING_RECORDS 256
+
+/*
+ * One log record, 128 bytes. Records are ordered across CPUs by a global
+ * sequence number and carry the TSC at the time they were written.
+ */
+struct klog_record {
+    uint64_t seq;
+    uint64_t tsc;
+    uint16_t len;
+    uint8_t cpu;
+    volatile uint8_t state;
+    char text[KLOG_TEXT_MAX];
+};
+
+/**
+ * klog_write - Append a message to the executing CPU's log ring.
+ *
+ * @msg: Message text (need not be NUL terminated).
+ * @len: Length of the message in bytes.
+ *
+ * Lock-free: slots are reserved with a compare-and-swap on the ring head,
+ * so an interrupt handler may log while it interrupts another writer. Once
+ * klog_init_deferred() has run, the rings are drained by this CPU's
+ * workqueue and the writer only formats; before that, writers outside
+ * interrupt context drain right away. A writer that finds its ring full
+ * drains it itself, except in interrupt context, where the message is
+ * dropped and counted.
+ */
+void klog_write(const char *msg, size_t len);
+
+/**
+ * klog_init_deferred - Hand draining over to the workqueues.
+ *
+ * Called once every CPU has its worker (see workqueue.h). klog_drain()
+ * still works from anywhere, e.g. before a dump that must not interleave
+ * with log text.
+ */
+void klog_init_deferred(void);
+
+/**
+ * klog_drain - Render pending records to the console and serial port.
+ *
+ * Merges all CPU rings in sequence order. Only one CPU drains at a time;
+ * a concurrent caller returns immediately.
+ */
+void klog_drain(void);
+
+/**
+ * klog_dump - Print the retained log history, dmesg style.
+ *
+ * Every record still held by the rings is printed as
+ * "[cpu seq tsc] text", oldest first.
+ */
+void klog_dump(void);
+
+// Messages dropped because a ring was full in interrupt context
+uint64_t klog_dropped(void);
+
+/**
+ * panic - Log a final message, flush everything and halt.
+ *
+ * @fmt: kprintf() style format string.
+ *
+ * Disables interrupts and stops the other CPUs with an NMI, then forces
+ * out every pending record with polled serial I/O. A record a stopped
+ * writer never finished is skipped. The panic message itself goes straight
+ * to the console and serial port, so it is printed even when the rings are
+ * full. Never returns; a panic on another CPU meanwhile just halts there.
+ */
+__attribute__((noreturn))
+void panic(const char *fmt, ...);
+
+#endif // KLOG_H
@@ -0,0 +1,145 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "kstack.h"
+#include "cpu.h"
+#include "tlb.h"
+#include "spinlock.h"
+#include "pmm_mngr.h"
+#include "vmm_mngr.h"
+#include "vmm_mngr_utils.h"
+#include "text_renderer.h"
+
+#define STACK_REGION_BASE (0xFFFF000000000000ULL | ((uint64_t)STACK_INDEX << 39))
+
+// Permanent stacks below, recyclable slots from here on
+#define KSTACK_SLOTS_BASE (STACK_REGION_BASE + (1ULL << 30))
+#define KSTACK_SLOT_SIZE  (PAGE_SIZE + KSTACK_SIZE)
+#define KSTACK_PAGES      (KSTACK_SIZE / PAGE_SIZE)
+
+_Static_assert(KSTACK_MAX_SLOTS % 64 == 0, "slot bitmap uses whole words");
+_Static_assert((uint64_t)KSTACK_MAX_SLOTS * KSTACK_SLOT_SIZE <= (511ULL << 30),
+               "stack slots overflow the PML4 slot");
+
+struct kstack_cpu {
+    uint64_t cache[KSTACK_CACHE_SIZE];  // Tops of mapped, unused stacks
+    uint32_t cached;
+    uint64_t allocs;
+    uint64_t cache_hits;
+    uint64_t maps;
+    uint64_t unmaps;
+} __attribute__((aligned(64)));
+
+static struct kstack_cpu kstack_cpus[MAX_CPUS];
+
+// Slots that are mapped or cached; guarded by kstack_lock
+static LOCK_CLASS(kstack_lock_class, "kstack");
+static struct ticket_lock kstack_lock = TICKET_LOCK_INIT(kstack_lock_class);
+static uint64_t slot_used[KSTACK_MAX_SLOTS / 64];
+static uint32_t slot_hint;              // No free slot below this word
+
+static uint64_t permanent_next = STACK_REGION_BASE;
+
+static uint64_t slot_bottom(uint32_t slot) {
+    return KSTACK_SLOTS_BASE + (uint64_t)slot * KSTACK_SLOT_SIZE + PAGE_SIZE;
+}
+
+static bool slot_reserve(uint32_t *slot) {
+    uint64_t flags = ticket_lock_irqsave(&kstack_lock);
+    for (uint32_t word = slot_hint; word < KSTACK_MAX_SLOTS / 64; word++) {
+        if (~slot_used[word]) {
+            uint32_t bit = __builtin_ctzll(~slot_used[word]);
+            slot_used[word] |= 1ULL << bit;
+            slot_hint = word;
+            ticket_unlock_irqrestore(&kstack_lock, flags);
+            *slot = word * 64 + bit;
+            return true;
+        }
+    }
+    slot_hint = KSTACK_MAX_SLOTS / 64;
+    ticket_unlock_irqrestore(&kstack_lock, flags);
+    return false;
+}
+
+static void slot_release(uint32_t slot) {
+    uint64_t flags = ticket_lock_irqsave(&kstack_lock);
+    slot_used[slot / 64] &= ~(1ULL << (slot % 64));
+    if (slot / 64 < slot_hint)
+        slot_hint = slot / 64;
+    ticket_unlock_irqrestore(&kstack_lock, flags);
+}
+
+uint64_t kstack_alloc(void) {
+    uint64_t flags = irq_save();
+    struct kstack_cpu *kc = &kstack_cpus[this_cpu_id()];
+    kc->allocs++;
+    if (kc->cached) {
+        uint64_t top = kc->cache[--kc->cached];
+        kc->cache_hits++;
+        irq_restore(flags);
+        return top;
+    }
+    kc->maps++;
+    irq_restore(flags);
+
+    uint32_t slot;
+    if (!slot_reserve(&slot))
+        return 0;
+
+    // A slot is unmapped while free, so this needs no shootdown
+    uint64_t bottom = slot_bottom(slot);
+    for (uint64_t offset = 0; offset < KSTACK_SIZE; offset += PAGE_SIZE)
+        vmm_map_recursive(bottom + offset, pmm_alloc(), PAGE_WRITE);
+    return bottom + KSTACK_SIZE;
+}
+
+void kstack_free(uint64_t top) {
+    uint64_t flags = irq_save();
+    struct kstack_cpu *kc = &kstack_cpus[this_cpu_id()];
+    if (kc->cached < KSTACK_CACHE_SIZE) {
+        kc->cache[kc->cached++] = top;
+        irq_restore(flags);
+        return;
+    }
+    kc->unmaps++;
+    irq_restore(flags);
+
+    // The frames may only be reused once no CPU can reach them anymore
+    uint64_t bottom = top - KSTACK_SIZE;
+    phys_addr_t frames[KSTACK_PAGES];
+    for (uint32_t i = 0; i < KSTACK_PAGES; i++)
+        frames[i] = vmm_query_mapping(bottom + i * PAGE_SIZE).phys_addr;
+    vmm_unmap_range(bottom, KSTACK_SIZE);
+    for (uint32_t i = 0; i < KSTACK_PAGES; i++)
+        pmm_free(frames[i]);
+
+    slot_release((bottom - PAGE_SIZE - KSTACK_SLOTS_BASE) / KSTACK_SLOT_SIZE);
+}
+
+uint64_t kstack_alloc_permanent(size_t size) {
+    uint64_t bottom = __atomic_add_fetch(&permanent_next, PAGE_SIZE + size, __ATOMIC_RELAXED) - size;
+    for (uint64_t offset = 0; offset < size; offset += PAGE_SIZE)
+        vmm_map_recursive(bottom + offset, pmm_alloc(), PAGE_WRITE);
+    return bottom + size;
+}
+
+void kstack_get_stats(struct kstack_stats *stats) {
+    *stats = (struct kstack_stats){ 0 };
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        struct kstack_cpu *kc = &kstack_cpus[cpu];
+        stats->allocs += kc->allocs;
+        stats->cache_hits += kc->cache_hits;
+        stats->maps += kc->maps;
+        stats->unmaps += kc->unmaps;
+    }
+    stats->permanent_bytes = __atomic_load_n(&permanent_next, __ATOMIC_RELAXED) - STACK_REGION_BASE;
+}
+
+void kstack_dump_stats(void) {
+    struct kstack_stats stats;
+    kstack_get_stats(&stats);
+    kprintf("Kernel stacks: %lu allocated, %lu from the cache, %lu mapped, %lu unmapped, "
+            "%lu KiB permanent\n",
+            stats.allocs, stats.cache_hits, stats.maps, stats.unmaps,
+            stats.permanent_bytes / 1024);
+}
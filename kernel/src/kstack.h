@@ -0,0 +1,69 @@
+#ifndef KSTACK_H
+#define KSTACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Kernel stacks in the STACK_INDEX slot. Each stack has an unmapped guard
+ * page right below it, so an overflow faults instead of running into the
+ * neighbour. The first GiB of the slot holds permanent stacks of any size
+ * (boot, per-CPU and IST stacks); above it sit fixed-size KSTACK_SIZE slots
+ * for threads, which are recycled.
+ *
+ * A freed thread stack stays mapped in a small per-CPU cache, so the next
+ * kstack_alloc() on that CPU costs no page-table work, no pmm_alloc() and
+ * no shootdown. Only when the cache is full is a stack unmapped and its
+ * frames returned.
+ */
+
+// Size of a recyclable stack, without its guard page
+#define KSTACK_SIZE (16 * 1024)
+
+// Freed stacks each CPU keeps mapped for reuse
+#define KSTACK_CACHE_SIZE 8
+
+// Recyclable stack slots in the region
+#define KSTACK_MAX_SLOTS 4096
+
+struct kstack_stats {
+    uint64_t allocs;
+    uint64_t cache_hits;        // Allocations served mapped from the cache
+    uint64_t maps;              // Allocations that mapped fresh frames
+    uint64_t unmaps;            // Frees that overflowed the cache
+    uint64_t permanent_bytes;   // Handed out by kstack_alloc_permanent()
+};
+
+/**
+ * kstack_alloc - Get a KSTACK_SIZE stack.
+ *
+ * Returns the stack top (the initial RSP), or 0 if all slots are in use.
+ * The memory is not cleared. Must not be called with a spinlock held.
+ */
+uint64_t kstack_alloc(void);
+
+/**
+ * kstack_free - Give back a stack from kstack_alloc().
+ *
+ * @top: What kstack_alloc() returned. Nothing may run on the stack anymore.
+ *
+ * Must not be called with a spinlock held, though interrupts may be off.
+ */
+void kstack_free(uint64_t top);
+
+/**
+ * kstack_alloc_permanent - Map a stack that is never freed.
+ *
+ * @size: Bytes, a multiple of PAGE_SIZE.
+ *
+ * Returns the stack top. Needs the recursive mapping.
+ */
+uint64_t kstack_alloc_permanent(size_t size);
+
+// Totals over all CPUs
+void kstack_get_stats(struct kstack_stats *stats);
+
+// Print how many allocations the cache served
+void kstack_dump_stats(void);
+
+#endif // KSTACK_H
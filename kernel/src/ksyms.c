@@ -0,0 +1,29 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "ksyms.h"
+
+// Generated by gen-ksyms: addresses ascending, names NUL-separated
+extern const uint64_t ksyms_count;
+extern const uint64_t ksyms_text_end;
+extern const uint64_t ksyms_addrs[];
+extern const uint32_t ksyms_name_offsets[];
+extern const char ksyms_names[];
+
+const char *ksym_lookup(uint64_t addr, uint64_t *offset) {
+    if (!ksyms_count || addr < ksyms_addrs[0] || addr >= ksyms_text_end)
+        return NULL;
+
+    // Last symbol at or below addr
+    uint64_t lo = 0, hi = ksyms_count;
+    while (hi - lo > 1) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (ksyms_addrs[mid] <= addr)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    if (offset)
+        *offset = addr - ksyms_addrs[lo];
+    return &ksyms_names[ksyms_name_offsets[lo]];
+}
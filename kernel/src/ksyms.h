@@ -0,0 +1,25 @@
+#ifndef KSYMS_H
+#define KSYMS_H
+
+#include <stdint.h>
+
+/*
+ * The kernel's own function symbols, embedded at build time. The kernel is
+ * linked once with an empty table; gen-ksyms turns the symbols of that
+ * image into the real table for the final link. The table lives in
+ * .rodata, after .text, so no function moves between the two links (the
+ * build checks this).
+ */
+
+/**
+ * ksym_lookup - Name the function that contains a code address.
+ *
+ * @addr:   Address in the kernel's text.
+ * @offset: Set to @addr minus the start of the function; may be NULL.
+ *
+ * Returns the symbol name, or NULL if @addr is outside the kernel's text.
+ * Binary search; safe from any context.
+ */
+const char *ksym_lookup(uint64_t addr, uint64_t *offset);
+
+#endif // KSYMS_H
@@ -1,4 +1,5 @@
 #include "limine_requests.h"
+#include "string.h"
 
 // Define Limine request markers
 __attribute__((used, section(".limine_requests_start")))
@@ -29,6 +30,39 @@ volatile struct limine_framebuffer_request framebuffer_request = {
     .revision = 0
 };
 
+// ACPI root table (physical address with base revision 3)
+__attribute__((used, section(".limine_requests")))
+volatile struct limine_rsdp_request rsdp_request = {
+    .id = LIMINE_RSDP_REQUEST,
+    .revision = 0
+};
+
+// Application processors; they park in the bootloader until smp_init()
+__attribute__((used, section(".limine_requests")))
+volatile struct limine_smp_request smp_request = {
+    .id = LIMINE_SMP_REQUEST,
+    .revision = 0,
+    .flags = LIMINE_SMP_X2APIC
+};
+
 // Define Limine request end marker
 __attribute__((used, section(".limine_requests_end")))
 volatile uint8_t limine_requests_end_marker;
+
+bool cmdline_has(const char *word) {
+    if (!exec_file.response || !exec_file.response->kernel_file)
+        return false;
+
+    size_t len = strlen(word);
+    const char *p = exec_file.response->kernel_file->cmdline;
+    while (p && *p) {
+        while (*p == ' ')
+            p++;
+        const char *start = p;
+        while (*p && *p != ' ')
+            p++;
+        if ((size_t)(p - start) == len && !memcmp(start, word, len))
+            return true;
+    }
+    return false;
+}
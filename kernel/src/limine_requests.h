@@ -1,6 +1,7 @@
 #pragma once
 #define LIMINE_API_REVISION 0
 
+#include <stdbool.h>
 #include <limine.h> // Include the Limine header
 
 // Declare the Limine requests as external variables
@@ -8,7 +9,19 @@ extern volatile struct limine_memmap_request memmap_request;
 extern volatile struct limine_hhdm_request hhdm_request;
 extern volatile struct limine_kernel_file_request exec_file;
 extern volatile struct limine_framebuffer_request framebuffer_request;
+extern volatile struct limine_rsdp_request rsdp_request;
+extern volatile struct limine_smp_request smp_request;
 
 // Start and end markers for Limine requests
 extern volatile uint8_t limine_requests_start_marker;
 extern volatile uint8_t limine_requests_end_marker;
+
+/**
+ * cmdline_has - Check the kernel command line for a whole word.
+ *
+ * @word: Option to look for, e.g. "bench".
+ *
+ * Must be called while the Limine responses are still reachable (before
+ * remap_kernel()).
+ */
+bool cmdline_has(const char *word);
@@ -9,6 +9,30 @@
 #include "limine_requests.h"
 #include "remap_pages.h"
 #include "idt.h"
+#include "ioremap.h"
+#include "fpu.h"
+#include "pic.h"
+#include "serial.h"
+#include "klog.h"
+#include "trace.h"
+#include "cpu.h"
+#include "bench.h"
+#include "isr.h"
+#include "apic.h"
+#include "clocksource.h"
+#include "pit.h"
+#include "timer.h"
+#include "percpu.h"
+#include "smp.h"
+#include "sched.h"
+#include "spinlock.h"
+#include "rcu.h"
+#include "tlb.h"
+#include "kstack.h"
+#include "vmm_mngr.h"
+#include "softirq.h"
+#include "workqueue.h"
+#include "profile.h"
 
 extern uint64_t _end;
 // Set the base revision to 3, this is recommended as this is the latest
@@ -28,7 +52,9 @@ static volatile LIMINE_BASE_REVISION(3);
 static void hcf(void) {
     for (;;) {
 #if defined (__x86_64__)
-        asm ("hlt");
+        // Run queued threads (the log drain among them) or sleep until the
+        // next interrupt or timer wheel deadline
+        sched_idle();
 #elif defined (__aarch64__) || defined (__riscv)
         asm ("wfi");
 #elif defined (__loongarch64)
@@ -40,6 +66,13 @@ static void hcf(void) {
 extern uint64_t new_stack_top;
 extern uint64_t new_stack_bottom;
 
+// Set from the kernel command line ("bench", "profile", "trace", "selftest") while Limine responses are reachable.
+// Kept out of kmain's frame, which does not survive the stack switch.
+static bool bench_mode;
+static bool profile_mode;
+static bool trace_mode;
+static bool selftest_mode;  // On-target checks; most are also covered by the host tests
+
 // Kernel start and end from linker script
 void test_huge_pages() {
     uint64_t kernel_end = (uint64_t)&_end;
@@ -52,6 +85,438 @@ void test_huge_pages() {
 }
 
 
+// Check memcpy/memmove/memset/memcmp against computed patterns for every
+// source/destination alignment and lengths on both sides of each size cut-off
+static uint8_t string_test_src[8192 + 64];
+static uint8_t string_test_dst[8192 + 64];
+
+static bool check_string_functions(void) {
+    static const size_t big_lengths[] = { 1000, 2047, 2048, 2049, 4095, 4096, 8191 };
+    size_t failures = 0;
+
+    for (size_t i = 0; i < sizeof(string_test_src); i++)
+        string_test_src[i] = (uint8_t)(i * 7 + 3);
+
+    for (size_t so = 0; so < 16; so++) {
+        for (size_t dof = 0; dof < 16; dof++) {
+            for (size_t n = 0; n < 300 + sizeof(big_lengths) / sizeof(big_lengths[0]); n++) {
+                size_t len = n < 300 ? n : big_lengths[n - 300];
+                uint8_t *dst = string_test_dst;
+
+                for (size_t i = 0; i < len + 32; i++)
+                    dst[i] = (uint8_t)(i ^ 0xA5);
+
+                memcpy(dst + dof, string_test_src + so, len);
+                for (size_t i = 0; i < len + 32; i++) {
+                    uint8_t expect = (i >= dof && i < dof + len) ? (uint8_t)((i - dof + so) * 7 + 3) : (uint8_t)(i ^ 0xA5);
+                    if (dst[i] != expect) {
+                        failures++;
+                        break;
+                    }
+                }
+
+                memset(dst + dof, (int)so * 13, len);
+                for (size_t i = 0; i < len + 32; i++) {
+                    uint8_t expect = (i >= dof && i < dof + len) ? (uint8_t)(so * 13) : (uint8_t)(i ^ 0xA5);
+                    if (dst[i] != expect) {
+                        failures++;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // Overlapping moves in both directions around a fixed source
+    for (int delta = -80; delta <= 80; delta++) {
+        for (size_t len = 0; len < 300; len += 7) {
+            uint8_t *buf = string_test_dst;
+            size_t s = 1024, d = 1024 + delta;
+
+            for (size_t i = 0; i < 2048; i++)
+                buf[i] = (uint8_t)(i * 11 + 1);
+
+            memmove(buf + d, buf + s, len);
+            for (size_t i = 0; i < 2048; i++) {
+                uint8_t expect = (i >= d && i < d + len) ? (uint8_t)((i - d + s) * 11 + 1) : (uint8_t)(i * 11 + 1);
+                if (buf[i] != expect) {
+                    failures++;
+                    break;
+                }
+            }
+        }
+    }
+
+    // A single differing byte at every position decides the sign
+    for (size_t len = 1; len < 64; len++) {
+        for (size_t k = 0; k < len; k++) {
+            for (size_t i = 0; i < len; i++)
+                string_test_dst[i + 3] = string_test_src[i];
+
+            if (memcmp(string_test_dst + 3, string_test_src, len) != 0)
+                failures++;
+            string_test_dst[k + 3]++;
+            int expect = string_test_dst[k + 3] > string_test_src[k] ? 1 : -1;
+            if (memcmp(string_test_dst + 3, string_test_src, len) != expect ||
+                memcmp(string_test_src, string_test_dst + 3, len) != -expect)
+                failures++;
+        }
+    }
+
+    if (failures)
+        kprintf("string: %lu failures\n", failures);
+    return failures == 0;
+}
+
+
+#define CHECK_TIMERS 3
+
+static struct timer check_timers_list[CHECK_TIMERS + 1];
+static volatile uint64_t check_fired_ns[CHECK_TIMERS + 1];
+static volatile int check_fired_order[CHECK_TIMERS + 1];
+static volatile int check_fired;
+
+static void check_timer_fn(struct timer *timer) {
+    int i = (int)(uintptr_t)timer->data;
+    check_fired_ns[i] = ktime_get_ns();
+    check_fired_order[check_fired++] = i;
+}
+
+// Arm a few wheel timers out of order, cancel one and sleep until they fire
+static bool check_timers(void) {
+    static const uint64_t delays_ns[CHECK_TIMERS + 1] = { 2000000, 500000, 1000000, 1500000 };
+    uint64_t start = ktime_get_ns();
+
+    check_fired = 0;
+    for (int i = 0; i <= CHECK_TIMERS; i++) {
+        check_fired_ns[i] = 0;
+        timer_setup(&check_timers_list[i], check_timer_fn, (void *)(uintptr_t)i);
+        timer_add(&check_timers_list[i], start + delays_ns[i]);
+    }
+    bool cancelled = timer_cancel(&check_timers_list[CHECK_TIMERS]);
+
+    while (check_fired < CHECK_TIMERS && ktime_get_ns() - start < 100000000)
+        timer_idle();
+
+    bool ok = cancelled && check_fired == CHECK_TIMERS && !check_fired_ns[CHECK_TIMERS] &&
+              check_fired_order[0] == 1 && check_fired_order[1] == 2 && check_fired_order[2] == 0;
+    for (int i = 0; i < CHECK_TIMERS; i++) {
+        uint64_t deadline = start + delays_ns[i];
+        if (check_fired_ns[i] < deadline)
+            ok = false;
+        else
+            kprintf("Timer %lu us: fired %lu ns late\n", delays_ns[i] / 1000,
+                    check_fired_ns[i] - deadline);
+    }
+    return ok;
+}
+
+#define CHECK_SCHED_THREADS 32
+#define CHECK_SCHED_ROUNDS  200
+
+static volatile uint32_t check_sched_done;
+static volatile uint64_t check_sched_work;
+static struct thread *volatile check_sched_sleeper;
+static volatile bool check_sched_woken;
+
+static void check_sched_worker(void *arg) {
+    (void)arg;
+    for (int i = 0; i < CHECK_SCHED_ROUNDS; i++) {
+        __atomic_fetch_add(&check_sched_work, 1, __ATOMIC_RELAXED);
+        if (i % 8 == 0)
+            sched_yield();
+        else
+            cond_resched();
+    }
+    __atomic_fetch_add(&check_sched_done, 1, __ATOMIC_RELEASE);
+}
+
+static void check_sched_sleep(void *arg) {
+    (void)arg;
+    check_sched_sleeper = current_thread();
+    while (!check_sched_woken)
+        sched_block();
+    __atomic_fetch_add(&check_sched_done, 1, __ATOMIC_RELEASE);
+}
+
+static void check_sched_waker(void *arg) {
+    (void)arg;
+    while (!check_sched_sleeper)
+        sched_yield();
+    check_sched_woken = true;
+    sched_wake(check_sched_sleeper);
+    __atomic_fetch_add(&check_sched_done, 1, __ATOMIC_RELEASE);
+}
+
+// Queue a burst of yielding threads on the BSP for the other CPUs to steal,
+// plus a block/wake pair, and idle until all of them finished
+static bool check_sched(void) {
+    uint32_t expected = CHECK_SCHED_THREADS + 2;
+    check_sched_done = 0;
+    check_sched_work = 0;
+
+    if (!thread_create(check_sched_sleep, NULL, "check-sleep"))
+        return false;
+    for (int i = 0; i < CHECK_SCHED_THREADS; i++)
+        if (!thread_create(check_sched_worker, NULL, "check-worker"))
+            return false;
+    if (!thread_create(check_sched_waker, NULL, "check-wake"))
+        return false;
+
+    uint64_t start = ktime_get_ns();
+    while (__atomic_load_n(&check_sched_done, __ATOMIC_ACQUIRE) < expected &&
+           ktime_get_ns() - start < 1000000000ULL)
+        sched_idle();
+
+    uint64_t steals = 0;
+    for (uint32_t cpu = 0; cpu < smp_cpu_count; cpu++) {
+        struct sched_stats stats;
+        sched_get_stats(cpu, &stats);
+        steals += stats.steals;
+    }
+    kprintf("Scheduler: %u threads done in %lu us, %lu steals\n", check_sched_done,
+            (ktime_get_ns() - start) / 1000, steals);
+    return check_sched_done == expected &&
+           check_sched_work == (uint64_t)CHECK_SCHED_THREADS * CHECK_SCHED_ROUNDS;
+}
+
+#define CHECK_RCU_OBJECTS 8
+#define CHECK_RCU_UPDATES 100
+#define CHECK_RCU_READERS 3
+
+struct check_rcu_object {
+    volatile bool alive;
+    struct rcu_head rcu;
+};
+
+static struct check_rcu_object check_rcu_objects[CHECK_RCU_OBJECTS];
+static struct check_rcu_object *check_rcu_current;
+static volatile bool check_rcu_stop;
+static volatile bool check_rcu_stale;
+static volatile uint32_t check_rcu_callbacks;
+static volatile uint32_t check_rcu_readers_done;
+
+static void check_rcu_reader(void *arg) {
+    (void)arg;
+    for (uint64_t i = 0; !check_rcu_stop; i++) {
+        rcu_read_lock();
+        struct check_rcu_object *obj = rcu_dereference(check_rcu_current);
+        if (!obj->alive)
+            check_rcu_stale = true;
+        rcu_read_unlock();
+        if (i % 64 == 0)
+            sched_yield();
+    }
+    __atomic_fetch_add(&check_rcu_readers_done, 1, __ATOMIC_RELEASE);
+}
+
+static void check_rcu_callback(struct rcu_head *head) {
+    (void)head;
+    __atomic_fetch_add(&check_rcu_callbacks, 1, __ATOMIC_RELAXED);
+}
+
+// Readers on other CPUs must never see an object retired after a grace
+// period; call_rcu() callbacks must all run
+static bool check_rcu(void) {
+    check_rcu_objects[0].alive = true;
+    rcu_assign_pointer(check_rcu_current, &check_rcu_objects[0]);
+    for (int i = 0; i < CHECK_RCU_READERS; i++)
+        if (!thread_create(check_rcu_reader, NULL, "check-rcu"))
+            return false;
+
+    uint64_t start = ktime_get_ns();
+    uint64_t gp_start = rcu_completed();
+    for (int i = 1; i <= CHECK_RCU_UPDATES; i++) {
+        struct check_rcu_object *old = check_rcu_current;
+        struct check_rcu_object *obj = &check_rcu_objects[i % CHECK_RCU_OBJECTS];
+        obj->alive = true;
+        rcu_assign_pointer(check_rcu_current, obj);
+        synchronize_rcu();
+        old->alive = false;
+        call_rcu(&old->rcu, check_rcu_callback);
+    }
+    uint64_t gp_ns = (ktime_get_ns() - start) / CHECK_RCU_UPDATES;
+
+    check_rcu_stop = true;
+    synchronize_rcu();
+    while (check_rcu_readers_done < CHECK_RCU_READERS || check_rcu_callbacks < CHECK_RCU_UPDATES) {
+        if (ktime_get_ns() - start > 2000000000ULL)
+            break;
+        sched_idle();
+    }
+
+    kprintf("RCU: %lu grace periods, %lu us per synchronize_rcu()\n",
+            rcu_completed() - gp_start, gp_ns / 1000);
+    return !check_rcu_stale && check_rcu_callbacks == CHECK_RCU_UPDATES &&
+           check_rcu_readers_done == CHECK_RCU_READERS;
+}
+
+// Next to the benchmark scratch page, in a PML4 slot nothing else uses
+#define CHECK_TLB_VIRT    (0xFFFF820000000000ULL + (1ULL << 20))
+#define CHECK_TLB_READERS 3
+#define CHECK_TLB_REMAPS  200
+
+static volatile uint64_t check_tlb_seq;         // Odd while a remap is in flight
+static volatile bool check_tlb_stop;
+static volatile bool check_tlb_stale;
+static volatile uint32_t check_tlb_readers_done;
+
+// Page n of the check holds n; a reader that finds the other one after the
+// remap returned saw a translation the shootdown should have removed
+static void check_tlb_reader(void *arg) {
+    (void)arg;
+    volatile uint64_t *page = (volatile uint64_t *)CHECK_TLB_VIRT;
+    for (uint64_t i = 0; !check_tlb_stop; i++) {
+        uint64_t seq = __atomic_load_n(&check_tlb_seq, __ATOMIC_ACQUIRE);
+        if (!(seq & 1)) {
+            uint64_t value = *page;
+            asm volatile ("" : : : "memory");
+            if (__atomic_load_n(&check_tlb_seq, __ATOMIC_ACQUIRE) == seq &&
+                value != (seq >> 1) % 2)
+                check_tlb_stale = true;
+        }
+        if (i % 256 == 0)
+            cond_resched();
+    }
+    __atomic_fetch_add(&check_tlb_readers_done, 1, __ATOMIC_RELEASE);
+}
+
+// Flip a page between two frames while threads on the other CPUs read it
+static bool check_tlb(void) {
+    phys_addr_t frames[2] = { pmm_alloc(), pmm_alloc() };
+    for (int i = 0; i < 2; i++)
+        *(uint64_t *)(HHDM_OFFSET + frames[i]) = i;
+    vmm_map_recursive(CHECK_TLB_VIRT, frames[0], PAGE_WRITE);
+
+    for (int i = 0; i < CHECK_TLB_READERS; i++)
+        if (!thread_create(check_tlb_reader, NULL, "check-tlb"))
+            return false;
+
+    uint64_t start = ktime_get_ns();
+    for (uint64_t i = 1; i <= CHECK_TLB_REMAPS; i++) {
+        __atomic_fetch_add(&check_tlb_seq, 1, __ATOMIC_SEQ_CST);
+        vmm_map_recursive(CHECK_TLB_VIRT, frames[i % 2], PAGE_WRITE);
+        __atomic_fetch_add(&check_tlb_seq, 1, __ATOMIC_SEQ_CST);
+        sched_yield();
+    }
+    uint64_t remap_ns = (ktime_get_ns() - start) / CHECK_TLB_REMAPS;
+
+    check_tlb_stop = true;
+    while (check_tlb_readers_done < CHECK_TLB_READERS && ktime_get_ns() - start < 2000000000ULL)
+        sched_idle();
+
+    vmm_unmap_recursive(CHECK_TLB_VIRT);
+    pmm_free(frames[0]);
+    pmm_free(frames[1]);
+
+    kprintf("TLB: %lu ns per remap with shootdown\n", remap_ns);
+    return !check_tlb_stale && check_tlb_readers_done == CHECK_TLB_READERS;
+}
+
+#define CHECK_FPU_THREADS 4
+#define CHECK_FPU_ROUNDS  100
+
+static uint8_t check_fpu_src[4096], check_fpu_dst[CHECK_FPU_THREADS][4096];
+static volatile bool check_fpu_lost;
+static volatile uint32_t check_fpu_done;
+
+// Keep a value in %xmm7 across yields and SIMD memcpy() calls, which
+// clobber the registers, while the other threads do the same
+__attribute__((target("sse2")))
+static void check_fpu_worker(void *arg) {
+    uint64_t id = (uint64_t)arg;
+    for (uint64_t i = 0; i < CHECK_FPU_ROUNDS; i++) {
+        uint64_t value = (id << 32) | i, got;
+        asm volatile ("movq %0, %%xmm7" : : "r"(value) : "xmm7");
+        memcpy(check_fpu_dst[id], check_fpu_src, sizeof(check_fpu_src));
+        sched_yield();
+        asm volatile ("movq %%xmm7, %0" : "=r"(got));
+        if (got != value)
+            check_fpu_lost = true;
+    }
+    __atomic_fetch_add(&check_fpu_done, 1, __ATOMIC_RELEASE);
+}
+
+static bool check_fpu(void) {
+    struct fpu_stats before, after;
+    fpu_get_stats(0, &before);
+
+    for (uint64_t i = 0; i < CHECK_FPU_THREADS; i++)
+        if (!thread_create(check_fpu_worker, (void *)i, "check-fpu"))
+            return false;
+
+    uint64_t start = ktime_get_ns();
+    while (check_fpu_done < CHECK_FPU_THREADS && ktime_get_ns() - start < 2000000000ULL)
+        sched_idle();
+
+    fpu_get_stats(0, &after);
+    kprintf("FPU: %lu lazy loads on CPU 0 for %u thread rounds\n",
+            after.traps - before.traps, CHECK_FPU_THREADS * CHECK_FPU_ROUNDS);
+    return !check_fpu_lost && check_fpu_done == CHECK_FPU_THREADS;
+}
+
+#define CHECK_WORK_ITEMS 64
+
+static struct work check_work_items[CHECK_WORK_ITEMS];
+static struct timer check_work_timer;
+static volatile uint32_t check_work_done;
+static volatile bool check_work_bad;
+
+static void check_work_fn(struct work *work) {
+    uint32_t cpu = (uint32_t)(uintptr_t)work->data;
+    if (in_interrupt() || this_cpu_id() != cpu)
+        check_work_bad = true;
+    __atomic_fetch_add(&check_work_done, 1, __ATOMIC_RELEASE);
+}
+
+// Softirq context: spread the items over the online CPUs' workqueues
+static void check_work_queue(struct timer *timer) {
+    (void)timer;
+    if (!in_interrupt())
+        check_work_bad = true;
+    for (uint32_t i = 0; i < CHECK_WORK_ITEMS; i++) {
+        uint32_t cpu = i % smp_cpu_count;
+        work_setup(&check_work_items[i], check_work_fn, (void *)(uintptr_t)cpu);
+        queue_work_on(cpu, &check_work_items[i]);
+    }
+}
+
+// A timer callback hands work to the per-CPU workers, which must run each
+// item in thread context on the CPU it was queued for
+static bool check_workqueue(void) {
+    check_work_done = 0;
+    timer_setup(&check_work_timer, check_work_queue, NULL);
+    timer_add(&check_work_timer, ktime_get_ns() + 1000000);
+
+    uint64_t start = ktime_get_ns();
+    while (check_work_done < CHECK_WORK_ITEMS && ktime_get_ns() - start < 1000000000ULL)
+        sched_idle();
+
+    struct workqueue_stats stats;
+    workqueue_get_stats(0, &stats);
+    kprintf("Workqueue: %u items done in %lu us, CPU 0 max depth %u\n", check_work_done,
+            (ktime_get_ns() - start) / 1000, stats.max_depth);
+    return !check_work_bad && check_work_done == CHECK_WORK_ITEMS;
+}
+
+// ktime_get_ns() must never go backwards and must agree with the PIT
+static bool check_clocksource(void) {
+    uint64_t prev = ktime_get_ns();
+    for (int i = 0; i < 10000; i++) {
+        uint64_t now = ktime_get_ns();
+        if (now < prev)
+            return false;
+        prev = now;
+    }
+
+    uint64_t start = ktime_get_ns();
+    pit_delay_us(20000);
+    uint64_t elapsed = ktime_get_ns() - start;
+    kprintf("Clocksource: 20000 us PIT delay took %lu ns\n", elapsed);
+
+    // Allow 1% plus the PIT's own rounding
+    return elapsed > 19800000 && elapsed < 20300000;
+}
 
 static inline uint64_t get_limine_stack_base() {
     uint64_t stack_base;
@@ -69,24 +534,43 @@ static inline uint64_t get_limine_stack_bottom() {
 // If renaming kmain() to something else, make sure to change the
 // linker script accordingly.
 void kmain(void) {
+    // this_cpu_id() reads the per-CPU area through GS
+    percpu_init_bsp();
+
     // Ensure the bootloader actually understands our base revision (see spec).
     if (LIMINE_BASE_REVISION_SUPPORTED == false) {
         hcf();
     }
 
+    // Enable SSE/AVX before the console picks its glyph blitter
+    fpu_init();
+    string_init();
+
+    // Before the console, which takes its buffers from the PMM
+    pmm_init(memmap_request, hhdm_request);
+
     bool fb_init = init_text_renderer(framebuffer_request.response->framebuffers[0]->address, framebuffer_request.response->framebuffers[0]->width, framebuffer_request.response->framebuffers[0]->height, framebuffer_request.response->framebuffers[0]->pitch);
 
     if (!fb_init) {
         hcf();
     }
 
+    bench_mode = bench_requested();
+    profile_mode = cmdline_has("profile");
+    trace_mode = cmdline_has("trace");
+    selftest_mode = cmdline_has("selftest");
+
+    // Record allocator and paging events from here on
+    if (trace_mode)
+        trace_enable();
+
     kprintf("RSP: %p\n", get_limine_stack_base());
     kprintf("RBP: %p\n", get_limine_stack_bottom());
 
     kprintf("Kernel loaded at physical: %p\n", &kmain);
 
     kprintf("cr3: %lx\n",hhdm_request.response->offset + read_cr3());
-    print_and_init_memmap(memmap_request, hhdm_request);
+    print_memmap(memmap_request);
 
 
     kprintf("-------------------------\n");
@@ -115,6 +599,9 @@ void kmain(void) {
     kprintf("-------------------------\n");
     kprintf("Other Tests tests\n");
     kprintf("-------------------------\n");
+    kprintf("String functions: %s\n", string_impl_name());
+    if (selftest_mode)
+        kprintf("String check: %s\n", check_string_functions() ? "OK" : "FAILED");
     /*
     void *address;
     uint64_t size;
@@ -149,6 +636,9 @@ void kmain(void) {
     kprintf("Kernel end: %p\n", &_end);
     //inspect_page_tables();
 
+    // Program the PAT before remap_kernel() maps the framebuffer as WC
+    pat_init();
+
     remap_kernel();
 
 
@@ -164,6 +654,9 @@ void kmain(void) {
     asm volatile("mov %0, %%rbp" :: "r"(new_stack_top));
     asm volatile("mov %0, %%rsp" :: "r"(new_stack_top- (old_stack_top - old_stack_bottom)));
 
+    // The boot stack is this CPU's stack from here on; backtraces stop at its top
+    this_cpu()->stack_top = new_stack_top;
+
 
     kprintf("New RSP: %p\n", get_limine_stack_base());
     kprintf("New RBP: %p\n", get_limine_stack_bottom());
@@ -175,8 +668,73 @@ void kmain(void) {
     idt_install();
     kprintf("IDT installed\n");
 
+    // Calibrate the TSC before anything converts time to cycles
+    clocksource_init();
+    if (selftest_mode)
+        kprintf("Clocksource check: %s\n", check_clocksource() ? "OK" : "FAILED");
+
+    // Legacy IRQs on vectors 0x20-0x2F, then let the UART drain by interrupt
+    pic_init();
+    // Local APIC in virtual wire mode, timer calibrated against the TSC
+    apic_init();
+    timer_init();
+    serial_enable_irq();
+    asm volatile ("sti");
+    kprintf("Interrupts enabled, serial output is interrupt driven\n");
+
+    // `make profile`: sample the rest of boot; APs join as they come up
+    if (profile_mode)
+        profile_start();
+
+    kprintf("Local APIC %u (%s), timer %s\n", apic_id(),
+            apic_x2apic ? "x2APIC" : "xAPIC", apic_timer_mode_name());
+    if (selftest_mode)
+        kprintf("Timer wheel check: %s\n", check_timers() ? "OK" : "FAILED");
+
+    // Bring up the application processors
+    smp_init();
+    kprintf("SMP: %u of %u CPUs online\n", smp_cpus_online, smp_cpu_count);
+
+    // From here on kmain is the BSP's idle thread
+    sched_init_cpu();
+
+    // Every CPU has a worker now; kprintf() stops rendering in the caller
+    klog_init_deferred();
+    if (selftest_mode) {
+        kprintf("Scheduler check: %s\n", check_sched() ? "OK" : "FAILED");
+        kprintf("RCU check: %s\n", check_rcu() ? "OK" : "FAILED");
+        kprintf("TLB shootdown check: %s\n", check_tlb() ? "OK" : "FAILED");
+        kprintf("Lazy FPU check: %s\n", check_fpu() ? "OK" : "FAILED");
+        kprintf("Workqueue check: %s\n", check_workqueue() ? "OK" : "FAILED");
+    }
+    sched_dump_stats();
+    lockstat_dump();
+    tlb_dump_stats();
+    kstack_dump_stats();
+    fpu_dump_stats();
+    softirq_dump_stats();
+    workqueue_dump_stats();
+
+    // Folded stacks over COM1, then power off QEMU
+    if (profile_mode) {
+        profile_dump();
+        bench_exit(0);
+    }
+
+    // `make bench`: run the benchmark registry and power off QEMU
+    if (bench_mode) {
+        bench_run_all();
+        bench_exit(0);
+    }
+
     // Test huge pages
 
+    isr_dump_stats();
+
+    // Ship the binary trace over COM1 (decode with tools/trace_decode.py)
+    if (trace_mode)
+        trace_dump();
+
     // Try to page fault:
 
     uint64_t *ptr = (uint64_t *)0x1000;
@@ -1,27 +1,28 @@
 #include <stdint.h>
 #include "page_fault_handler.h"
 #include "text_renderer.h"
+#include "klog.h"
+#include "trace.h"
 
 /**
  * page_fault_handler - Handles page fault exceptions.
  *
- * @frame: Pointer to the CPU state at the time of the fault.
- * @error_code: The error code provided by the CPU.
+ * @frame: CPU state at the time of the fault, including the error code.
  *
- * This handler prints the faulting virtual address (from CR2) and halts the system.
+ * This handler prints the faulting virtual address (from CR2) and panics.
  */
-__attribute__((interrupt))
-void page_fault_handler(struct interrupt_frame *frame, uint64_t error_code) {
+void page_fault_handler(struct isr_frame *frame) {
     uint64_t fault_addr;
+    uint64_t error_code = frame->error_code;
+
     // Retrieve the faulting address from CR2.
     asm volatile ("mov %%cr2, %0" : "=r" (fault_addr));
+    trace(TRACE_PAGE_FAULT, fault_addr, error_code);
 
     // Print out the faulting virtual address.
     kprintf("Page fault at virtual address: 0x%lx\n", fault_addr);
     kprintf("Error code: 0x%lx\n", error_code);
 
-    // Halt the system.
-    while (1) {
-        asm volatile ("hlt");
-    }
+    // Flush the log and halt the system.
+    panic("Unhandled page fault at RIP 0x%lx\n", frame->rip);
 }
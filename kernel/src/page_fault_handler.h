@@ -1,21 +1,16 @@
-#include <stdint.h>
+#ifndef PAGE_FAULT_HANDLER_H
+#define PAGE_FAULT_HANDLER_H
 
-// Structure passed to interrupt handlers (simplified)
-struct interrupt_frame {
-    uint64_t rip;
-    uint64_t cs;
-    uint64_t flags;
-    uint64_t rsp;
-    uint64_t ss;
-};
+#include <stdint.h>
+#include "isr.h"
 
 /**
  * page_fault_handler - Handles page fault exceptions.
  *
- * @frame: Pointer to the CPU state at the time of the fault.
- * @error_code: The error code provided by the CPU.
+ * @frame: CPU state at the time of the fault, including the error code.
  *
- * This handler prints the faulting virtual address (from CR2) and halts the system.
+ * This handler prints the faulting virtual address (from CR2) and panics.
  */
-__attribute__((interrupt))
-void page_fault_handler(struct interrupt_frame *frame, uint64_t error_code) ;
\ No newline at end of file
+void page_fault_handler(struct isr_frame *frame);
+
+#endif // PAGE_FAULT_HANDLER_H
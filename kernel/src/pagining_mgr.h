@@ -15,9 +15,9 @@
 #define PD_INDEX(vaddr)   (((vaddr) >> PD_SHIFT) & 0x1FF)
 #define PT_INDEX(vaddr)   (((vaddr) >> PT_SHIFT) & 0x1FF)
 
-#define PAGE_PRESENT  (1 << 0)
-#define PAGE_RW       (1 << 1)
-#define PAGE_USER     (1 << 2)
+#define PAGE_PRESENT 0x1
+#define PAGE_RW      0x2
+#define PAGE_USER    0x4
 
 
 // Assuming identity mapping or a known KERNEL_BASE
@@ -0,0 +1,56 @@
+#ifndef PERCPU_H
+#define PERCPU_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cpu.h"
+#include "gdt.h"
+
+#define MSR_GS_BASE        0xC0000101
+#define MSR_KERNEL_GS_BASE 0xC0000102
+
+/*
+ * Per-CPU data block, reached through the GS segment base. The first fields
+ * have fixed offsets because this_cpu_id() in cpu.h and the AP entry code in
+ * smp_entry.S address them directly.
+ */
+struct percpu {
+    struct percpu *self;        // PERCPU_SELF: for turning %gs into a pointer
+    uint32_t cpu_id;            // PERCPU_CPU_ID: index into MAX_CPUS arrays
+    uint32_t apic_id;
+    uint64_t cr3;               // PERCPU_CR3: page tables the AP switches to
+    uint64_t stack_top;         // PERCPU_STACK_TOP: kernel stack of this CPU
+    volatile uint32_t online;
+    uint32_t reserved;
+    uint64_t gdt[GDT_ENTRIES];
+    struct tss tss;
+} __attribute__((aligned(64)));
+
+#define PERCPU_SELF      0
+#define PERCPU_CPU_ID    8
+#define PERCPU_CR3       16
+#define PERCPU_STACK_TOP 24
+
+_Static_assert(offsetof(struct percpu, self) == PERCPU_SELF, "percpu layout");
+_Static_assert(offsetof(struct percpu, cpu_id) == PERCPU_CPU_ID, "percpu layout");
+_Static_assert(offsetof(struct percpu, cr3) == PERCPU_CR3, "percpu layout");
+_Static_assert(offsetof(struct percpu, stack_top) == PERCPU_STACK_TOP, "percpu layout");
+
+extern struct percpu percpu_areas[MAX_CPUS];
+
+// Per-CPU area of the executing CPU
+static inline struct percpu *this_cpu(void) {
+    struct percpu *cpu;
+    asm volatile ("movq %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+/**
+ * percpu_init_bsp - Give the bootstrap processor its per-CPU area.
+ *
+ * Points IA32_GS_BASE at percpu_areas[0] so this_cpu_id() works. Must be the
+ * first thing kmain() does; the GDT and TSS follow in smp_init().
+ */
+void percpu_init_bsp(void);
+
+#endif // PERCPU_H
@@ -0,0 +1,81 @@
+#include <stdint.h>
+#include "pic.h"
+#include "cpu.h"
+#include "idt.h"
+#include "isr.h"
+
+#define PIC1_CMD  0x20
+#define PIC1_DATA 0x21
+#define PIC2_CMD  0xA0
+#define PIC2_DATA 0xA1
+
+#define PIC_EOI   0x20
+#define PIC_CASCADE_IRQ 2
+
+// IRQ 7 and 15 may fire without a real request; they must not be acknowledged
+// at the PIC that raised them.
+static void pic_spurious_master(struct isr_frame *frame) {
+    (void)frame;
+}
+
+static void pic_spurious_slave(struct isr_frame *frame) {
+    (void)frame;
+    // The master did see the cascade line, so it still wants its EOI
+    outb(PIC1_CMD, PIC_EOI);
+}
+
+void pic_init(void) {
+    // ICW1: start initialization, expect ICW4
+    outb(PIC1_CMD, 0x11);
+    io_wait();
+    outb(PIC2_CMD, 0x11);
+    io_wait();
+
+    // ICW2: vector offsets
+    outb(PIC1_DATA, PIC_VECTOR_BASE);
+    io_wait();
+    outb(PIC2_DATA, PIC_VECTOR_BASE + 8);
+    io_wait();
+
+    // ICW3: slave on IRQ 2
+    outb(PIC1_DATA, 1 << PIC_CASCADE_IRQ);
+    io_wait();
+    outb(PIC2_DATA, PIC_CASCADE_IRQ);
+    io_wait();
+
+    // ICW4: 8086 mode
+    outb(PIC1_DATA, 0x01);
+    io_wait();
+    outb(PIC2_DATA, 0x01);
+    io_wait();
+
+    // Mask everything
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+
+    isr_register(PIC_VECTOR_BASE + 7, pic_spurious_master);
+    isr_register(PIC_VECTOR_BASE + 15, pic_spurious_slave);
+}
+
+void pic_unmask(uint8_t irq) {
+    if (irq < 8) {
+        outb(PIC1_DATA, inb(PIC1_DATA) & ~(1 << irq));
+    } else {
+        outb(PIC2_DATA, inb(PIC2_DATA) & ~(1 << (irq - 8)));
+        outb(PIC1_DATA, inb(PIC1_DATA) & ~(1 << PIC_CASCADE_IRQ));
+    }
+}
+
+void pic_mask(uint8_t irq) {
+    if (irq < 8) {
+        outb(PIC1_DATA, inb(PIC1_DATA) | (1 << irq));
+    } else {
+        outb(PIC2_DATA, inb(PIC2_DATA) | (1 << (irq - 8)));
+    }
+}
+
+void pic_send_eoi(uint8_t irq) {
+    if (irq >= 8)
+        outb(PIC2_CMD, PIC_EOI);
+    outb(PIC1_CMD, PIC_EOI);
+}
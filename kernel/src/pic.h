@@ -0,0 +1,27 @@
+#ifndef PIC_H
+#define PIC_H
+
+#include <stdint.h>
+
+// Legacy IRQ 0-15 are delivered on vectors PIC_VECTOR_BASE..PIC_VECTOR_BASE+15
+#define PIC_VECTOR_BASE 0x20
+
+/**
+ * pic_init - Remap the 8259 pair away from the exception vectors.
+ *
+ * Moves IRQ 0-7 to PIC_VECTOR_BASE and IRQ 8-15 to PIC_VECTOR_BASE + 8,
+ * masks every line and installs handlers for the spurious IRQ 7 and 15.
+ * Drivers unmask their own line with pic_unmask().
+ */
+void pic_init(void);
+
+// Unmask a single legacy IRQ line (the cascade is unmasked as needed)
+void pic_unmask(uint8_t irq);
+
+// Mask a single legacy IRQ line
+void pic_mask(uint8_t irq);
+
+// Acknowledge an IRQ at the end of its handler
+void pic_send_eoi(uint8_t irq);
+
+#endif // PIC_H
@@ -0,0 +1,40 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "pit.h"
+#include "cpu.h"
+
+#define PIT_CH2_DATA 0x42
+#define PIT_CMD      0x43
+#define PIT_GATE     0x61   // NMI status and control port
+
+#define GATE_CH2     0x01
+#define GATE_SPEAKER 0x02
+#define GATE_OUT2    0x20
+
+void pit_oneshot_start(uint16_t ticks) {
+    // Gate low while loading, speaker off
+    uint8_t gate = inb(PIT_GATE) & ~(GATE_CH2 | GATE_SPEAKER);
+    outb(PIT_GATE, gate);
+
+    // Channel 2, lobyte/hibyte access, mode 0 (interrupt on terminal count)
+    outb(PIT_CMD, 0xB0);
+    outb(PIT_CH2_DATA, ticks & 0xFF);
+    outb(PIT_CH2_DATA, ticks >> 8);
+
+    // The rising edge of the gate starts the count
+    outb(PIT_GATE, gate | GATE_CH2);
+}
+
+bool pit_oneshot_expired(void) {
+    return inb(PIT_GATE) & GATE_OUT2;
+}
+
+void pit_delay_us(uint32_t us) {
+    uint64_t ticks = (uint64_t)us * PIT_HZ / 1000000 + 1;
+    if (ticks > PIT_MAX_TICKS)
+        ticks = PIT_MAX_TICKS;
+
+    pit_oneshot_start((uint16_t)ticks);
+    while (!pit_oneshot_expired())
+        asm volatile ("pause");
+}
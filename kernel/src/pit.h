@@ -0,0 +1,30 @@
+#ifndef PIT_H
+#define PIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Input clock of the 8254 programmable interval timer
+#define PIT_HZ 1193182
+
+// Longest interval a single one-shot can measure (16-bit counter)
+#define PIT_MAX_TICKS 0xFFFF
+
+/**
+ * pit_oneshot_start - Start a one-shot countdown on PIT channel 2.
+ *
+ * @ticks: Length of the interval in PIT_HZ ticks (1-PIT_MAX_TICKS).
+ *
+ * Channel 2 is gated through port 0x61 and raises no interrupt, so it can be
+ * polled with pit_oneshot_expired() to calibrate other clocks. The PC
+ * speaker stays disconnected.
+ */
+void pit_oneshot_start(uint16_t ticks);
+
+// True once the countdown started by pit_oneshot_start() has reached zero
+bool pit_oneshot_expired(void);
+
+// Busy-wait for at least @us microseconds (up to PIT_MAX_TICKS ticks)
+void pit_delay_us(uint32_t us);
+
+#endif // PIT_H
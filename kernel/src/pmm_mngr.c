@@ -3,6 +3,8 @@
 #include "limine.h"
 #include "string.h"
 #include "text_renderer.h"
+#include "trace.h"
+#include "spinlock.h"
 
 struct limine_memmap_entry **memmap_entries;
 uint64_t memmap_entry_count;
@@ -10,6 +12,13 @@ uint8_t *pmm_bitmap;
 uint64_t bitmap_size;
 uint64_t pmm_total_frames = 0;
 uint64_t pmm_used_frames = 0;
+static uint64_t pmm_total_memory;
+static uint64_t pmm_bitmap_phys;
+
+// Guards pmm_bitmap and pmm_used_frames. An MCS lock because every CPU
+// allocates and pmm_alloc() holds it for a scan of the bitmap.
+static LOCK_CLASS(pmm_lock_class, "pmm");
+static struct mcs_lock pmm_lock = MCS_LOCK_INIT(pmm_lock_class);
 
 // Physical memory bitmap (1 bit per 4KB frame)
 
@@ -27,20 +36,57 @@ uint64_t get_total_frame_count() {
 
 
 uint64_t pmm_alloc() {
+    struct mcs_node node;
+    uint64_t flags = mcs_lock_irqsave(&pmm_lock, &node);
     for (uint64_t i = 0; i < pmm_total_frames; i++) {
         if (!(pmm_bitmap[i / 8] & (1 << (i % 8)))) { // Frame is free
             pmm_bitmap[i / 8] |= (1 << (i % 8));     // Mark as used
             pmm_used_frames++;
+            mcs_unlock_irqrestore(&pmm_lock, &node, flags);
+            trace(TRACE_PMM_ALLOC, i * PAGE_SIZE, 0);
             return i * PAGE_SIZE; // Return physical address
         }
     }
+    mcs_unlock_irqrestore(&pmm_lock, &node, flags);
     return 0; // Out of memory
 }
 
+uint64_t pmm_alloc_contig(uint64_t count) {
+    if (!count)
+        return 0;
+
+    struct mcs_node node;
+    uint64_t flags = mcs_lock_irqsave(&pmm_lock, &node);
+    uint64_t run = 0;
+    for (uint64_t i = 0; i < pmm_total_frames; i++) {
+        if (pmm_bitmap[i / 8] & (1 << (i % 8))) {
+            run = 0;
+            continue;
+        }
+        if (++run < count)
+            continue;
+
+        uint64_t first = i + 1 - count;
+        for (uint64_t j = first; j <= i; j++)
+            pmm_bitmap[j / 8] |= (1 << (j % 8));
+        pmm_used_frames += count;
+        mcs_unlock_irqrestore(&pmm_lock, &node, flags);
+        trace(TRACE_PMM_ALLOC, first * PAGE_SIZE, 0);
+        return first * PAGE_SIZE;
+    }
+    mcs_unlock_irqrestore(&pmm_lock, &node, flags);
+    return 0;
+}
+
 void pmm_free(uint64_t phys_addr) {
     uint64_t frame = phys_addr / PAGE_SIZE;
+    trace(TRACE_PMM_FREE, phys_addr, 0);
+
+    struct mcs_node node;
+    uint64_t flags = mcs_lock_irqsave(&pmm_lock, &node);
     pmm_bitmap[frame / 8] &= ~(1 << (frame % 8)); // Mark as free
     pmm_used_frames--;
+    mcs_unlock_irqrestore(&pmm_lock, &node, flags);
 }
 
 // Initialize the PMM using Limine's memory map
@@ -112,21 +158,15 @@ void pmm_init(struct limine_memmap_request memmap_request, struct limine_hhdm_re
         pmm_bitmap[j / 8] |= (1 << (j % 8)); // Set bit (mark as used)
     }
 
-    // Print some useful information
-    kprintf("Total memory: %lu MB\n", total_memory / 1024 / 1024);
-    kprintf("Total frames: %lu\n", pmm_total_frames);
-    kprintf("Bitmap size: %lu KB\n", bitmap_size / 1024);
-    kprintf("Bitmap address: %p\n", pmm_bitmap);
-    kprintf("Bitmap start: %lx\n", largest_region_base);
-    kprintf("Bitmap end: %lx\n", largest_region_base + bitmap_size);
-    kprintf("Bitmap start frame: %lu\n", bitmap_start_frame);
-    kprintf("Bitmap end frame: %lu\n", bitmap_end_frame);
+    // Printed later by print_memmap(); this runs before the console is up
+    pmm_total_memory = total_memory;
+    pmm_bitmap_phys = largest_region_base;
     
 
     pmm_used_frames += (bitmap_end_frame - bitmap_start_frame);
 }
 
-void print_and_init_memmap(struct limine_memmap_request memmap_request, struct limine_hhdm_request hhdm_request) {
+void print_memmap(struct limine_memmap_request memmap_request) {
     struct limine_memmap_response *memmap = memmap_request.response;
     kprintf("Memory Map:\n");
     for (uint64_t i = 0; i < memmap->entry_count; i++) {
@@ -135,8 +175,16 @@ void print_and_init_memmap(struct limine_memmap_request memmap_request, struct l
                entry->base, entry->length, entry->type);
     }
 
-    // Initialize PMM after printing
-    pmm_init(memmap_request, hhdm_request);
+    uint64_t bitmap_start_frame = pmm_bitmap_phys / PAGE_SIZE;
+    uint64_t bitmap_end_frame = (pmm_bitmap_phys + bitmap_size + PAGE_SIZE - 1) / PAGE_SIZE;
+    kprintf("Total memory: %lu MB\n", pmm_total_memory / 1024 / 1024);
+    kprintf("Total frames: %lu\n", pmm_total_frames);
+    kprintf("Bitmap size: %lu KB\n", bitmap_size / 1024);
+    kprintf("Bitmap address: %p\n", pmm_bitmap);
+    kprintf("Bitmap start: %lx\n", pmm_bitmap_phys);
+    kprintf("Bitmap end: %lx\n", pmm_bitmap_phys + bitmap_size);
+    kprintf("Bitmap start frame: %lu\n", bitmap_start_frame);
+    kprintf("Bitmap end frame: %lu\n", bitmap_end_frame);
     kprintf("PMM initialized!\n");
     kprintf("Total frames: %lu, Used frames: %lu\n", pmm_total_frames, pmm_used_frames);
 }
\ No newline at end of file
@@ -23,7 +23,10 @@ typedef uint64_t phys_addr_t;
 void pmm_init(struct limine_memmap_request memmap_request, struct limine_hhdm_request hhdm_request);
 void pmm_free(uint64_t phys_addr);
 uint64_t pmm_alloc();
-void print_and_init_memmap(struct limine_memmap_request memmap_request, struct limine_hhdm_request hhdm_request);
+// @count physically contiguous frames, or 0 if no free run is that long
+uint64_t pmm_alloc_contig(uint64_t count);
+// Print the memory map and what pmm_init() made of it
+void print_memmap(struct limine_memmap_request memmap_request);
 
 uint64_t get_free_frame_count();
 uint64_t get_used_frame_count();
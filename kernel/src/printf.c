@@ -0,0 +1,307 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include "printf.h"
+
+// Flag bits
+#define FMT_LEFT    (1 << 0)   // '-'
+#define FMT_PLUS    (1 << 1)   // '+'
+#define FMT_SPACE   (1 << 2)   // ' '
+#define FMT_ALT     (1 << 3)   // '#'
+#define FMT_ZERO    (1 << 4)   // '0'
+#define FMT_UPPER   (1 << 5)   // %X
+#define FMT_SIGNED  (1 << 6)   // %d / %i
+#define FMT_PTR     (1 << 7)   // %p: "0x" prefix even for zero
+
+// Two ASCII digits for every value 0-99, so decimal conversion needs one
+// division (a multiply-shift for a constant divisor) per two digits.
+static const char digit_pairs[200] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char hex_lower[16] = "0123456789abcdef";
+static const char hex_upper[16] = "0123456789ABCDEF";
+
+// Bounded output cursor; pos keeps counting past the end for the return value
+struct out {
+    char *buf;
+    size_t size;
+    size_t pos;
+};
+
+static inline void out_char(struct out *o, char c) {
+    if (o->pos + 1 < o->size)
+        o->buf[o->pos] = c;
+    o->pos++;
+}
+
+static void out_chars(struct out *o, const char *s, size_t n) {
+    size_t room = o->pos + 1 < o->size ? o->size - 1 - o->pos : 0;
+    size_t copy = n < room ? n : room;
+    for (size_t i = 0; i < copy; i++)
+        o->buf[o->pos + i] = s[i];
+    o->pos += n;
+}
+
+static void out_pad(struct out *o, char c, int n) {
+    while (n-- > 0)
+        out_char(o, c);
+}
+
+// Convert to decimal, writing backwards from end; returns the first digit
+static char *u64_to_dec(char *end, uint64_t v) {
+    while (v >= 100) {
+        uint64_t q = v / 100;
+        unsigned r = (unsigned)(v - q * 100) * 2;
+        end -= 2;
+        end[0] = digit_pairs[r];
+        end[1] = digit_pairs[r + 1];
+        v = q;
+    }
+    if (v >= 10) {
+        end -= 2;
+        end[0] = digit_pairs[v * 2];
+        end[1] = digit_pairs[v * 2 + 1];
+    } else {
+        *--end = (char)('0' + v);
+    }
+    return end;
+}
+
+static char *u64_to_hex(char *end, uint64_t v, bool upper) {
+    const char *digits = upper ? hex_upper : hex_lower;
+    do {
+        *--end = digits[v & 0xF];
+        v >>= 4;
+    } while (v);
+    return end;
+}
+
+static char *u64_to_oct(char *end, uint64_t v) {
+    do {
+        *--end = (char)('0' + (v & 7));
+        v >>= 3;
+    } while (v);
+    return end;
+}
+
+static void format_number(struct out *o, uint64_t value, bool negative, int base,
+                          int flags, int width, int precision) {
+    char tmp[24];
+    char *end = tmp + sizeof(tmp);
+    char *digits;
+
+    if (precision == 0 && value == 0) {
+        digits = end;   // "%.0d" of zero prints no digits
+    } else if (base == 10) {
+        digits = u64_to_dec(end, value);
+    } else if (base == 16) {
+        digits = u64_to_hex(end, value, flags & FMT_UPPER);
+    } else {
+        digits = u64_to_oct(end, value);
+    }
+    int ndigits = (int)(end - digits);
+
+    // Sign or base prefix
+    char prefix[2];
+    int nprefix = 0;
+    if (flags & FMT_SIGNED) {
+        if (negative)
+            prefix[nprefix++] = '-';
+        else if (flags & FMT_PLUS)
+            prefix[nprefix++] = '+';
+        else if (flags & FMT_SPACE)
+            prefix[nprefix++] = ' ';
+    } else if ((flags & FMT_ALT) && (value != 0 || (flags & FMT_PTR))) {
+        if (base == 16) {
+            prefix[nprefix++] = '0';
+            prefix[nprefix++] = (flags & FMT_UPPER) ? 'X' : 'x';
+        } else if (base == 8 && precision <= ndigits) {
+            prefix[nprefix++] = '0';
+        }
+    }
+
+    // Precision gives the minimum number of digits; '0' is ignored with it
+    int zeros = precision > ndigits ? precision - ndigits : 0;
+    if (precision < 0 && (flags & FMT_ZERO) && !(flags & FMT_LEFT))
+        zeros = width - nprefix - ndigits;
+    if (zeros < 0)
+        zeros = 0;
+
+    int padding = width - nprefix - zeros - ndigits;
+
+    if (!(flags & FMT_LEFT))
+        out_pad(o, ' ', padding);
+    out_chars(o, prefix, nprefix);
+    out_pad(o, '0', zeros);
+    out_chars(o, digits, ndigits);
+    if (flags & FMT_LEFT)
+        out_pad(o, ' ', padding);
+}
+
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list args) {
+    struct out o = { buf, size, 0 };
+
+    while (*fmt) {
+        // Copy literal runs in one go
+        const char *lit = fmt;
+        while (*fmt && *fmt != '%')
+            fmt++;
+        if (fmt != lit)
+            out_chars(&o, lit, fmt - lit);
+        if (!*fmt)
+            break;
+        fmt++;  // Skip '%'
+
+        int flags = 0;
+        for (;; fmt++) {
+            if (*fmt == '-') flags |= FMT_LEFT;
+            else if (*fmt == '+') flags |= FMT_PLUS;
+            else if (*fmt == ' ') flags |= FMT_SPACE;
+            else if (*fmt == '#') flags |= FMT_ALT;
+            else if (*fmt == '0') flags |= FMT_ZERO;
+            else break;
+        }
+
+        int width = 0;
+        if (*fmt == '*') {
+            width = va_arg(args, int);
+            if (width < 0) {
+                flags |= FMT_LEFT;
+                width = -width;
+            }
+            fmt++;
+        } else {
+            while (*fmt >= '0' && *fmt <= '9')
+                width = width * 10 + (*fmt++ - '0');
+        }
+
+        int precision = -1;
+        if (*fmt == '.') {
+            fmt++;
+            precision = 0;
+            if (*fmt == '*') {
+                precision = va_arg(args, int);
+                if (precision < 0)
+                    precision = -1;
+                fmt++;
+            } else {
+                while (*fmt >= '0' && *fmt <= '9')
+                    precision = precision * 10 + (*fmt++ - '0');
+            }
+        }
+
+        // Length modifier: number of bytes of the argument
+        int length = sizeof(int);
+        if (*fmt == 'h') {
+            fmt++;
+            length = sizeof(short);
+            if (*fmt == 'h') {
+                fmt++;
+                length = sizeof(char);
+            }
+        } else if (*fmt == 'l') {
+            fmt++;
+            length = sizeof(long);
+            if (*fmt == 'l') {
+                fmt++;
+                length = sizeof(long long);
+            }
+        } else if (*fmt == 'z' || *fmt == 't' || *fmt == 'j') {
+            fmt++;
+            length = sizeof(uint64_t);
+        }
+
+        char conv = *fmt;
+        if (!conv)
+            break;
+        fmt++;
+
+        switch (conv) {
+            case 'd':
+            case 'i': {
+                int64_t v;
+                if (length == 8) v = va_arg(args, int64_t);
+                else v = va_arg(args, int);
+                if (length == 2) v = (short)v;
+                else if (length == 1) v = (signed char)v;
+                bool negative = v < 0;
+                uint64_t mag = negative ? (uint64_t)0 - (uint64_t)v : (uint64_t)v;
+                format_number(&o, mag, negative, 10, flags | FMT_SIGNED, width, precision);
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o': {
+                uint64_t v;
+                if (length == 8) v = va_arg(args, uint64_t);
+                else v = va_arg(args, unsigned int);
+                if (length == 2) v = (unsigned short)v;
+                else if (length == 1) v = (unsigned char)v;
+                int base = conv == 'u' ? 10 : conv == 'o' ? 8 : 16;
+                if (conv == 'X')
+                    flags |= FMT_UPPER;
+                format_number(&o, v, false, base, flags, width, precision);
+                break;
+            }
+            case 'p': {
+                uint64_t v = (uint64_t)(uintptr_t)va_arg(args, void *);
+                format_number(&o, v, false, 16, flags | FMT_ALT | FMT_PTR, width, precision);
+                break;
+            }
+            case 'c': {
+                char c = (char)va_arg(args, int);
+                if (!(flags & FMT_LEFT))
+                    out_pad(&o, ' ', width - 1);
+                out_char(&o, c);
+                if (flags & FMT_LEFT)
+                    out_pad(&o, ' ', width - 1);
+                break;
+            }
+            case 's': {
+                const char *s = va_arg(args, const char *);
+                if (!s)
+                    s = "(null)";
+                size_t n = 0;
+                while (s[n] && (precision < 0 || n < (size_t)precision))
+                    n++;
+                if (!(flags & FMT_LEFT))
+                    out_pad(&o, ' ', width - (int)n);
+                out_chars(&o, s, n);
+                if (flags & FMT_LEFT)
+                    out_pad(&o, ' ', width - (int)n);
+                break;
+            }
+            case '%':
+                out_char(&o, '%');
+                break;
+            default:
+                // Unknown conversion: print it verbatim
+                out_char(&o, '%');
+                out_char(&o, conv);
+                break;
+        }
+    }
+
+    if (size)
+        buf[o.pos < size ? o.pos : size - 1] = '\0';
+    return (int)o.pos;
+}
+
+int snprintf(char *buf, size_t size, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, size, fmt, args);
+    va_end(args);
+    return len;
+}
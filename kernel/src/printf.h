@@ -0,0 +1,26 @@
+#ifndef PRINTF_H
+#define PRINTF_H
+
+#include <stddef.h>
+#include <stdarg.h>
+
+/**
+ * vsnprintf - Format into a bounded buffer.
+ *
+ * @buf:  Destination buffer (may be NULL when @size is 0).
+ * @size: Size of @buf in bytes, including the terminating NUL.
+ * @fmt:  Format string.
+ * @args: Arguments for the format string.
+ *
+ * Supports the flags "-+ #0", field width and precision (numeric or '*'),
+ * the length modifiers hh, h, l, ll, z, t and j, and the conversions
+ * d i u x X o c s p %. Returns the length the full output would have had,
+ * as C99 does; the output is truncated to fit and always NUL terminated
+ * when @size is non-zero.
+ */
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list args);
+
+// snprintf - vsnprintf() with a variable argument list
+int snprintf(char *buf, size_t size, const char *fmt, ...);
+
+#endif // PRINTF_H
@@ -0,0 +1,274 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "profile.h"
+#include "cpu.h"
+#include "isr.h"
+#include "ksyms.h"
+#include "klog.h"
+#include "percpu.h"
+#include "printf.h"
+#include "sched.h"
+#include "serial.h"
+#include "string.h"
+#include "clocksource.h"
+#include "text_renderer.h"
+#include "timer.h"
+#include "workqueue.h"
+
+#define PROFILE_PERIOD_NS (1000000000ULL / PROFILE_HZ)
+
+struct profile_stack {
+    uint64_t hash;
+    uint32_t depth;
+    uint32_t count;             // 0 while the slot is free
+    uint64_t pcs[PROFILE_DEPTH];
+};
+
+struct profile_cpu {
+    struct timer timer;
+    struct work start;          // Arms the timer of a CPU already online
+    struct work stop;           // Cancels it again
+    uint64_t samples;
+    uint64_t dropped;
+    uint64_t missed;
+    uint32_t stacks;
+    struct profile_stack table[PROFILE_STACKS];
+} __attribute__((aligned(64)));
+
+_Static_assert((PROFILE_STACKS & (PROFILE_STACKS - 1)) == 0, "PROFILE_STACKS power of two");
+
+static struct profile_cpu profile_cpus[MAX_CPUS];
+static volatile bool profile_running;
+static volatile uint32_t profile_stopping;  // Stop items not run yet
+
+uint32_t backtrace_walk(uint64_t rip, uint64_t rbp, uint64_t lo, uint64_t hi,
+                        uint64_t *pcs, uint32_t max) {
+    if (!max)
+        return 0;
+    uint32_t depth = 0;
+    pcs[depth++] = rip;
+
+    // Each frame is [saved rbp][return address], pushed by the callee
+    uint64_t fp = rbp;
+    while (depth < max) {
+        if (fp < lo || fp >= hi || hi - fp < 16 || (fp & 7))
+            break;
+        const uint64_t *frame = (const uint64_t *)fp;
+        if (!frame[1])
+            break;
+        pcs[depth++] = frame[1];
+        if (frame[0] <= fp)
+            break;
+        fp = frame[0];
+    }
+    return depth;
+}
+
+static uint64_t stack_hash(const uint64_t *pcs, uint32_t depth) {
+    uint64_t hash = depth;
+    for (uint32_t i = 0; i < depth; i++) {
+        hash ^= pcs[i];
+        hash *= 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+void profile_record(const uint64_t *pcs, uint32_t depth) {
+    if (depth > PROFILE_DEPTH)
+        depth = PROFILE_DEPTH;
+    uint64_t hash = stack_hash(pcs, depth);
+
+    uint64_t flags = irq_save();
+    struct profile_cpu *pc = &profile_cpus[this_cpu_id()];
+    for (uint32_t probe = 0; probe < PROFILE_STACKS; probe++) {
+        struct profile_stack *stack = &pc->table[(hash + probe) & (PROFILE_STACKS - 1)];
+        if (!stack->count) {
+            stack->hash = hash;
+            stack->depth = depth;
+            memcpy(stack->pcs, pcs, depth * sizeof(pcs[0]));
+            stack->count = 1;
+            pc->stacks++;
+            pc->samples++;
+            irq_restore(flags);
+            return;
+        }
+        if (stack->hash == hash && stack->depth == depth &&
+            !memcmp(stack->pcs, pcs, depth * sizeof(pcs[0]))) {
+            stack->count++;
+            pc->samples++;
+            irq_restore(flags);
+            return;
+        }
+    }
+    pc->dropped++;
+    irq_restore(flags);
+}
+
+// Runs in softirq context; the interrupt that got us here saved the state
+// of the code it interrupted
+static void profile_tick(struct timer *timer) {
+    if (!profile_running)
+        return;
+
+    uint32_t cpu = this_cpu_id();
+    struct isr_frame *frame = isr_irq_frame[cpu];
+    if (frame) {
+        // The frame sits on the interrupted stack, below its end
+        struct thread *thread = current_thread();
+        uint64_t hi = thread && thread->stack_top ? thread->stack_top
+                                                   : percpu_areas[cpu].stack_top;
+        uint64_t pcs[PROFILE_DEPTH];
+        uint32_t depth = backtrace_walk(frame->rip, frame->rbp, (uint64_t)frame, hi,
+                                        pcs, PROFILE_DEPTH);
+        profile_record(pcs, depth);
+    } else {
+        // Run outside an interrupt: the timer_idle() catch-up or ksoftirqd
+        profile_cpus[cpu].missed++;
+    }
+
+    // Keep the rate steady, but do not try to make up for a long stall
+    uint64_t now = ktime_get_ns();
+    uint64_t next = timer->expires + PROFILE_PERIOD_NS;
+    if (next <= now)
+        next = now + PROFILE_PERIOD_NS;
+    timer_add(timer, next);
+}
+
+void profile_init_cpu(void) {
+    if (!profile_running)
+        return;
+
+    uint64_t flags = irq_save();
+    struct profile_cpu *pc = &profile_cpus[this_cpu_id()];
+    // Still pending from before a quick stop and start: it re-arms itself
+    if (!timer_pending(&pc->timer)) {
+        timer_setup(&pc->timer, profile_tick, NULL);
+        timer_add(&pc->timer, ktime_get_ns() + PROFILE_PERIOD_NS);
+    }
+    irq_restore(flags);
+}
+
+static void profile_start_work(struct work *work) {
+    (void)work;
+    profile_init_cpu();
+}
+
+void profile_start(void) {
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        struct profile_cpu *pc = &profile_cpus[cpu];
+        uint64_t flags = irq_save();
+        memset(pc->table, 0, sizeof(pc->table));
+        pc->samples = pc->dropped = pc->missed = 0;
+        pc->stacks = 0;
+        irq_restore(flags);
+    }
+    __atomic_store_n(&profile_running, true, __ATOMIC_SEQ_CST);
+
+    // Timers are per CPU, so each CPU arms its own
+    uint32_t self = this_cpu_id();
+    profile_init_cpu();
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (cpu == self || !percpu_areas[cpu].online)
+            continue;
+        work_setup(&profile_cpus[cpu].start, profile_start_work, NULL);
+        queue_work_on(cpu, &profile_cpus[cpu].start);
+    }
+}
+
+static void profile_cancel_timer(void) {
+    uint64_t flags = irq_save();
+    timer_cancel(&profile_cpus[this_cpu_id()].timer);
+    irq_restore(flags);
+}
+
+// A worker runs only between softirqs, so no tick of its CPU is still
+// recording once this has run
+static void profile_stop_work(struct work *work) {
+    (void)work;
+    profile_cancel_timer();
+    __atomic_fetch_sub(&profile_stopping, 1, __ATOMIC_RELEASE);
+}
+
+void profile_stop(void) {
+    // Ticks that see this do not re-arm
+    __atomic_store_n(&profile_running, false, __ATOMIC_SEQ_CST);
+
+    uint32_t self = this_cpu_id();
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (cpu == self || !percpu_areas[cpu].online)
+            continue;
+        __atomic_fetch_add(&profile_stopping, 1, __ATOMIC_RELAXED);
+        work_setup(&profile_cpus[cpu].stop, profile_stop_work, NULL);
+        queue_work_on(cpu, &profile_cpus[cpu].stop);
+    }
+    profile_cancel_timer();
+
+    // The tables of the other CPUs are ours to read from here on
+    while (__atomic_load_n(&profile_stopping, __ATOMIC_ACQUIRE))
+        asm volatile ("pause");
+}
+
+void profile_get_stats(uint32_t cpu, struct profile_stats *stats) {
+    struct profile_cpu *pc = &profile_cpus[cpu];
+    stats->samples = pc->samples;
+    stats->dropped = pc->dropped;
+    stats->missed = pc->missed;
+    stats->stacks = pc->stacks;
+}
+
+// Append one frame to a folded line of at most @size bytes. Return
+// addresses are looked up one byte back, so a call at the very end of a
+// function still names the caller.
+static int fold_frame(char *line, int size, int len, uint64_t pc, bool ret) {
+    const char *name = ksym_lookup(ret ? pc - 1 : pc, NULL);
+    const char *sep = len ? ";" : "";
+    if (name)
+        len += snprintf(line + len, size - len, "%s%s", sep, name);
+    else
+        len += snprintf(line + len, size - len, "%s0x%lx", sep, pc);
+    return len < size ? len : size - 1;
+}
+
+void profile_dump(void) {
+    profile_stop();
+
+    // Keep pending log text from interleaving with the dump
+    klog_drain();
+
+    char line[1024];
+    int len = snprintf(line, sizeof(line), "PROFILE-BEGIN %u\n", PROFILE_HZ);
+    serial_write(line, len);
+
+    struct profile_stats total = { 0 };
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        struct profile_cpu *pc = &profile_cpus[cpu];
+        for (uint32_t i = 0; i < PROFILE_STACKS; i++) {
+            const struct profile_stack *stack = &pc->table[i];
+            if (!stack->count)
+                continue;
+
+            len = 0;
+            // Folded stacks go from the root to the leaf; leave room for the count
+            for (uint32_t f = stack->depth; f-- > 0;)
+                len = fold_frame(line, sizeof(line) - 32, len, stack->pcs[f], f != 0);
+            len += snprintf(line + len, sizeof(line) - len, " %u\n", stack->count);
+            serial_write(line, len);
+        }
+
+        struct profile_stats stats;
+        profile_get_stats(cpu, &stats);
+        total.samples += stats.samples;
+        total.dropped += stats.dropped;
+        total.missed += stats.missed;
+        total.stacks += stats.stacks;
+    }
+
+    len = snprintf(line, sizeof(line), "PROFILE-END %lu %lu %lu\n",
+                   total.samples, total.dropped, total.missed);
+    serial_write(line, len);
+
+    kprintf("Profile: %lu samples at %u Hz in %u stacks, %lu dropped, %lu missed\n",
+            total.samples, PROFILE_HZ, total.stacks, total.dropped, total.missed);
+}
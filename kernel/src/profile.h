@@ -0,0 +1,105 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Sampling profiler. While running, every CPU takes PROFILE_HZ samples a
+ * second from a wheel timer: the interrupted RIP and a frame-pointer
+ * backtrace (the kernel is built with -fno-omit-frame-pointer). Samples go
+ * into a per-CPU table of unique stacks with a hit count each, so a long
+ * run costs no more memory than a short one. profile_dump() symbolizes the
+ * stacks with the embedded symbol table (ksyms.h) and writes them over
+ * serial in the folded format flamegraph tools take.
+ *
+ * The timer softirq only runs where interrupts are enabled, so code that
+ * runs with them off is charged to the point where it turns them back on.
+ */
+
+// Samples per second per CPU; off the round rates of other periodic work
+#define PROFILE_HZ 997
+
+// Frames kept per sample, the interrupted RIP included
+#define PROFILE_DEPTH 16
+
+// Unique stacks per CPU (power of two); samples of further stacks are dropped
+#define PROFILE_STACKS 256
+
+/**
+ * backtrace_walk - Follow a chain of saved frame pointers.
+ *
+ * @rip: Innermost address, stored first.
+ * @rbp: Frame pointer at @rip.
+ * @lo:  Lowest address a frame may be at.
+ * @hi:  End of the stack; frames must lie below it.
+ * @pcs: Receives @rip, then one return address per frame, innermost first.
+ * @max: Size of @pcs.
+ *
+ * Returns the number of addresses stored. Stops at the first frame pointer
+ * that is misaligned, outside [@lo, @hi) or not above the one before, and
+ * at a zero return address, so a corrupt chain cannot fault or loop. A
+ * function interrupted before it set up its frame shows up without its
+ * caller.
+ */
+uint32_t backtrace_walk(uint64_t rip, uint64_t rbp, uint64_t lo, uint64_t hi,
+                        uint64_t *pcs, uint32_t max);
+
+/**
+ * profile_start - Clear the tables and start sampling on every CPU.
+ *
+ * Thread context. CPUs that come online later start in profile_init_cpu().
+ */
+void profile_start(void);
+
+/**
+ * profile_stop - Stop sampling on every CPU.
+ *
+ * Thread context. Returns once each online CPU has cancelled its timer and
+ * no tick is still writing to its table; the tables are kept for
+ * profile_dump().
+ */
+void profile_stop(void);
+
+// Start this CPU's sampling timer if the profiler is running; called by
+// smp_ap_main() once the CPU is online, so profile_start() cannot miss it
+void profile_init_cpu(void);
+
+/**
+ * profile_record - Count one sample on this CPU.
+ *
+ * @pcs:   Stack as from backtrace_walk(), innermost first.
+ * @depth: Entries in @pcs; at most PROFILE_DEPTH are kept.
+ *
+ * The timer sampler uses this; another sample source (an NMI or a
+ * performance counter overflow) can feed the same tables. Safe from any
+ * context but NMI.
+ */
+void profile_record(const uint64_t *pcs, uint32_t depth);
+
+struct profile_stats {
+    uint64_t samples;           // Recorded in the table
+    uint64_t dropped;           // Lost because the table was full
+    uint64_t missed;            // Ticks with no interrupted context to sample
+    uint32_t stacks;            // Unique stacks in the table
+};
+
+void profile_get_stats(uint32_t cpu, struct profile_stats *stats);
+
+/**
+ * profile_dump - Stop sampling and write the stacks to the serial port.
+ *
+ * Output is line based so it survives a text capture of COM1:
+ *
+ *   PROFILE-BEGIN <hz>
+ *   <root>;<caller>;...;<leaf> <samples>
+ *   ...
+ *   PROFILE-END <samples> <dropped> <missed>
+ *
+ * Frames are function names, or hex addresses outside the kernel's text.
+ * The lines between the markers are input for flamegraph.pl (see
+ * `make profile`). A summary goes to the console.
+ */
+void profile_dump(void);
+
+#endif // PROFILE_H
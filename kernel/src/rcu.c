@@ -0,0 +1,156 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "rcu.h"
+#include "cpu.h"
+#include "sched.h"
+#include "timer.h"
+#include "clocksource.h"
+
+struct rcu_cpu rcu_cpus[MAX_CPUS];
+
+/*
+ * Grace periods are numbered. gp_started == gp_completed means none is in
+ * progress; otherwise gp_started is the one in progress. gp_requested is
+ * the highest number some callback waits for. Whoever changes one of them
+ * re-checks the others afterwards (rcu_start_gp_if_needed()), so a request
+ * racing with a completion is never left without a grace period.
+ */
+static uint64_t gp_started;
+static uint64_t gp_completed;
+static uint64_t gp_requested;
+
+static void rcu_start_gp_if_needed(void) {
+    uint64_t started = __atomic_load_n(&gp_started, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&gp_completed, __ATOMIC_SEQ_CST) == started &&
+        __atomic_load_n(&gp_requested, __ATOMIC_SEQ_CST) > started)
+        __atomic_compare_exchange_n(&gp_started, &started, started + 1, false,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+// Ask for a grace period that starts after now; returns its number
+static uint64_t rcu_request_gp(void) {
+    uint64_t target = __atomic_load_n(&gp_started, __ATOMIC_SEQ_CST) + 1;
+    uint64_t requested = __atomic_load_n(&gp_requested, __ATOMIC_RELAXED);
+    while (requested < target &&
+           !__atomic_compare_exchange_n(&gp_requested, &requested, target, true,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        ;
+    rcu_start_gp_if_needed();
+    return target;
+}
+
+static bool rcu_cpu_quiescent(struct rcu_cpu *rc, uint64_t gp) {
+    return __atomic_load_n(&rc->qs_gp, __ATOMIC_SEQ_CST) >= gp ||
+           !(__atomic_load_n(&rc->dynticks, __ATOMIC_SEQ_CST) & 1);
+}
+
+// End the grace period in progress if every online CPU has been quiescent
+static void rcu_try_complete(void) {
+    uint64_t completed = __atomic_load_n(&gp_completed, __ATOMIC_SEQ_CST);
+    uint64_t started = __atomic_load_n(&gp_started, __ATOMIC_SEQ_CST);
+    if (started == completed)
+        return;
+
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        struct rcu_cpu *rc = &rcu_cpus[cpu];
+        if (__atomic_load_n(&rc->online, __ATOMIC_ACQUIRE) && !rcu_cpu_quiescent(rc, started))
+            return;
+    }
+
+    if (__atomic_compare_exchange_n(&gp_completed, &completed, started, false,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        rcu_start_gp_if_needed();
+}
+
+static void rcu_poll_timer(struct timer *timer) {
+    // Waking the CPU is all it takes; the idle loop calls rcu_poll()
+    (void)timer;
+}
+
+void rcu_init_cpu(void) {
+    struct rcu_cpu *rc = &rcu_cpus[this_cpu_id()];
+    rc->dynticks = 1;
+    rc->qs_gp = __atomic_load_n(&gp_started, __ATOMIC_SEQ_CST);
+    rc->cb_head = NULL;
+    rc->cb_tail = &rc->cb_head;
+    timer_setup(&rc->poll, rcu_poll_timer, NULL);
+    __atomic_store_n(&rc->online, true, __ATOMIC_RELEASE);
+}
+
+void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *head)) {
+    head->func = func;
+    head->next = NULL;
+
+    uint64_t flags = irq_save();
+    struct rcu_cpu *rc = &rcu_cpus[this_cpu_id()];
+    head->gp = rcu_request_gp();
+    *rc->cb_tail = head;
+    rc->cb_tail = &head->next;
+    irq_restore(flags);
+}
+
+void rcu_note_context_switch(void) {
+    struct rcu_cpu *rc = &rcu_cpus[this_cpu_id()];
+    __atomic_store_n(&rc->qs_gp, __atomic_load_n(&gp_started, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+}
+
+void rcu_poll(void) {
+    rcu_note_context_switch();
+    rcu_try_complete();
+
+    // Detach the callbacks that are ready; they were queued in order
+    uint64_t flags = irq_save();
+    struct rcu_cpu *rc = &rcu_cpus[this_cpu_id()];
+    uint64_t completed = __atomic_load_n(&gp_completed, __ATOMIC_SEQ_CST);
+    struct rcu_head *ready = NULL;
+    struct rcu_head **end = &rc->cb_head;
+    while (*end && (*end)->gp <= completed)
+        end = &(*end)->next;
+    if (end != &rc->cb_head) {
+        ready = rc->cb_head;
+        rc->cb_head = *end;
+        *end = NULL;
+        if (!rc->cb_head)
+            rc->cb_tail = &rc->cb_head;
+    }
+    irq_restore(flags);
+
+    while (ready) {
+        struct rcu_head *next = ready->next;
+        ready->func(ready);
+        rc->cb_invoked++;
+        ready = next;
+    }
+}
+
+void rcu_idle_enter(void) {
+    struct rcu_cpu *rc = &rcu_cpus[this_cpu_id()];
+
+    // With every CPU idle nobody would finish the grace period our
+    // callbacks wait for, so come back and check
+    if (rc->cb_head && !timer_pending(&rc->poll))
+        timer_add(&rc->poll, ktime_get_ns() + RCU_POLL_NS);
+    __atomic_fetch_add(&rc->dynticks, 1, __ATOMIC_SEQ_CST);
+}
+
+void rcu_idle_exit(void) {
+    __atomic_fetch_add(&rcu_cpus[this_cpu_id()].dynticks, 1, __ATOMIC_SEQ_CST);
+}
+
+void synchronize_rcu(void) {
+    uint64_t target;
+    uint64_t flags = irq_save();
+    target = rcu_request_gp();
+    irq_restore(flags);
+
+    while (__atomic_load_n(&gp_completed, __ATOMIC_ACQUIRE) < target) {
+        rcu_poll();
+        sched_yield();
+        asm volatile ("pause");
+    }
+}
+
+uint64_t rcu_completed(void) {
+    return __atomic_load_n(&gp_completed, __ATOMIC_ACQUIRE);
+}
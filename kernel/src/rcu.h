@@ -0,0 +1,123 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu.h"
+#include "timer.h"
+
+/*
+ * Quiescent-state-based RCU. Readers take no locks and write nothing: a
+ * read-side critical section only promises not to block, yield or switch
+ * threads. A CPU that context-switches, yields or idles has therefore left
+ * every section it was in, and once each online CPU has done so after an
+ * update was published, no reader can still hold the old version. That is
+ * a grace period; call_rcu() callbacks and synchronize_rcu() wait for one.
+ *
+ * An idle CPU counts as quiescent without reporting anything: its
+ * dynticks counter is even while it halts. Interrupt handlers that run on
+ * an idle CPU make it odd again for their duration, so they may read too.
+ */
+
+// How often an idle CPU with callbacks waiting wakes up to push the
+// grace period forward
+#define RCU_POLL_NS 1000000ULL
+
+struct rcu_head {
+    struct rcu_head *next;
+    uint64_t gp;                        // Grace period that must complete first
+    void (*func)(struct rcu_head *head);
+};
+
+struct rcu_cpu {
+    uint64_t dynticks;                  // Odd while the CPU may be reading
+    uint64_t qs_gp;                     // Last grace period it reported for
+    bool online;
+    bool irq_from_idle;                 // Current interrupt woke it from idle
+    struct rcu_head *cb_head;           // Pending callbacks, oldest first
+    struct rcu_head **cb_tail;
+    uint64_t cb_invoked;
+    struct timer poll;
+} __attribute__((aligned(64)));
+
+extern struct rcu_cpu rcu_cpus[MAX_CPUS];
+
+// Read-side critical sections; they compile to a compiler barrier
+static inline void rcu_read_lock(void) {
+    asm volatile ("" : : : "memory");
+}
+
+static inline void rcu_read_unlock(void) {
+    asm volatile ("" : : : "memory");
+}
+
+// Load an RCU-protected pointer inside a read-side critical section
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_CONSUME)
+
+// Publish a new version; everything written to it before is visible first
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+/**
+ * rcu_init_cpu - Start tracking the executing CPU.
+ *
+ * Grace periods wait for this CPU from here on. Needs timer_init().
+ */
+void rcu_init_cpu(void);
+
+/**
+ * call_rcu - Run a callback after a grace period.
+ *
+ * @head: Embedded in the object being retired; owned by RCU until @func runs.
+ * @func: Called on this CPU, outside any interrupt handler, once every
+ *        reader that could have seen the object has finished.
+ *
+ * Never blocks, so it is safe with interrupts disabled.
+ */
+void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *head));
+
+/**
+ * synchronize_rcu - Wait for a full grace period.
+ *
+ * Yields the CPU while waiting. Must not be called inside a read-side
+ * critical section or from an interrupt handler.
+ */
+void synchronize_rcu(void);
+
+// Report a quiescent state at a context switch. Cheap: one load, one store.
+void rcu_note_context_switch(void);
+
+/**
+ * rcu_poll - Report a quiescent state and make progress.
+ *
+ * Completes the current grace period if every CPU has passed through a
+ * quiescent state, starts the next one when callbacks wait for it, and
+ * runs this CPU's callbacks whose grace period is over. Called by the
+ * scheduler at yields and in the idle loop.
+ */
+void rcu_poll(void);
+
+// Bracket the halt in the idle loop: the CPU is quiescent in between
+void rcu_idle_enter(void);
+void rcu_idle_exit(void);
+
+// Number of grace periods completed so far
+uint64_t rcu_completed(void);
+
+// Called by irq_enter()/irq_exit() for the outermost interrupt level
+static inline void rcu_irq_enter(void) {
+    struct rcu_cpu *rc = &rcu_cpus[this_cpu_id()];
+    if (!(rc->dynticks & 1)) {
+        __atomic_fetch_add(&rc->dynticks, 1, __ATOMIC_SEQ_CST);
+        rc->irq_from_idle = true;
+    }
+}
+
+static inline void rcu_irq_exit(void) {
+    struct rcu_cpu *rc = &rcu_cpus[this_cpu_id()];
+    if (rc->irq_from_idle) {
+        rc->irq_from_idle = false;
+        __atomic_fetch_add(&rc->dynticks, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+#endif // RCU_H
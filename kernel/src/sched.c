@@ -0,0 +1,536 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sched.h"
+#include "cpu.h"
+#include "isr.h"
+#include "apic.h"
+#include "percpu.h"
+#include "smp.h"
+#include "timer.h"
+#include "clocksource.h"
+#include "klog.h"
+#include "rcu.h"
+#include "tlb.h"
+#include "kstack.h"
+#include "fpu.h"
+#include "softirq.h"
+#include "workqueue.h"
+#include "text_renderer.h"
+
+// An idle CPU only steals from another idle CPU if it has this many queued;
+// that CPU is about to run its first thread itself
+#define STEAL_MIN_FROM_IDLE 2
+
+// Every thread is on at most one queue, so pushes cannot overflow
+_Static_assert(SCHED_DEQUE_SIZE >= SCHED_MAX_THREADS, "run queue too small");
+_Static_assert((SCHED_DEQUE_SIZE & (SCHED_DEQUE_SIZE - 1)) == 0, "deque size not a power of two");
+
+/*
+ * Chase-Lev work-stealing deque. The owning CPU pushes and takes at the
+ * bottom with interrupts disabled; other CPUs steal from the top with a
+ * CAS. Memory orders follow Le et al., "Correct and Efficient Work-Stealing
+ * for Weak Memory Models" (PPoPP 2013). top and bottom only ever grow, so
+ * the slot index is the counter modulo the (fixed) size.
+ */
+struct sched_deque {
+    int64_t top;
+    uint8_t pad[56];                // Keep thieves' CAS off the owner's line
+    int64_t bottom;
+    struct thread *slots[SCHED_DEQUE_SIZE];
+};
+
+struct sched_cpu {
+    struct sched_deque rq;
+    struct thread *current;
+    struct thread *prev;            // Switched away from, for sched_finish_switch()
+    struct thread *wake_list;       // Pushed by sched_wake() from any CPU
+    struct thread idle;             // The code that called sched_init_cpu()
+    struct timer slice;
+    volatile bool need_resched;
+    volatile bool kicked;           // An IPI is on its way, don't send another
+    bool ready;
+    uint64_t switches;
+    uint64_t steals;
+    uint64_t steal_failures;
+} __attribute__((aligned(64)));
+
+static struct sched_cpu sched_cpus[MAX_CPUS];
+static struct thread threads[SCHED_MAX_THREADS];
+static uint32_t next_thread_id = 1;
+
+// sched_switch.S
+void sched_switch(struct thread *prev, struct thread *next);
+void sched_thread_entry(void);
+void sched_thread_start(void);
+
+static void sched_finish_switch(void);
+
+static inline struct sched_cpu *this_rq(void) {
+    return &sched_cpus[this_cpu_id()];
+}
+
+static void deque_push(struct sched_deque *dq, struct thread *thread) {
+    int64_t b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED);
+    int64_t t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+    if (b - t >= SCHED_DEQUE_SIZE)
+        panic("Run queue overflow\n");
+    __atomic_store_n(&dq->slots[b & (SCHED_DEQUE_SIZE - 1)], thread, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+}
+
+// Owner side: newest entry, NULL when empty
+static struct thread *deque_take(struct sched_deque *dq) {
+    int64_t b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&dq->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&dq->top, __ATOMIC_RELAXED);
+
+    struct thread *thread = NULL;
+    if (t <= b) {
+        thread = __atomic_load_n(&dq->slots[b & (SCHED_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+        if (t == b) {
+            // Last entry: race the thieves for it
+            if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, false,
+                                             __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+                thread = NULL;
+            __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return thread;
+}
+
+// Any CPU: oldest entry, NULL when empty or when another CPU won the race
+static struct thread *deque_steal(struct sched_deque *dq) {
+    int64_t t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&dq->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b)
+        return NULL;
+
+    struct thread *thread = __atomic_load_n(&dq->slots[t & (SCHED_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return NULL;
+    return thread;
+}
+
+// Racy snapshot, only used to pick victims and for statistics
+static uint32_t deque_len(struct sched_deque *dq) {
+    int64_t t = __atomic_load_n(&dq->top, __ATOMIC_RELAXED);
+    int64_t b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED);
+    return b > t ? (uint32_t)(b - t) : 0;
+}
+
+static bool cpu_is_idle(struct sched_cpu *rq) {
+    return __atomic_load_n(&rq->current, __ATOMIC_SEQ_CST) == &rq->idle;
+}
+
+static void kick_cpu(uint32_t cpu) {
+    struct sched_cpu *rq = &sched_cpus[cpu];
+    if (!__atomic_exchange_n(&rq->kicked, true, __ATOMIC_SEQ_CST))
+        apic_send_ipi(percpu_areas[cpu].apic_id, SCHED_IPI_VECTOR);
+}
+
+// More work queued here than this CPU can start right away: wake one idle
+// peer so it comes to steal
+static void kick_idle_peer(struct sched_cpu *self) {
+    if (deque_len(&self->rq) < 2)
+        return;
+    for (uint32_t cpu = 0; cpu < smp_cpu_count; cpu++) {
+        struct sched_cpu *rq = &sched_cpus[cpu];
+        if (rq != self && rq->ready && cpu_is_idle(rq) && !rq->kicked) {
+            kick_cpu(cpu);
+            return;
+        }
+    }
+}
+
+// Hand @thread to @cpu's owner, which moves it to its run queue
+static void wake_list_push(uint32_t cpu, struct thread *thread) {
+    struct sched_cpu *rq = &sched_cpus[cpu];
+    struct thread *head = __atomic_load_n(&rq->wake_list, __ATOMIC_RELAXED);
+    do {
+        thread->wake_next = head;
+    } while (!__atomic_compare_exchange_n(&rq->wake_list, &head, thread, true,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+    if (cpu_is_idle(rq))
+        kick_cpu(cpu);
+}
+
+// Move the threads on @from's wake list to @rq's queue, oldest first.
+// Pinned threads taken from another CPU's list are handed back to it.
+static void move_wake_list(struct sched_cpu *rq, struct sched_cpu *from) {
+    struct thread *list = __atomic_exchange_n(&from->wake_list, NULL, __ATOMIC_SEQ_CST);
+    struct thread *reversed = NULL;
+    while (list) {
+        struct thread *next = list->wake_next;
+        list->wake_next = reversed;
+        reversed = list;
+        list = next;
+    }
+    while (reversed) {
+        struct thread *next = reversed->wake_next;
+        if (from != rq && reversed->pinned)
+            wake_list_push(reversed->cpu, reversed);
+        else
+            deque_push(&rq->rq, reversed);
+        reversed = next;
+    }
+}
+
+// Move threads handed over by sched_wake() to the local queue
+static void drain_wake_list(struct sched_cpu *rq) {
+    move_wake_list(rq, rq);
+}
+
+/*
+ * Take one thread from the CPU with the longest queue. Only an idle CPU
+ * steals, and it takes the oldest entry, which has the least cache state
+ * left on its CPU; a thread that was stolen then stays on its new CPU.
+ *
+ * Threads woken onto a busy CPU sit on its wake list, which only that CPU
+ * drains when it next schedules. When no queue is worth stealing from,
+ * such a list is taken over whole instead, so a long-running thread does
+ * not hold up wakeups for the rest of its slice.
+ */
+static struct thread *steal_work(struct sched_cpu *self) {
+    struct sched_cpu *victim = NULL;
+    uint32_t best = 0;
+    for (uint32_t cpu = 0; cpu < smp_cpu_count; cpu++) {
+        struct sched_cpu *rq = &sched_cpus[cpu];
+        if (rq == self || !rq->ready)
+            continue;
+        uint32_t len = deque_len(&rq->rq);
+        if (len > best && (len >= STEAL_MIN_FROM_IDLE || !cpu_is_idle(rq))) {
+            victim = rq;
+            best = len;
+        }
+    }
+    if (!victim) {
+        for (uint32_t cpu = 0; cpu < smp_cpu_count; cpu++) {
+            struct sched_cpu *rq = &sched_cpus[cpu];
+            if (rq == self || !rq->ready || cpu_is_idle(rq) ||
+                !__atomic_load_n(&rq->wake_list, __ATOMIC_RELAXED))
+                continue;
+            move_wake_list(self, rq);
+            struct thread *thread = deque_take(&self->rq);
+            if (thread) {
+                self->steals++;
+                return thread;
+            }
+        }
+        return NULL;
+    }
+
+    struct thread *thread = deque_steal(&victim->rq);
+    if (thread && thread->pinned) {
+        // Not ours to run; it goes back the way a wakeup would
+        wake_list_push(thread->cpu, thread);
+        thread = NULL;
+    }
+    if (thread)
+        self->steals++;
+    else
+        self->steal_failures++;
+    return thread;
+}
+
+static void slice_expired(struct timer *timer) {
+    ((struct sched_cpu *)timer->data)->need_resched = true;
+}
+
+// Called with interrupts disabled; returns once @prev runs again
+static void switch_to(struct sched_cpu *rq, struct thread *prev, struct thread *next) {
+    // A thread woken or stolen right after it blocked may still be saving
+    // its registers on the CPU it left
+    while (__atomic_load_n(&next->on_cpu, __ATOMIC_ACQUIRE))
+        asm volatile ("pause");
+    next->on_cpu = 1;
+    // A thread that yielded kept its state, and with it any early wakeup
+    uint32_t runnable = THREAD_RUNNABLE;
+    __atomic_compare_exchange_n(&next->state, &runnable, THREAD_RUNNING, false,
+                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    next->cpu = this_cpu_id();
+
+    __atomic_store_n(&rq->current, next, __ATOMIC_SEQ_CST);
+    rq->need_resched = false;
+    rq->switches++;
+    if (next == &rq->idle)
+        timer_cancel(&rq->slice);
+    else
+        timer_add(&rq->slice, ktime_get_ns() + SCHED_SLICE_NS);
+
+    rcu_note_context_switch();
+    fpu_switch(prev);
+    rq->prev = prev;
+    sched_switch(prev, next);
+    sched_finish_switch();
+}
+
+// Runs first thing on the new stack after every switch
+static void sched_finish_switch(void) {
+    struct thread *prev = this_rq()->prev;
+    __atomic_store_n(&prev->on_cpu, 0, __ATOMIC_RELEASE);
+    if (prev->state == THREAD_ZOMBIE) {
+        // Nothing runs on its stack anymore; the next thread_create() on
+        // this CPU gets it back still mapped
+        kstack_free(prev->stack_top);
+        __atomic_store_n(&prev->state, THREAD_FREE, __ATOMIC_RELEASE);
+    }
+}
+
+// Give up the CPU after the caller set the current thread's new state
+static void schedule(struct sched_cpu *rq) {
+    struct thread *prev = rq->current;
+    drain_wake_list(rq);
+    struct thread *next = deque_take(&rq->rq);
+    if (!next)
+        next = steal_work(rq);
+    if (!next)
+        next = &rq->idle;
+
+    if (next == prev) {
+        // Woken again before it got off the CPU
+        prev->state = THREAD_RUNNING;
+        return;
+    }
+    switch_to(rq, prev, next);
+}
+
+void sched_thread_start(void) {
+    sched_finish_switch();
+    asm volatile ("sti" : : : "memory");
+
+    struct thread *thread = current_thread();
+    thread->fn(thread->arg);
+    thread_exit();
+}
+
+static void sched_ipi(struct isr_frame *frame) {
+    (void)frame;
+    apic_eoi();
+}
+
+void sched_init_cpu(void) {
+    struct sched_cpu *rq = this_rq();
+    rq->idle.state = THREAD_RUNNING;
+    rq->idle.on_cpu = 1;
+    rq->idle.cpu = this_cpu_id();
+    rq->idle.name = "idle";
+    rq->current = &rq->idle;
+    timer_setup(&rq->slice, slice_expired, rq);
+
+    rcu_init_cpu();
+    tlb_init_cpu();
+    isr_register(SCHED_IPI_VECTOR, sched_ipi);
+    __atomic_store_n(&rq->ready, true, __ATOMIC_RELEASE);
+
+    softirq_init_cpu();
+    workqueue_init_cpu();
+}
+
+struct thread *current_thread(void) {
+    return this_rq()->current;
+}
+
+static struct thread *thread_spawn(void (*fn)(void *arg), void *arg, const char *name,
+                                   bool pinned) {
+    struct thread *thread = NULL;
+    uint32_t slot;
+    for (slot = 0; slot < SCHED_MAX_THREADS; slot++) {
+        uint32_t expected = THREAD_FREE;
+        if (__atomic_compare_exchange_n(&threads[slot].state, &expected, THREAD_EMBRYO, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            thread = &threads[slot];
+            break;
+        }
+    }
+    if (!thread)
+        return NULL;
+
+    uint64_t stack_top = kstack_alloc();
+    if (!stack_top) {
+        __atomic_store_n(&thread->state, THREAD_FREE, __ATOMIC_RELEASE);
+        return NULL;
+    }
+
+    thread->fn = fn;
+    thread->arg = arg;
+    thread->name = name;
+    thread->id = __atomic_fetch_add(&next_thread_id, 1, __ATOMIC_RELAXED);
+    thread->stack_top = stack_top;
+    thread->on_cpu = 0;
+    thread->wake_next = NULL;
+    thread->pinned = pinned;
+
+    // The extended state area sits at the top of the stack
+    thread->fpu_state = (void *)((stack_top - fpu_state_size) & ~63ULL);
+    thread->fpu_used = false;
+    fpu_state_init(thread->fpu_state);
+
+    // What sched_switch() pops: six callee-saved registers, then the return
+    // address, placed so sched_thread_entry starts with %rsp 16 byte aligned
+    uint64_t *sp = (uint64_t *)thread->fpu_state;
+    *--sp = 0;
+    *--sp = 0;
+    *--sp = (uint64_t)sched_thread_entry;
+    for (int i = 0; i < 6; i++)
+        *--sp = 0;
+    thread->rsp = (uint64_t)sp;
+
+    uint64_t flags = irq_save();
+    struct sched_cpu *rq = this_rq();
+    thread->cpu = this_cpu_id();
+    thread->state = THREAD_RUNNABLE;
+    deque_push(&rq->rq, thread);
+    kick_idle_peer(rq);
+    irq_restore(flags);
+    return thread;
+}
+
+struct thread *thread_create(void (*fn)(void *arg), void *arg, const char *name) {
+    return thread_spawn(fn, arg, name, false);
+}
+
+struct thread *thread_create_pinned(void (*fn)(void *arg), void *arg, const char *name) {
+    return thread_spawn(fn, arg, name, true);
+}
+
+void thread_exit(void) {
+    irq_save();
+    struct sched_cpu *rq = this_rq();
+    rq->current->state = THREAD_ZOMBIE;
+    schedule(rq);
+    panic("Exited thread was scheduled again\n");
+    __builtin_unreachable();
+}
+
+void sched_yield(void) {
+    // Not inside any RCU read-side section by definition
+    rcu_poll();
+
+    uint64_t flags = irq_save();
+    struct sched_cpu *rq = this_rq();
+    struct thread *prev = rq->current;
+
+    // The idle thread is on no queue; once switched away it would only
+    // come back when this CPU runs dry. sched_idle() is its way to yield.
+    if (prev == &rq->idle || !rq->ready) {
+        irq_restore(flags);
+        return;
+    }
+
+    // Oldest local entry, so threads that keep yielding take turns
+    drain_wake_list(rq);
+    struct thread *next = deque_steal(&rq->rq);
+    if (!next)
+        next = deque_take(&rq->rq);
+
+    if (next) {
+        // Still RUNNING or WOKEN: it is not blocked, and a sched_wake()
+        // that came before its next sched_block() must not be lost
+        deque_push(&rq->rq, prev);
+        kick_idle_peer(rq);
+        switch_to(rq, prev, next);
+    } else {
+        // Nothing else to run: start a fresh slice
+        rq->need_resched = false;
+        timer_add(&rq->slice, ktime_get_ns() + SCHED_SLICE_NS);
+    }
+    irq_restore(flags);
+}
+
+void cond_resched(void) {
+    if (this_rq()->need_resched)
+        sched_yield();
+}
+
+void sched_block(void) {
+    uint64_t flags = irq_save();
+    struct sched_cpu *rq = this_rq();
+    struct thread *prev = rq->current;
+
+    uint32_t expected = THREAD_RUNNING;
+    if (__atomic_compare_exchange_n(&prev->state, &expected, THREAD_BLOCKED, false,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        schedule(rq);
+    else
+        prev->state = THREAD_RUNNING;   // A wakeup came first
+    irq_restore(flags);
+}
+
+void sched_wake(struct thread *thread) {
+    uint32_t state = __atomic_load_n(&thread->state, __ATOMIC_SEQ_CST);
+    for (;;) {
+        uint32_t target;
+        if (state == THREAD_RUNNING)
+            target = THREAD_WOKEN;
+        else if (state == THREAD_BLOCKED)
+            target = THREAD_RUNNABLE;
+        else
+            return;
+        if (__atomic_compare_exchange_n(&thread->state, &state, target, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            break;
+    }
+    if (state != THREAD_BLOCKED)
+        return;
+
+    // Back to the CPU it last ran on
+    wake_list_push(thread->cpu, thread);
+}
+
+void sched_idle(void) {
+    struct sched_cpu *rq = this_rq();
+    if (!rq->ready) {
+        timer_idle();
+        return;
+    }
+
+    rcu_poll();
+    irq_save();
+    rq->kicked = false;
+
+    drain_wake_list(rq);
+    struct thread *next = deque_take(&rq->rq);
+    if (!next)
+        next = steal_work(rq);
+    if (next) {
+        switch_to(rq, &rq->idle, next);
+        asm volatile ("sti" : : : "memory");
+        return;
+    }
+
+    // Interrupts stay off until timer_idle() halts, so a wakeup IPI sent
+    // after the checks above still ends the halt
+    rcu_idle_enter();
+    tlb_idle_enter();
+    timer_idle();
+    tlb_idle_exit();
+    rcu_idle_exit();
+}
+
+void sched_get_stats(uint32_t cpu, struct sched_stats *stats) {
+    struct sched_cpu *rq = &sched_cpus[cpu];
+    stats->switches = rq->switches;
+    stats->steals = rq->steals;
+    stats->steal_failures = rq->steal_failures;
+    stats->rq_len = deque_len(&rq->rq);
+}
+
+void sched_dump_stats(void) {
+    kprintf("Scheduler statistics:\n");
+    for (uint32_t cpu = 0; cpu < smp_cpu_count; cpu++) {
+        if (!sched_cpus[cpu].ready)
+            continue;
+        struct sched_stats stats;
+        sched_get_stats(cpu, &stats);
+        kprintf("  CPU %u: %lu switches, %lu steals (%lu failed), %u queued\n",
+                cpu, stats.switches, stats.steals, stats.steal_failures, stats.rq_len);
+    }
+}
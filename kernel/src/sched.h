@@ -0,0 +1,146 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu.h"
+#include "timer.h"
+#include "kstack.h"
+
+// Upper bound on live kernel threads, not counting the per-CPU idle threads
+#define SCHED_MAX_THREADS 128
+
+// Kernel stack of every thread, from kstack_alloc()
+#define SCHED_STACK_SIZE KSTACK_SIZE
+
+// Run queue capacity per CPU, a power of two
+#define SCHED_DEQUE_SIZE 256
+
+// Time slice after which cond_resched() gives up the CPU
+#define SCHED_SLICE_NS 10000000ULL
+
+// IPI that wakes an idle CPU after a thread was handed to it
+#define SCHED_IPI_VECTOR 0xF1
+
+enum thread_state {
+    THREAD_FREE,        // Slot unused
+    THREAD_EMBRYO,      // Being set up by thread_create()
+    THREAD_RUNNABLE,    // On a run queue or about to be
+    THREAD_RUNNING,     // On a CPU, or queued again by sched_yield()
+    THREAD_WOKEN,       // Like RUNNING, and sched_wake() came before sched_block()
+    THREAD_BLOCKED,
+    THREAD_ZOMBIE,      // Exited, slot is released after the switch away
+};
+
+struct thread {
+    uint64_t rsp;               // Saved by sched_switch.S, must stay first
+    volatile uint32_t state;    // enum thread_state
+    volatile uint32_t on_cpu;   // Set until the context is fully saved
+    uint32_t cpu;               // CPU it last ran on, where wakeups send it
+    uint32_t id;
+    struct thread *wake_next;   // Link in the target CPU's wake list
+    void (*fn)(void *arg);
+    void *arg;
+    uint64_t stack_top;
+    const char *name;
+    void *fpu_state;            // Extended state area at the top of the stack
+    bool fpu_used;              // fpu_state holds state of its own (see fpu.h)
+    bool pinned;                // Never stolen; only runs on @cpu
+};
+
+struct sched_stats {
+    uint64_t switches;          // Context switches on this CPU
+    uint64_t steals;            // Threads taken from another CPU's queue
+    uint64_t steal_failures;    // Steal attempts that found nothing or lost a race
+    uint32_t rq_len;            // Threads queued right now
+};
+
+/**
+ * sched_init_cpu - Make the executing CPU schedulable.
+ *
+ * Turns the code running now into this CPU's idle thread and arms nothing
+ * until a thread is queued. Also brings the CPU under RCU and starts its
+ * ksoftirqd and workqueue threads. Needs timer_init() on this CPU; the BSP
+ * also needs the recursive mapping for thread stacks.
+ */
+void sched_init_cpu(void);
+
+/**
+ * thread_create - Start a kernel thread.
+ *
+ * @fn:   Entry point, runs with interrupts enabled.
+ * @arg:  Passed to @fn.
+ * @name: Static string for statistics and debugging.
+ *
+ * The thread is queued on the calling CPU and returning from @fn is the
+ * same as thread_exit(). Returns NULL when all SCHED_MAX_THREADS slots are
+ * in use.
+ */
+struct thread *thread_create(void (*fn)(void *arg), void *arg, const char *name);
+
+/**
+ * thread_create_pinned - Start a kernel thread bound to the calling CPU.
+ *
+ * Same as thread_create(), but the thread is never stolen: a CPU that
+ * takes it from the queue hands it straight back. For per-CPU service
+ * threads that work on this CPU's data.
+ */
+struct thread *thread_create_pinned(void (*fn)(void *arg), void *arg, const char *name);
+
+// Terminate the calling thread
+__attribute__((noreturn)) void thread_exit(void);
+
+// Thread running on this CPU (the idle thread when nothing else is)
+struct thread *current_thread(void);
+
+/**
+ * sched_yield - Let other runnable threads on this CPU run first.
+ *
+ * The caller goes to the back of the local queue: the oldest queued thread
+ * runs next, so yielding threads take turns. Returns at once when nothing
+ * else is runnable here, and always in the idle thread, which has
+ * sched_idle() for that. Either way it reports an RCU quiescent state.
+ */
+void sched_yield(void);
+
+// Yield if the current time slice has run out
+void cond_resched(void);
+
+/**
+ * sched_block - Sleep until sched_wake().
+ *
+ * A sched_wake() that arrives between the caller's last check of its wait
+ * condition and this call is not lost: sched_block() returns immediately.
+ * Must not be called from interrupt context or by the idle thread.
+ */
+void sched_block(void);
+
+/**
+ * sched_wake - Make a blocked thread runnable.
+ *
+ * @thread: Thread to wake; waking a thread that is not blocked only makes
+ *          its next sched_block() return at once.
+ *
+ * The thread is handed to the CPU it last ran on, where its cache state
+ * is, and that CPU gets an IPI if it is not the caller. Safe from
+ * interrupt context and from any CPU.
+ */
+void sched_wake(struct thread *thread);
+
+/**
+ * sched_idle - One iteration of a CPU's idle loop.
+ *
+ * Runs queued threads until the local queue is empty, then tries to steal
+ * from the CPU with the longest queue, and otherwise sleeps in timer_idle().
+ * Must be called by the idle thread. Before sched_init_cpu() it is just
+ * timer_idle().
+ */
+void sched_idle(void);
+
+// Snapshot of one CPU's counters
+void sched_get_stats(uint32_t cpu, struct sched_stats *stats);
+
+// Print switch, steal and queue length counters of every online CPU
+void sched_dump_stats(void);
+
+#endif // SCHED_H
@@ -0,0 +1,164 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "serial.h"
+#include "cpu.h"
+#include "idt.h"
+#include "pic.h"
+#include "isr.h"
+#include "softirq.h"
+#include "spinlock.h"
+
+// 16550 registers (offsets from the base port)
+#define UART_DATA 0
+#define UART_IER  1
+#define UART_IIR  2
+#define UART_FCR  2
+#define UART_LCR  3
+#define UART_MCR  4
+#define UART_LSR  5
+
+#define UART_IER_THRE 0x02  // Interrupt when the transmit FIFO empties
+#define UART_LSR_THRE 0x20  // Transmit FIFO empty
+
+// Transmit ring: serial_write() produces at tx_head, the THRE interrupt
+// consumes at tx_tail. Both only move forward and are masked on use.
+// Writers on any CPU and the softirq on the BSP share it under tx_lock,
+// which also keeps the UART registers to one CPU at a time.
+static LOCK_CLASS(tx_lock_class, "serial");
+static struct ticket_lock tx_lock = TICKET_LOCK_INIT(tx_lock_class);
+static char tx_ring[SERIAL_TX_RING_SIZE];
+static volatile uint32_t tx_head = 0;
+static volatile uint32_t tx_tail = 0;
+
+// Set once the THRE interrupt is wired up; before that the ring is drained
+// synchronously by the writer.
+static bool tx_irq_enabled = false;
+
+static inline uint32_t tx_used(void) {
+    return tx_head - tx_tail;
+}
+
+// Move up to one FIFO load from the ring to the UART; the caller must have
+// seen THRE set. tx_lock must be held with interrupts disabled.
+static void tx_fill_fifo(void) {
+    for (int i = 0; i < SERIAL_FIFO_SIZE && tx_used(); i++) {
+        outb(COM1 + UART_DATA, tx_ring[tx_tail % SERIAL_TX_RING_SIZE]);
+        tx_tail++;
+    }
+}
+
+// Poll the UART until the ring is empty. tx_lock must be held with
+// interrupts disabled.
+static void tx_drain_polled(void) {
+    while (tx_used()) {
+        while ((inb(COM1 + UART_LSR) & UART_LSR_THRE) == 0);  // Wait until the FIFO is empty
+        tx_fill_fifo();
+    }
+}
+
+// Start the transmitter if it is idle. tx_lock must be held with
+// interrupts disabled.
+static void tx_kick(void) {
+    if (inb(COM1 + UART_LSR) & UART_LSR_THRE)
+        tx_fill_fifo();
+
+    if (tx_used()) {
+        // The interrupt fires as soon as the FIFO runs empty
+        outb(COM1 + UART_IER, UART_IER_THRE);
+    }
+}
+
+// Hard-IRQ half: acknowledge and leave the port I/O to the softirq
+static void serial_irq_handler(struct isr_frame *frame) {
+    (void)frame;
+
+    // Reading IIR acknowledges a pending THRE interrupt
+    (void)inb(COM1 + UART_IIR);
+    pic_send_eoi(COM1_IRQ);
+    raise_softirq(SOFTIRQ_SERIAL);
+}
+
+static void serial_softirq(void) {
+    uint64_t flags = ticket_lock_irqsave(&tx_lock);
+
+    if (inb(COM1 + UART_LSR) & UART_LSR_THRE)
+        tx_fill_fifo();
+
+    if (!tx_used())
+        outb(COM1 + UART_IER, 0x00);
+
+    ticket_unlock_irqrestore(&tx_lock, flags);
+}
+
+// Initialize the serial port
+void serial_init(uint32_t baud) {
+    uint16_t divisor = baud ? (uint16_t)(115200 / baud) : 1;
+    if (divisor == 0)
+        divisor = 1;
+
+    outb(COM1 + UART_IER, 0x00);  // Disable interrupts
+    outb(COM1 + UART_LCR, 0x80);  // Enable DLAB (Divisor Latch Access)
+    outb(COM1 + 0, divisor & 0xFF);  // Set divisor (115200 / baud)
+    outb(COM1 + 1, divisor >> 8);
+    outb(COM1 + UART_LCR, 0x03);  // 8 bits, no parity, one stop bit
+    outb(COM1 + UART_FCR, 0xC7);  // Enable FIFO, clear them, 14-byte threshold
+    outb(COM1 + UART_MCR, 0x0B);  // Enable IRQs, RTS/DSR set
+}
+
+void serial_enable_irq(void) {
+    uint64_t flags = ticket_lock_irqsave(&tx_lock);
+
+    open_softirq(SOFTIRQ_SERIAL, serial_softirq);
+    isr_register(PIC_VECTOR_BASE + COM1_IRQ, serial_irq_handler);
+    pic_unmask(COM1_IRQ);
+    tx_irq_enabled = true;
+    tx_kick();
+
+    ticket_unlock_irqrestore(&tx_lock, flags);
+}
+
+void serial_write(const char *buf, size_t len) {
+    uint64_t flags = ticket_lock_irqsave(&tx_lock);
+
+    for (size_t i = 0; i < len; i++) {
+        if (tx_used() == SERIAL_TX_RING_SIZE) {
+            // Ring full: the only time a writer waits for the line
+            tx_drain_polled();
+        }
+        tx_ring[tx_head % SERIAL_TX_RING_SIZE] = buf[i];
+        tx_head++;
+    }
+
+    if (tx_irq_enabled) {
+        tx_kick();
+    } else {
+        tx_drain_polled();
+    }
+
+    ticket_unlock_irqrestore(&tx_lock, flags);
+}
+
+// Send a character to the serial port
+void serial_putc(char c) {
+    serial_write(&c, 1);
+}
+
+void serial_flush_sync(void) {
+    uint64_t flags = ticket_lock_irqsave(&tx_lock);
+    tx_drain_polled();
+    ticket_unlock_irqrestore(&tx_lock, flags);
+}
+
+void serial_putc_sync(char c) {
+    uint64_t flags = ticket_lock_irqsave(&tx_lock);
+    tx_drain_polled();
+    while ((inb(COM1 + UART_LSR) & UART_LSR_THRE) == 0);  // Wait until the buffer is empty
+    outb(COM1 + UART_DATA, c);
+    ticket_unlock_irqrestore(&tx_lock, flags);
+}
+
+void serial_panic_unlock(void) {
+    // Serve whoever is next, including a holder this CPU interrupted
+    __atomic_store_n(&tx_lock.owner, tx_lock.next, __ATOMIC_RELEASE);
+}
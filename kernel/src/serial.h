@@ -1,37 +1,43 @@
 #ifndef SERIAL_H
 #define SERIAL_H
 #include <stdint.h>
+#include <stddef.h>
+#include "cpu.h"
 
-// Write a byte to an I/O port
-static inline void outb(uint16_t port, uint8_t val) {
-    asm volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
-}
+#define COM1 0x3F8  // COM1 serial port base address
+#define COM1_IRQ 4  // Legacy IRQ line of COM1
 
-// Read a byte from an I/O port
-static inline uint8_t inb(uint16_t port) {
-    uint8_t ret;
-    asm volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
-    return ret;
-}
+// Default line speed; override with -DSERIAL_BAUD=<rate>. The 16550 divides
+// a 115200 Hz reference, so rates above that need a faster UART clock.
+#ifndef SERIAL_BAUD
+#define SERIAL_BAUD 115200
+#endif
 
-#define COM1 0x3F8  // COM1 serial port base address
+// Size of the transmit ring in bytes (power of two)
+#define SERIAL_TX_RING_SIZE 16384
 
-// Initialize the serial port
-void serial_init() {
-    outb(COM1 + 1, 0x00);  // Disable interrupts
-    outb(COM1 + 3, 0x80);  // Enable DLAB (Divisor Latch Access)
-    outb(COM1 + 0, 0x03);  // Set divisor to 3 (38400 baud)
-    outb(COM1 + 1, 0x00);
-    outb(COM1 + 3, 0x03);  // 8 bits, no parity, one stop bit
-    outb(COM1 + 2, 0xC7);  // Enable FIFO, clear them, 14-byte threshold
-    outb(COM1 + 4, 0x0B);  // Enable IRQs, RTS/DSR set
-}
-
-// Send a character to the serial port
-void serial_putc(char c) {
-    while ((inb(COM1 + 5) & 0x20) == 0);  // Wait until the buffer is empty
-    outb(COM1, c);
-}
+// Depth of the 16550 transmit FIFO
+#define SERIAL_FIFO_SIZE 16
 
-#endif // SERIAL_H
+// Initialize the serial port at the given baud rate
+void serial_init(uint32_t baud);
+
+// Switch transmission to the THRE interrupt (needs the IDT and PIC)
+void serial_enable_irq(void);
+
+// Queue bytes for transmission; only spins when the ring is full
+void serial_write(const char *buf, size_t len);
 
+// Queue a single character
+void serial_putc(char c);
+
+// Synchronously drain the ring by polling; safe with interrupts disabled
+void serial_flush_sync(void);
+
+// Send a character immediately, bypassing the ring (panic paths)
+void serial_putc_sync(char c);
+
+// Break the ring lock so panic() can write whatever state it is in
+void serial_panic_unlock(void);
+
+#endif // SERIAL_H
@@ -0,0 +1,111 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "smp.h"
+#include "percpu.h"
+#include "gdt.h"
+#include "idt.h"
+#include "cpu.h"
+#include "fpu.h"
+#include "apic.h"
+#include "timer.h"
+#include "sched.h"
+#include "profile.h"
+#include "kstack.h"
+#include "clocksource.h"
+#include "ioremap.h"
+#include "limine_requests.h"
+
+// How long smp_init() waits for the APs
+#define AP_START_TIMEOUT_NS 1000000000ULL
+
+struct percpu percpu_areas[MAX_CPUS];
+
+volatile uint32_t smp_cpus_online;
+uint32_t smp_cpu_count = 1;
+
+// smp_entry.S
+void smp_ap_entry(struct limine_smp_info *info);
+void smp_ap_main(struct percpu *cpu);
+
+void percpu_init_bsp(void) {
+    struct percpu *cpu = &percpu_areas[0];
+    cpu->self = cpu;
+    cpu->cpu_id = 0;
+    wrmsr(MSR_GS_BASE, (uint64_t)cpu);
+}
+
+// Kernel stack and IST stacks, each with a guard page below
+static void cpu_setup_stacks(struct percpu *cpu) {
+    // The BSP keeps running on the boot stack
+    if (cpu->cpu_id)
+        cpu->stack_top = kstack_alloc_permanent(SMP_STACK_SIZE);
+
+    cpu->tss.ist[IST_DOUBLE_FAULT - 1] = kstack_alloc_permanent(SMP_IST_SIZE);
+    cpu->tss.ist[IST_NMI - 1] = kstack_alloc_permanent(SMP_IST_SIZE);
+}
+
+void smp_ap_main(struct percpu *cpu) {
+    // Before anything that may reach memset() and its SIMD paths
+    fpu_init();
+    gdt_init(cpu);
+    idt_load();
+    pat_init();
+    apic_init();
+    timer_init();
+    sched_init_cpu();
+
+    cpu->online = 1;
+    __atomic_fetch_add(&smp_cpus_online, 1, __ATOMIC_RELEASE);
+
+    // Only now: a profile_start() that still saw this CPU offline has set
+    // profile_running before, and the locked add above orders the two
+    profile_init_cpu();
+
+    // This context is the CPU's idle thread from here on
+    for (;;)
+        sched_idle();
+}
+
+void smp_init(void) {
+    struct percpu *bsp = &percpu_areas[0];
+    bsp->cr3 = read_cr3();
+    bsp->apic_id = apic_id();
+    cpu_setup_stacks(bsp);
+    gdt_init(bsp);
+
+    // Faults on a broken stack and NMIs always get a known good stack
+    idt_set_ist(8, IST_DOUBLE_FAULT);
+    idt_set_ist(2, IST_NMI);
+
+    bsp->online = 1;
+    smp_cpus_online = 1;
+
+    struct limine_smp_response *smp = smp_request.response;
+    if (!smp)
+        return;
+
+    uint32_t next = 1;
+    for (uint64_t i = 0; i < smp->cpu_count && next < MAX_CPUS; i++) {
+        struct limine_smp_info *info = smp->cpus[i];
+        if (info->lapic_id == smp->bsp_lapic_id)
+            continue;
+
+        struct percpu *cpu = &percpu_areas[next];
+        cpu->self = cpu;
+        cpu->cpu_id = next++;
+        cpu->apic_id = info->lapic_id;
+        cpu->cr3 = bsp->cr3;
+        cpu_setup_stacks(cpu);
+
+        // Writing goto_address releases the AP
+        info->extra_argument = (uint64_t)cpu;
+        __atomic_store_n(&info->goto_address, smp_ap_entry, __ATOMIC_RELEASE);
+    }
+    smp_cpu_count = next;
+
+    uint64_t start = ktime_get_ns();
+    while (__atomic_load_n(&smp_cpus_online, __ATOMIC_ACQUIRE) < smp_cpu_count &&
+           ktime_get_ns() - start < AP_START_TIMEOUT_NS)
+        asm volatile ("pause");
+}
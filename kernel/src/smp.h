@@ -0,0 +1,32 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+
+// Kernel stack of every application processor
+#define SMP_STACK_SIZE (64 * 1024)
+
+// Stack for each interrupt stack table entry
+#define SMP_IST_SIZE (16 * 1024)
+
+// CPUs that finished smp_ap_main() setup, including the BSP
+extern volatile uint32_t smp_cpus_online;
+
+// CPUs the kernel knows about (online or not), at most MAX_CPUS
+extern uint32_t smp_cpu_count;
+
+/**
+ * smp_init - Set up the BSP's GDT/TSS and start the application processors.
+ *
+ * Assigns CPU 0 to the bootstrap processor and numbers the others in the
+ * order of the Limine SMP response, up to MAX_CPUS. Each CPU gets a kernel
+ * stack and IST stacks with an unmapped guard page below each, in the
+ * STACK_INDEX region above the boot stack. The APs load their own GDT and
+ * TSS, the shared IDT, enable their FPU, PAT, local APIC and timer wheel and
+ * then run the scheduler's idle loop. Waits up to a second for all of them to come online.
+ * Needs the recursive mapping, idt_install(), clocksource_init() and
+ * timer_init() on the BSP.
+ */
+void smp_init(void);
+
+#endif // SMP_H
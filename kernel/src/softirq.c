@@ -0,0 +1,170 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "softirq.h"
+#include "cpu.h"
+#include "idt.h"
+#include "sched.h"
+#include "clocksource.h"
+#include "klog.h"
+#include "text_renderer.h"
+
+struct softirq_cpu {
+    bool running;               // Handlers active; keeps nested exits out
+    bool deferred;              // ksoftirqd owes a round
+    struct thread *ksoftirqd;
+    uint64_t raised[SOFTIRQ_VECTORS];
+    uint64_t runs[SOFTIRQ_VECTORS];
+    uint64_t cycles[SOFTIRQ_VECTORS];
+    uint64_t restarts;
+    uint64_t deferrals;
+    uint64_t thread_runs;
+} __attribute__((aligned(64)));
+
+volatile uint32_t softirq_pending[MAX_CPUS];
+
+static softirq_fn_t softirq_handlers[SOFTIRQ_VECTORS];
+static struct softirq_cpu softirq_cpus[MAX_CPUS];
+
+static const char *const softirq_names[SOFTIRQ_VECTORS] = { "timer", "serial" };
+
+// Interrupts disabled
+static void wake_ksoftirqd(struct softirq_cpu *sc) {
+    if (sc->deferred)
+        return;
+    sc->deferred = true;
+    sc->deferrals++;
+    if (sc->ksoftirqd)
+        sched_wake(sc->ksoftirqd);
+}
+
+/*
+ * Run pending vectors for up to @passes passes or the time budget. Called
+ * and returns with interrupts disabled; the handlers run with them on.
+ */
+static void softirq_run(struct softirq_cpu *sc, uint32_t cpu, uint32_t passes) {
+    uint64_t deadline = ktime_get_ns() + SOFTIRQ_BUDGET_NS;
+    sc->running = true;
+    for (;;) {
+        uint32_t pending = softirq_pending[cpu];
+        softirq_pending[cpu] = 0;
+
+        irq_enable();
+        while (pending) {
+            uint32_t nr = __builtin_ctz(pending);
+            pending &= pending - 1;
+            uint64_t start = rdtsc();
+            softirq_handlers[nr]();
+            sc->runs[nr]++;
+            sc->cycles[nr] += rdtsc() - start;
+        }
+        irq_disable();
+
+        if (!softirq_pending[cpu])
+            break;
+        if (--passes == 0 || ktime_get_ns() >= deadline) {
+            wake_ksoftirqd(sc);
+            break;
+        }
+        sc->restarts++;
+    }
+    sc->running = false;
+}
+
+void open_softirq(uint32_t nr, softirq_fn_t fn) {
+    softirq_handlers[nr] = fn;
+}
+
+void raise_softirq(uint32_t nr) {
+    uint64_t flags = irq_save();
+    uint32_t cpu = this_cpu_id();
+    struct softirq_cpu *sc = &softirq_cpus[cpu];
+    softirq_pending[cpu] |= 1U << nr;
+    sc->raised[nr]++;
+
+    // Nothing else would look at it before the next interrupt
+    if (!in_interrupt() && !sc->running)
+        wake_ksoftirqd(sc);
+    irq_restore(flags);
+}
+
+void softirq_irq_exit(void) {
+    uint32_t cpu = this_cpu_id();
+    struct softirq_cpu *sc = &softirq_cpus[cpu];
+    if (irq_nesting[cpu] != 1 || !softirq_pending[cpu] || sc->running)
+        return;
+
+    // Once the budget ran out, each interrupt still takes one pass so timers
+    // keep firing even if ksoftirqd does not get to run for a while
+    softirq_run(sc, cpu, sc->deferred ? 1 : SOFTIRQ_MAX_RESTART);
+}
+
+static void ksoftirqd(void *arg) {
+    struct softirq_cpu *sc = arg;
+    uint32_t cpu = sc - softirq_cpus;   // Pinned, so also this_cpu_id()
+
+    for (;;) {
+        uint64_t flags = irq_save();
+        if (!softirq_pending[cpu]) {
+            // A deferral after this sees deferred clear and wakes us again
+            sc->deferred = false;
+            irq_restore(flags);
+            sched_block();
+            continue;
+        }
+        sc->thread_runs++;
+        // Handlers see interrupt context here too, as on an interrupt exit
+        irq_enter();
+        softirq_run(sc, cpu, SOFTIRQ_MAX_RESTART);
+        irq_exit();
+        irq_restore(flags);
+
+        // Let the other threads in between rounds
+        sched_yield();
+    }
+}
+
+void softirq_init_cpu(void) {
+    struct softirq_cpu *sc = &softirq_cpus[this_cpu_id()];
+    sc->ksoftirqd = thread_create_pinned(ksoftirqd, sc, "ksoftirqd");
+    if (!sc->ksoftirqd)
+        panic("Cannot start ksoftirqd\n");
+}
+
+void softirq_get_stats(uint32_t cpu, struct softirq_stats *stats) {
+    struct softirq_cpu *sc = &softirq_cpus[cpu];
+    for (int nr = 0; nr < SOFTIRQ_VECTORS; nr++) {
+        stats->raised[nr] = sc->raised[nr];
+        stats->runs[nr] = sc->runs[nr];
+        stats->cycles[nr] = sc->cycles[nr];
+    }
+    stats->restarts = sc->restarts;
+    stats->deferrals = sc->deferrals;
+    stats->thread_runs = sc->thread_runs;
+}
+
+void softirq_dump_stats(void) {
+    struct softirq_stats total = { 0 };
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        struct softirq_stats stats;
+        softirq_get_stats(cpu, &stats);
+        for (int nr = 0; nr < SOFTIRQ_VECTORS; nr++) {
+            total.raised[nr] += stats.raised[nr];
+            total.runs[nr] += stats.runs[nr];
+            total.cycles[nr] += stats.cycles[nr];
+        }
+        total.restarts += stats.restarts;
+        total.deferrals += stats.deferrals;
+        total.thread_runs += stats.thread_runs;
+    }
+
+    kprintf("Softirq statistics:\n");
+    for (int nr = 0; nr < SOFTIRQ_VECTORS; nr++) {
+        if (!total.runs[nr])
+            continue;
+        kprintf("  %-6s: %lu raised, %lu runs, %lu cycles avg\n", softirq_names[nr],
+                total.raised[nr], total.runs[nr], total.cycles[nr] / total.runs[nr]);
+    }
+    kprintf("  %lu restarts, %lu deferred to ksoftirqd, %lu ksoftirqd rounds\n",
+            total.restarts, total.deferrals, total.thread_runs);
+}
@@ -0,0 +1,81 @@
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu.h"
+
+/*
+ * Split interrupt handling. The hard-IRQ half (the isr_register() handler)
+ * only acknowledges the device and raises a softirq vector; the rest runs
+ * on the way out of the interrupt, after the EOI and with interrupts
+ * enabled, so other interrupts are not held off by it. Softirqs run on the
+ * CPU that raised them, never nest and never run concurrently with each
+ * other on one CPU. They count as interrupt context, in ksoftirqd too: no
+ * blocking, no yielding, no vector registers.
+ *
+ * One interrupt exit runs at most SOFTIRQ_MAX_RESTART passes over the
+ * pending vectors and stops after SOFTIRQ_BUDGET_NS. Whatever is still
+ * pending then is handed to the CPU's ksoftirqd thread, which competes
+ * with the other threads for the CPU; until it has caught up, interrupt
+ * exits make a single pass each. Work that may block or take long belongs
+ * on a workqueue (workqueue.h) instead.
+ */
+
+enum softirq_vector {
+    SOFTIRQ_TIMER,      // Timer wheel expiry (timer.c)
+    SOFTIRQ_SERIAL,     // UART transmit refill (serial.c)
+    SOFTIRQ_VECTORS,
+};
+
+// Passes over the pending vectors per interrupt exit
+#define SOFTIRQ_MAX_RESTART 10
+
+// Time one interrupt exit may spend in softirqs before deferring
+#define SOFTIRQ_BUDGET_NS 2000000ULL
+
+typedef void (*softirq_fn_t)(void);
+
+// Vectors raised on each CPU and not yet run, one bit per vector
+extern volatile uint32_t softirq_pending[MAX_CPUS];
+
+/**
+ * open_softirq - Install the handler of a vector.
+ *
+ * @nr: enum softirq_vector.
+ * @fn: Runs on the raising CPU as described above.
+ */
+void open_softirq(uint32_t nr, softirq_fn_t fn);
+
+/**
+ * raise_softirq - Mark a vector pending on this CPU.
+ *
+ * @nr: enum softirq_vector.
+ *
+ * From an interrupt handler, the vector runs when the outermost handler
+ * returns. Elsewhere, ksoftirqd is woken to run it. Raising a pending
+ * vector again runs its handler once.
+ */
+void raise_softirq(uint32_t nr);
+
+// Called by isr_dispatch() before the outermost interrupt handler returns
+void softirq_irq_exit(void);
+
+// Start this CPU's ksoftirqd; called by sched_init_cpu()
+void softirq_init_cpu(void);
+
+struct softirq_stats {
+    uint64_t raised[SOFTIRQ_VECTORS];
+    uint64_t runs[SOFTIRQ_VECTORS];
+    uint64_t cycles[SOFTIRQ_VECTORS];   // TSC cycles spent in the handler
+    uint64_t restarts;                  // Extra passes within one exit
+    uint64_t deferrals;                 // Times the budget ran out
+    uint64_t thread_runs;               // Rounds run by ksoftirqd
+};
+
+void softirq_get_stats(uint32_t cpu, struct softirq_stats *stats);
+
+// Print per-vector runs and average cycles and the deferral counters
+void softirq_dump_stats(void);
+
+#endif // SOFTIRQ_H
@@ -0,0 +1,111 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "spinlock.h"
+#include "cpu.h"
+#include "text_renderer.h"
+
+// Pause instructions per waiter ahead of us between two looks at a ticket
+// lock, so the owner's line is not hammered while the queue is long
+#define TICKET_BACKOFF 32
+
+uint64_t ticket_lock_wait(struct ticket_lock *lock, uint32_t ticket) {
+    uint64_t start = rdtsc();
+    for (;;) {
+        uint32_t owner = __atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE);
+        if (owner == ticket)
+            break;
+        for (uint32_t i = (ticket - owner) * TICKET_BACKOFF; i; i--)
+            asm volatile ("pause");
+    }
+    return rdtsc() - start;
+}
+
+void mcs_lock(struct mcs_lock *lock, struct mcs_node *node) {
+    node->next = NULL;
+    node->locked = 1;
+
+    struct mcs_node *prev = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+    uint64_t spin = 0;
+    if (prev) {
+        // Queue behind prev and spin on our own node until it hands over
+        uint64_t start = rdtsc();
+        __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+        while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE))
+            asm volatile ("pause");
+        spin = rdtsc() - start;
+    }
+    LOCKSTAT_ACQUIRED(lock, spin);
+}
+
+void mcs_unlock(struct mcs_lock *lock, struct mcs_node *node) {
+    LOCKSTAT_RELEASED(lock);
+
+    struct mcs_node *next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+    if (!next) {
+        // No known successor: free the lock unless someone just queued
+        struct mcs_node *expected = node;
+        if (__atomic_compare_exchange_n(&lock->tail, &expected, NULL, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            return;
+        // A waiter swapped the tail but has not linked itself in yet
+        while (!(next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)))
+            asm volatile ("pause");
+    }
+    __atomic_store_n(&next->locked, 0, __ATOMIC_RELEASE);
+}
+
+#ifdef LOCKSTAT
+
+static struct lock_class *lockstat_classes;
+
+void lockstat_acquired(struct lock_class *class, uint64_t *acquired_tsc, uint64_t spin_cycles) {
+    if (!__atomic_load_n(&class->registered, __ATOMIC_ACQUIRE) &&
+        !__atomic_exchange_n(&class->registered, 1, __ATOMIC_ACQ_REL)) {
+        struct lock_class *head = __atomic_load_n(&lockstat_classes, __ATOMIC_RELAXED);
+        do {
+            class->next = head;
+        } while (!__atomic_compare_exchange_n(&lockstat_classes, &head, class, true,
+                                              __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+
+    __atomic_fetch_add(&class->acquisitions, 1, __ATOMIC_RELAXED);
+    if (spin_cycles) {
+        __atomic_fetch_add(&class->contended, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&class->spin_cycles, spin_cycles, __ATOMIC_RELAXED);
+    }
+    *acquired_tsc = rdtsc();
+}
+
+void lockstat_released(struct lock_class *class, uint64_t acquired_tsc) {
+    uint64_t held = rdtsc() - acquired_tsc;
+    __atomic_fetch_add(&class->hold_cycles, held, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&class->max_hold_cycles, __ATOMIC_RELAXED);
+    while (held > max &&
+           !__atomic_compare_exchange_n(&class->max_hold_cycles, &max, held, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void lockstat_dump(void) {
+    kprintf("Lock statistics (cycles):\n");
+    for (struct lock_class *class = __atomic_load_n(&lockstat_classes, __ATOMIC_ACQUIRE);
+         class; class = class->next) {
+        uint64_t acquisitions = class->acquisitions;
+        if (!acquisitions)
+            continue;
+        kprintf("  %-12s %lu acquired, %lu contended, spin %lu avg, hold %lu avg %lu max\n",
+                class->name, acquisitions, class->contended,
+                class->contended ? class->spin_cycles / class->contended : 0,
+                class->hold_cycles / acquisitions, class->max_hold_cycles);
+    }
+}
+
+#else
+
+void lockstat_dump(void) {
+    kprintf("Lock statistics: not built in (compile with -DLOCKSTAT)\n");
+}
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu.h"
+
+/*
+ * Busy-wait locks for the kernel.
+ *
+ * Ticket locks are one cache line of state and FIFO fair; use them for
+ * short sections. Every waiter spins on the same line, so under heavy
+ * contention each release costs a cache miss on every waiting CPU. MCS
+ * locks queue the waiters in caller-provided nodes that each spin on their
+ * own line, so a release touches only the next waiter; use them where many
+ * CPUs pile up.
+ *
+ * The plain variants leave the interrupt flag alone. A lock that is ever
+ * taken from an interrupt handler must be taken with the _irqsave variants
+ * everywhere else, or the handler deadlocks against its own CPU.
+ *
+ * Every lock belongs to a lock class (usually one per lock). Building with
+ * -DLOCKSTAT makes each class count acquisitions, contended acquisitions,
+ * cycles spent spinning and hold times; lockstat_dump() prints them.
+ * Without it the class is only a name and the counters compile away.
+ */
+
+struct lock_class {
+    const char *name;
+#ifdef LOCKSTAT
+    uint64_t acquisitions;
+    uint64_t contended;         // Acquisitions that had to wait
+    uint64_t spin_cycles;       // TSC cycles spent waiting, summed
+    uint64_t hold_cycles;       // TSC cycles held, summed
+    uint64_t max_hold_cycles;
+    struct lock_class *next;    // lockstat_dump() list, linked on first use
+    uint8_t registered;
+#endif
+};
+
+// Define a lock class: LOCK_CLASS(pmm_lock_class, "pmm");
+#define LOCK_CLASS(var, class_name) struct lock_class var = { .name = (class_name) }
+
+struct ticket_lock {
+    volatile uint32_t next;     // Next ticket to hand out
+    volatile uint32_t owner;    // Ticket being served
+    struct lock_class *class;
+#ifdef LOCKSTAT
+    uint64_t acquired_tsc;
+#endif
+};
+
+#define TICKET_LOCK_INIT(lock_class) { .next = 0, .owner = 0, .class = &(lock_class) }
+
+struct mcs_node {
+    struct mcs_node *volatile next;
+    volatile uint32_t locked;
+} __attribute__((aligned(64)));
+
+struct mcs_lock {
+    struct mcs_node *tail;      // Last waiter, NULL when free
+    struct lock_class *class;
+#ifdef LOCKSTAT
+    uint64_t acquired_tsc;
+#endif
+};
+
+#define MCS_LOCK_INIT(lock_class) { .tail = NULL, .class = &(lock_class) }
+
+#ifdef LOCKSTAT
+void lockstat_acquired(struct lock_class *class, uint64_t *acquired_tsc, uint64_t spin_cycles);
+void lockstat_released(struct lock_class *class, uint64_t acquired_tsc);
+#define LOCKSTAT_ACQUIRED(lock, spin) lockstat_acquired((lock)->class, &(lock)->acquired_tsc, (spin))
+#define LOCKSTAT_RELEASED(lock) lockstat_released((lock)->class, (lock)->acquired_tsc)
+#else
+#define LOCKSTAT_ACQUIRED(lock, spin) do { (void)(spin); } while (0)
+#define LOCKSTAT_RELEASED(lock) do { } while (0)
+#endif
+
+// Contended path of ticket_lock(); returns the cycles spent waiting
+uint64_t ticket_lock_wait(struct ticket_lock *lock, uint32_t ticket);
+
+static inline void ticket_lock_init(struct ticket_lock *lock, struct lock_class *class) {
+    lock->next = 0;
+    lock->owner = 0;
+    lock->class = class;
+}
+
+static inline void ticket_lock(struct ticket_lock *lock) {
+    uint32_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    uint64_t spin = 0;
+    if (__builtin_expect(__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket, 0))
+        spin = ticket_lock_wait(lock, ticket);
+    LOCKSTAT_ACQUIRED(lock, spin);
+}
+
+// Take the lock only if it is free right now
+static inline bool ticket_trylock(struct ticket_lock *lock) {
+    uint32_t owner = __atomic_load_n(&lock->owner, __ATOMIC_RELAXED);
+    uint32_t expected = owner;
+    if (!__atomic_compare_exchange_n(&lock->next, &expected, owner + 1, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return false;
+    LOCKSTAT_ACQUIRED(lock, 0);
+    return true;
+}
+
+static inline void ticket_unlock(struct ticket_lock *lock) {
+    LOCKSTAT_RELEASED(lock);
+    // Only the holder writes owner, so a plain increment is enough
+    __atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+}
+
+static inline bool ticket_is_locked(struct ticket_lock *lock) {
+    return __atomic_load_n(&lock->next, __ATOMIC_RELAXED) !=
+           __atomic_load_n(&lock->owner, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t ticket_lock_irqsave(struct ticket_lock *lock) {
+    uint64_t flags = irq_save();
+    ticket_lock(lock);
+    return flags;
+}
+
+static inline void ticket_unlock_irqrestore(struct ticket_lock *lock, uint64_t flags) {
+    ticket_unlock(lock);
+    irq_restore(flags);
+}
+
+static inline void mcs_lock_init(struct mcs_lock *lock, struct lock_class *class) {
+    lock->tail = NULL;
+    lock->class = class;
+}
+
+/**
+ * mcs_lock - Acquire an MCS queue lock.
+ *
+ * @lock: Lock to take.
+ * @node: Queue node owned by the caller, usually on its stack. It must stay
+ *        valid and be passed to the matching mcs_unlock().
+ */
+void mcs_lock(struct mcs_lock *lock, struct mcs_node *node);
+
+// Release an MCS lock taken with @node; hands it to the next waiter, if any
+void mcs_unlock(struct mcs_lock *lock, struct mcs_node *node);
+
+static inline uint64_t mcs_lock_irqsave(struct mcs_lock *lock, struct mcs_node *node) {
+    uint64_t flags = irq_save();
+    mcs_lock(lock, node);
+    return flags;
+}
+
+static inline void mcs_unlock_irqrestore(struct mcs_lock *lock, struct mcs_node *node,
+                                         uint64_t flags) {
+    mcs_unlock(lock, node);
+    irq_restore(flags);
+}
+
+// Print the counters of every lock class taken so far (LOCKSTAT builds)
+void lockstat_dump(void);
+
+#endif // SPINLOCK_H
@@ -1,43 +1,501 @@
+#include <stdbool.h>
 #include "string.h"
+#include "cpu.h"
+#include "fpu.h"
+
+// Keep GCC from turning the copy loops below back into calls to memcpy/memset
+#define NO_LIBCALL __attribute__((optimize("no-tree-loop-distribute-patterns")))
+
+// Unaligned, alias-safe views used for word and vector sized accesses
+typedef uint64_t unaligned_u64 __attribute__((aligned(1), may_alias));
+typedef uint32_t unaligned_u32 __attribute__((aligned(1), may_alias));
+typedef long long v16_u __attribute__((vector_size(16), aligned(1), may_alias));
+typedef long long v32_u __attribute__((vector_size(32), aligned(1), may_alias));
+
+// Copies and fills of at least this many bytes use rep movsb/stosb when the
+// CPU advertises ERMS. With FSRM short strings are fast too, so the cut-off drops.
+#define REP_THRESHOLD_ERMS 2048
+#define REP_THRESHOLD_FSRM 128
+
+enum string_simd {
+    STRING_SIMD_NONE,
+    STRING_SIMD_SSE2,
+    STRING_SIMD_AVX,
+};
+
+// Selected by string_init(); until then everything takes the scalar paths
+static size_t rep_threshold = SIZE_MAX;
+static enum string_simd simd = STRING_SIMD_NONE;
+
+void string_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+
+    bool erms = false, fsrm = false;
+    if (eax >= 7) {
+        cpuid(7, 0, &eax, &ebx, &ecx, &edx);
+        erms = (ebx >> 9) & 1;
+        fsrm = (edx >> 4) & 1;
+    }
+
+    if (fsrm)
+        rep_threshold = REP_THRESHOLD_FSRM;
+    else if (erms)
+        rep_threshold = REP_THRESHOLD_ERMS;
+    else
+        rep_threshold = SIZE_MAX;
+
+    if (fpu_has_avx)
+        simd = STRING_SIMD_AVX;
+    else if (fpu_has_sse2)
+        simd = STRING_SIMD_SSE2;
+    else
+        simd = STRING_SIMD_NONE;
+}
+
+const char *string_impl_name(void) {
+    static const char *names[2][3] = {
+        { "scalar", "sse2", "avx" },
+        { "scalar+erms", "sse2+erms", "avx+erms" },
+    };
+    return names[rep_threshold != SIZE_MAX][simd];
+}
+
+// Vector paths run inside kernel_fpu_begin()/end(). In interrupt handlers,
+// which must leave the vector registers alone, they fall back to scalar.
+static inline enum string_simd simd_begin(void) {
+    if (simd == STRING_SIMD_NONE || !kernel_fpu_begin())
+        return STRING_SIMD_NONE;
+    return simd;
+}
+
+static inline void simd_end(enum string_simd level) {
+    if (level != STRING_SIMD_NONE)
+        kernel_fpu_end();
+}
+
+static inline uint64_t load64(const uint8_t *p) {
+    return *(const unaligned_u64 *)p;
+}
+
+static inline void store64(uint8_t *p, uint64_t v) {
+    *(unaligned_u64 *)p = v;
+}
+
+// Up to 64 bytes. Every load happens before the first store, so the source
+// and destination may overlap in either direction.
+static inline void copy_small(uint8_t *d, const uint8_t *s, size_t n) {
+    if (n > 32) {
+        uint64_t a0 = load64(s), a1 = load64(s + 8);
+        uint64_t a2 = load64(s + 16), a3 = load64(s + 24);
+        uint64_t b0 = load64(s + n - 32), b1 = load64(s + n - 24);
+        uint64_t b2 = load64(s + n - 16), b3 = load64(s + n - 8);
+        store64(d, a0);
+        store64(d + 8, a1);
+        store64(d + 16, a2);
+        store64(d + 24, a3);
+        store64(d + n - 32, b0);
+        store64(d + n - 24, b1);
+        store64(d + n - 16, b2);
+        store64(d + n - 8, b3);
+    } else if (n > 16) {
+        uint64_t a0 = load64(s), a1 = load64(s + 8);
+        uint64_t b0 = load64(s + n - 16), b1 = load64(s + n - 8);
+        store64(d, a0);
+        store64(d + 8, a1);
+        store64(d + n - 16, b0);
+        store64(d + n - 8, b1);
+    } else if (n >= 8) {
+        uint64_t head = load64(s), tail = load64(s + n - 8);
+        store64(d, head);
+        store64(d + n - 8, tail);
+    } else if (n >= 4) {
+        uint32_t head = *(const unaligned_u32 *)s;
+        uint32_t tail = *(const unaligned_u32 *)(s + n - 4);
+        *(unaligned_u32 *)d = head;
+        *(unaligned_u32 *)(d + n - 4) = tail;
+    } else if (n) {
+        uint8_t first = s[0], mid = s[n / 2], last = s[n - 1];
+        d[0] = first;
+        d[n / 2] = mid;
+        d[n - 1] = last;
+    }
+}
+
+// Same shape for fills of up to 64 bytes
+static inline void set_small(uint8_t *p, uint64_t pattern, size_t n) {
+    if (n > 32) {
+        store64(p, pattern);
+        store64(p + 8, pattern);
+        store64(p + 16, pattern);
+        store64(p + 24, pattern);
+        store64(p + n - 32, pattern);
+        store64(p + n - 24, pattern);
+        store64(p + n - 16, pattern);
+        store64(p + n - 8, pattern);
+    } else if (n > 16) {
+        store64(p, pattern);
+        store64(p + 8, pattern);
+        store64(p + n - 16, pattern);
+        store64(p + n - 8, pattern);
+    } else if (n >= 8) {
+        store64(p, pattern);
+        store64(p + n - 8, pattern);
+    } else if (n >= 4) {
+        *(unaligned_u32 *)p = (uint32_t)pattern;
+        *(unaligned_u32 *)(p + n - 4) = (uint32_t)pattern;
+    } else if (n) {
+        p[0] = p[n / 2] = p[n - 1] = (uint8_t)pattern;
+    }
+}
+
+static inline void rep_movsb(uint8_t *d, const uint8_t *s, size_t n) {
+    asm volatile ("rep movsb" : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+}
+
+// Forward copy of n > 64 bytes in quadwords. The last (possibly partial)
+// quadword is read up front so this is also safe for memmove when d < s.
+static inline void copy_fwd_movsq(uint8_t *d, const uint8_t *s, size_t n) {
+    uint64_t tail = load64(s + n - 8);
+    uint8_t *end = d + n - 8;
+    size_t words = n / 8;
+    asm volatile ("rep movsq" : "+D"(d), "+S"(s), "+c"(words) : : "memory");
+    store64(end, tail);
+}
+
+/*
+ * Vector copies of n > 64 bytes. The forward loops read the last 64 bytes
+ * before storing anything and the backward loops read the first 64 bytes,
+ * so the ragged end is covered by one overlapping store and both are safe
+ * for overlapping memmove in their direction.
+ */
+__attribute__((target("sse2"))) NO_LIBCALL
+static void copy_fwd_sse2(uint8_t *d, const uint8_t *s, size_t n) {
+    v16_u t0 = *(const v16_u *)(s + n - 64), t1 = *(const v16_u *)(s + n - 48);
+    v16_u t2 = *(const v16_u *)(s + n - 32), t3 = *(const v16_u *)(s + n - 16);
+    uint8_t *end = d + n - 64;
+
+    for (size_t left = n; left > 64; left -= 64, d += 64, s += 64) {
+        v16_u a = *(const v16_u *)s, b = *(const v16_u *)(s + 16);
+        v16_u c = *(const v16_u *)(s + 32), e = *(const v16_u *)(s + 48);
+        *(v16_u *)d = a;
+        *(v16_u *)(d + 16) = b;
+        *(v16_u *)(d + 32) = c;
+        *(v16_u *)(d + 48) = e;
+    }
+    *(v16_u *)end = t0;
+    *(v16_u *)(end + 16) = t1;
+    *(v16_u *)(end + 32) = t2;
+    *(v16_u *)(end + 48) = t3;
+}
+
+__attribute__((target("sse2"))) NO_LIBCALL
+static void copy_bwd_sse2(uint8_t *d, const uint8_t *s, size_t n) {
+    v16_u h0 = *(const v16_u *)s, h1 = *(const v16_u *)(s + 16);
+    v16_u h2 = *(const v16_u *)(s + 32), h3 = *(const v16_u *)(s + 48);
+
+    for (size_t left = n; left > 64; ) {
+        left -= 64;
+        v16_u a = *(const v16_u *)(s + left), b = *(const v16_u *)(s + left + 16);
+        v16_u c = *(const v16_u *)(s + left + 32), e = *(const v16_u *)(s + left + 48);
+        *(v16_u *)(d + left) = a;
+        *(v16_u *)(d + left + 16) = b;
+        *(v16_u *)(d + left + 32) = c;
+        *(v16_u *)(d + left + 48) = e;
+    }
+    *(v16_u *)d = h0;
+    *(v16_u *)(d + 16) = h1;
+    *(v16_u *)(d + 32) = h2;
+    *(v16_u *)(d + 48) = h3;
+}
+
+__attribute__((target("avx"))) NO_LIBCALL
+static void copy_fwd_avx(uint8_t *d, const uint8_t *s, size_t n) {
+    v32_u t0 = *(const v32_u *)(s + n - 64), t1 = *(const v32_u *)(s + n - 32);
+    uint8_t *end = d + n - 64;
+
+    for (size_t left = n; left > 64; left -= 64, d += 64, s += 64) {
+        v32_u a = *(const v32_u *)s, b = *(const v32_u *)(s + 32);
+        *(v32_u *)d = a;
+        *(v32_u *)(d + 32) = b;
+    }
+    *(v32_u *)end = t0;
+    *(v32_u *)(end + 32) = t1;
+}
+
+__attribute__((target("avx"))) NO_LIBCALL
+static void copy_bwd_avx(uint8_t *d, const uint8_t *s, size_t n) {
+    v32_u h0 = *(const v32_u *)s, h1 = *(const v32_u *)(s + 32);
+
+    for (size_t left = n; left > 64; ) {
+        left -= 64;
+        v32_u a = *(const v32_u *)(s + left), b = *(const v32_u *)(s + left + 32);
+        *(v32_u *)(d + left) = a;
+        *(v32_u *)(d + left + 32) = b;
+    }
+    *(v32_u *)d = h0;
+    *(v32_u *)(d + 32) = h1;
+}
+
+// Backward quadword copy of n > 64 bytes for overlapping memmove with d > s
+NO_LIBCALL
+static void copy_bwd_words(uint8_t *d, const uint8_t *s, size_t n) {
+    uint64_t head = load64(s);
+    for (size_t left = n; left > 8; ) {
+        left -= 8;
+        store64(d + left, load64(s + left));
+    }
+    store64(d, head);
+}
+
+// Forward copy of n > 64 bytes; also correct for overlapping memmove with d < s
+static inline void copy_fwd(uint8_t *d, const uint8_t *s, size_t n) {
+    if (n >= rep_threshold) {
+        rep_movsb(d, s, n);
+        return;
+    }
+
+    enum string_simd level = simd_begin();
+    switch (level) {
+    case STRING_SIMD_AVX:
+        copy_fwd_avx(d, s, n);
+        break;
+    case STRING_SIMD_SSE2:
+        copy_fwd_sse2(d, s, n);
+        break;
+    default:
+        copy_fwd_movsq(d, s, n);
+        break;
+    }
+    simd_end(level);
+}
 
 void *memcpy(void *dest, const void *src, size_t n) {
+    if (n <= 64)
+        copy_small(dest, src, n);
+    else
+        copy_fwd(dest, src, n);
+    return dest;
+}
+
+void *memmove(void *dest, const void *src, size_t n) {
     uint8_t *pdest = (uint8_t *)dest;
     const uint8_t *psrc = (const uint8_t *)src;
 
-    for (size_t i = 0; i < n; i++) {
-        pdest[i] = psrc[i];
+    if (pdest == psrc || n == 0)
+        return dest;
+
+    if (n <= 64) {
+        copy_small(pdest, psrc, n);
+    } else if ((uintptr_t)pdest - (uintptr_t)psrc >= n) {
+        // Destination below the source or no overlap at all
+        copy_fwd(pdest, psrc, n);
+    } else {
+        enum string_simd level = simd_begin();
+        switch (level) {
+        case STRING_SIMD_AVX:
+            copy_bwd_avx(pdest, psrc, n);
+            break;
+        case STRING_SIMD_SSE2:
+            copy_bwd_sse2(pdest, psrc, n);
+            break;
+        default:
+            copy_bwd_words(pdest, psrc, n);
+            break;
+        }
+        simd_end(level);
     }
     return dest;
 }
 
+__attribute__((target("sse2"))) NO_LIBCALL
+static void fill_sse2(uint8_t *p, uint64_t pattern, size_t n) {
+    v16_u v = { (long long)pattern, (long long)pattern };
+    uint8_t *end = p + n - 64;
+
+    for (size_t left = n; left > 64; left -= 64, p += 64) {
+        *(v16_u *)p = v;
+        *(v16_u *)(p + 16) = v;
+        *(v16_u *)(p + 32) = v;
+        *(v16_u *)(p + 48) = v;
+    }
+    *(v16_u *)end = v;
+    *(v16_u *)(end + 16) = v;
+    *(v16_u *)(end + 32) = v;
+    *(v16_u *)(end + 48) = v;
+}
+
+__attribute__((target("avx"))) NO_LIBCALL
+static void fill_avx(uint8_t *p, uint64_t pattern, size_t n) {
+    v32_u v = { (long long)pattern, (long long)pattern, (long long)pattern, (long long)pattern };
+    uint8_t *end = p + n - 64;
+
+    for (size_t left = n; left > 64; left -= 64, p += 64) {
+        *(v32_u *)p = v;
+        *(v32_u *)(p + 32) = v;
+    }
+    *(v32_u *)end = v;
+    *(v32_u *)(end + 32) = v;
+}
+
 void *memset(void *s, int c, size_t n) {
     uint8_t *p = (uint8_t *)s;
-    for (size_t i = 0; i < n; i++) {
-        p[i] = (uint8_t)c;
+    uint64_t pattern = (uint8_t)c * 0x0101010101010101ULL;
+
+    if (n <= 64) {
+        set_small(p, pattern, n);
+        return s;
+    }
+
+    if (n >= rep_threshold) {
+        asm volatile ("rep stosb" : "+D"(p), "+c"(n) : "a"(c) : "memory");
+        return s;
     }
+
+    enum string_simd level = simd_begin();
+    switch (level) {
+    case STRING_SIMD_AVX:
+        fill_avx(p, pattern, n);
+        break;
+    case STRING_SIMD_SSE2:
+        fill_sse2(p, pattern, n);
+        break;
+    default: {
+        // Quadword fill plus one overlapping store for the ragged end
+        uint8_t *end = p + n - 8;
+        size_t words = n / 8;
+        asm volatile ("rep stosq" : "+D"(p), "+c"(words) : "a"(pattern) : "memory");
+        store64(end, pattern);
+        break;
+    }
+    }
+    simd_end(level);
     return s;
 }
 
-void *memmove(void *dest, const void *src, size_t n) {
-    uint8_t *pdest = (uint8_t *)dest;
-    const uint8_t *psrc = (const uint8_t *)src;
+/*
+ * Whole-page clear and copy with non-temporal stores: the lines go straight
+ * to memory instead of displacing the caller's working set. The stores are
+ * weakly ordered, so each routine ends with an sfence before the page can be
+ * published (e.g. by a page table entry pointing at it).
+ */
+#define NT_PAGE_SIZE 4096
 
-    if (src > dest) {
-        for (size_t i = 0; i < n; i++) {
-            pdest[i] = psrc[i];
-        }
-    } else if (src < dest) {
-        for (size_t i = n; i > 0; i--) {
-            pdest[i-1] = psrc[i-1];
-        }
-    }
-    return dest;
+__attribute__((target("sse2")))
+static void clear_page_sse2(void *page) {
+    asm volatile ("pxor %%xmm0, %%xmm0\n\t"
+                  "1:\n\t"
+                  "movntdq %%xmm0, (%0)\n\t"
+                  "movntdq %%xmm0, 16(%0)\n\t"
+                  "movntdq %%xmm0, 32(%0)\n\t"
+                  "movntdq %%xmm0, 48(%0)\n\t"
+                  "add $64, %0\n\t"
+                  "cmp %1, %0\n\t"
+                  "jne 1b\n\t"
+                  "sfence"
+                  : "+r"(page)
+                  : "r"((uint8_t *)page + NT_PAGE_SIZE)
+                  : "xmm0", "memory");
+}
+
+static void clear_page_movnti(void *page) {
+    asm volatile ("1:\n\t"
+                  "movnti %2, (%0)\n\t"
+                  "movnti %2, 8(%0)\n\t"
+                  "movnti %2, 16(%0)\n\t"
+                  "movnti %2, 24(%0)\n\t"
+                  "movnti %2, 32(%0)\n\t"
+                  "movnti %2, 40(%0)\n\t"
+                  "movnti %2, 48(%0)\n\t"
+                  "movnti %2, 56(%0)\n\t"
+                  "add $64, %0\n\t"
+                  "cmp %1, %0\n\t"
+                  "jne 1b\n\t"
+                  "sfence"
+                  : "+r"(page)
+                  : "r"((uint8_t *)page + NT_PAGE_SIZE), "r"(0ULL)
+                  : "memory");
+}
+
+__attribute__((target("sse2")))
+static void copy_page_sse2(void *dst, const void *src) {
+    asm volatile ("1:\n\t"
+                  "prefetchnta 256(%1)\n\t"
+                  "movdqa (%1), %%xmm0\n\t"
+                  "movdqa 16(%1), %%xmm1\n\t"
+                  "movdqa 32(%1), %%xmm2\n\t"
+                  "movdqa 48(%1), %%xmm3\n\t"
+                  "movntdq %%xmm0, (%0)\n\t"
+                  "movntdq %%xmm1, 16(%0)\n\t"
+                  "movntdq %%xmm2, 32(%0)\n\t"
+                  "movntdq %%xmm3, 48(%0)\n\t"
+                  "add $64, %1\n\t"
+                  "add $64, %0\n\t"
+                  "cmp %2, %0\n\t"
+                  "jne 1b\n\t"
+                  "sfence"
+                  : "+r"(dst), "+r"(src)
+                  : "r"((uint8_t *)dst + NT_PAGE_SIZE)
+                  : "xmm0", "xmm1", "xmm2", "xmm3", "memory");
+}
+
+static void copy_page_movnti(void *dst, const void *src) {
+    uint64_t a, b, c, d;
+    asm volatile ("1:\n\t"
+                  "mov (%5), %0\n\t"
+                  "mov 8(%5), %1\n\t"
+                  "mov 16(%5), %2\n\t"
+                  "mov 24(%5), %3\n\t"
+                  "movnti %0, (%4)\n\t"
+                  "movnti %1, 8(%4)\n\t"
+                  "movnti %2, 16(%4)\n\t"
+                  "movnti %3, 24(%4)\n\t"
+                  "add $32, %5\n\t"
+                  "add $32, %4\n\t"
+                  "cmp %6, %4\n\t"
+                  "jne 1b\n\t"
+                  "sfence"
+                  : "=&r"(a), "=&r"(b), "=&r"(c), "=&r"(d), "+r"(dst), "+r"(src)
+                  : "r"((uint8_t *)dst + NT_PAGE_SIZE)
+                  : "memory");
+}
+
+void clear_page(void *page) {
+    enum string_simd level = simd_begin();
+    if (level != STRING_SIMD_NONE)
+        clear_page_sse2(page);
+    else
+        clear_page_movnti(page);
+    simd_end(level);
+}
+
+void copy_page(void *dst, const void *src) {
+    enum string_simd level = simd_begin();
+    if (level != STRING_SIMD_NONE)
+        copy_page_sse2(dst, src);
+    else
+        copy_page_movnti(dst, src);
+    simd_end(level);
 }
 
 int memcmp(const void *s1, const void *s2, size_t n) {
     const uint8_t *p1 = (const uint8_t *)s1;
     const uint8_t *p2 = (const uint8_t *)s2;
 
+    // Compare a quadword at a time; byte swapping the first differing pair
+    // turns memory order into numeric order.
+    while (n >= 8) {
+        uint64_t a = load64(p1), b = load64(p2);
+        if (a != b) {
+            a = __builtin_bswap64(a);
+            b = __builtin_bswap64(b);
+            return a < b ? -1 : 1;
+        }
+        p1 += 8;
+        p2 += 8;
+        n -= 8;
+    }
+
     for (size_t i = 0; i < n; i++) {
         if (p1[i] != p2[i]) {
             return p1[i] < p2[i] ? -1 : 1;
@@ -62,4 +520,4 @@ char *strcpy(char *dest, const char *src) {
     }
     dest[i] = '\0';
     return dest;
-}
\ No newline at end of file
+}
@@ -4,12 +4,42 @@
 #include <stdint.h>
 #include <stddef.h>
 
+/**
+ * string_init - Pick the memory function implementations for this CPU.
+ *
+ * Enables rep movsb/stosb for large operations when CPUID reports ERMS (and
+ * for medium ones with FSRM) and the SSE2/AVX loops for the rest. Must run
+ * after fpu_init(); until then the scalar paths are used.
+ */
+void string_init(void);
+
+// Short description of the selected implementation, e.g. "avx+erms"
+const char *string_impl_name(void);
+
 // Memory functions
 void *memcpy(void *dest, const void *src, size_t n);
 void *memset(void *s, int c, size_t n);
 void *memmove(void *dest, const void *src, size_t n);
 int memcmp(const void *s1, const void *s2, size_t n);
 
+/**
+ * clear_page - Zero one page-aligned 4 KiB page with non-temporal stores.
+ *
+ * @page: Page-aligned virtual address of the page.
+ *
+ * The cleared lines bypass the cache, and the routine ends with an sfence so
+ * the zeroes are visible before a later store publishes the page.
+ */
+void clear_page(void *page);
+
+/**
+ * copy_page - Copy one page-aligned 4 KiB page with non-temporal stores.
+ *
+ * @dst: Page-aligned destination.
+ * @src: Page-aligned source; must not overlap @dst.
+ */
+void copy_page(void *dst, const void *src);
+
 // String functions
 size_t strlen(const char *s);
 char *strcpy(char *dest, const char *src);
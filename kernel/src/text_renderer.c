@@ -6,6 +6,14 @@
 #include <stdarg.h>
 #include "serial.h"
 #include "limine_requests.h"
+#include "cpu.h"
+#include "fpu.h"
+#include "klog.h"
+#include "printf.h"
+#include "string.h"
+#include "spinlock.h"
+#include "pmm_mngr.h"
+#include "vmm_mngr.h"
 
 uint64_t* fb_address;
 uint64_t fb_width;
@@ -17,17 +25,98 @@ uint64_t fb_pitch;
 #define FONT_WIDTH  8
 #define FONT_HEIGHT 8
 
+// Console area the static buffers below cover. They are only used if the
+// PMM cannot provide buffers for the whole framebuffer, and then only the
+// top-left corner of a bigger framebuffer shows text.
+#define FALLBACK_MAX_WIDTH  1024
+#define FALLBACK_MAX_HEIGHT 768
+
+// Shadow copy of the console in RAM. All drawing happens here and only dirty
+// spans are pushed to fb_address, so the console never reads video memory.
+static uint32_t *backbuffer;
+static uint64_t bb_width;   // Console width in pixels (also the row stride)
+static uint64_t bb_height;  // Console height in pixels
+
+// Dirty span [dirty_x0, dirty_x1) per pixel row, and the range of rows
+// [dirty_y0, dirty_y1) that has any dirty span at all.
+static uint16_t *dirty_x0;
+static uint16_t *dirty_x1;
+static uint64_t dirty_y0 = 0;
+static uint64_t dirty_y1 = 0;
+
+// Text grid limits of the fallback console, one cell per glyph
+#define FALLBACK_COLS (FALLBACK_MAX_WIDTH / FONT_WIDTH)
+#define FALLBACK_ROWS (FALLBACK_MAX_HEIGHT / FONT_HEIGHT)
+
+// Default attribute: white text on black
+#define DEFAULT_ATTR 0x0F
+
+// One character cell: low nibble of attr is the foreground palette index,
+// high nibble the background.
+struct cell {
+    char ch;
+    uint8_t attr;
+};
+
+// The text the console holds, grid_rows rows of grid_cols cells. Rows form
+// a ring: screen row r is ring row (grid_head + r) % grid_rows, so
+// scrolling only bumps grid_head.
+static struct cell *grid;
+static size_t grid_head = 0;
+static size_t grid_cols;
+static size_t grid_rows;
+
+// What is currently painted at each screen position, and which screen rows
+// may differ from it since the last flush.
+static struct cell *shown;
+static bool *row_dirty;
+static bool grid_dirty = false;
+
+static uint32_t fallback_backbuffer[FALLBACK_MAX_WIDTH * FALLBACK_MAX_HEIGHT];
+static uint16_t fallback_dirty_x0[FALLBACK_MAX_HEIGHT];
+static uint16_t fallback_dirty_x1[FALLBACK_MAX_HEIGHT];
+static struct cell fallback_grid[FALLBACK_ROWS * FALLBACK_COLS];
+static struct cell fallback_shown[FALLBACK_ROWS * FALLBACK_COLS];
+static bool fallback_row_dirty[FALLBACK_ROWS];
+
+static uint8_t current_attr = DEFAULT_ATTR;
+
+// 16 colour VGA palette
+static const uint32_t palette[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF,
+};
+
 // Cursor position
+// Guards the text grid, cursor and colour, the back buffer and what is painted
+static LOCK_CLASS(console_lock_class, "console");
+static struct ticket_lock console_lock = TICKET_LOCK_INIT(console_lock_class);
+
 static size_t cursor_x = 0;
 static size_t cursor_y = 0;
 
 // Calculate screen dimensions in characters
 static size_t get_screen_width() {
-    return fb_width / FONT_WIDTH;
+    return grid_cols;
 }
 
 static size_t get_screen_height() {
-    return fb_height / FONT_HEIGHT;
+    return grid_rows;
+}
+
+// Text cells of screen row y
+static inline struct cell *grid_row(size_t y) {
+    return &grid[(grid_head + y) % grid_rows * grid_cols];
+}
+
+// Painted cells of screen row y
+static inline struct cell *shown_row(size_t y) {
+    return &shown[y * grid_cols];
+}
+
+static inline void mark_row(size_t y) {
+    row_dirty[y] = true;
+    grid_dirty = true;
 }
 
 // Font bitmap data would be here (we're skipping as requested)
@@ -130,74 +219,314 @@ const uint8_t font[95][8] = {
 };
 
 
-// Draw pixel on the framebuffer
+// Mark [x0, x1) of pixel rows [y0, y1) as needing a flush
+static void mark_dirty(uint64_t x0, uint64_t x1, uint64_t y0, uint64_t y1) {
+    if (x1 > bb_width) x1 = bb_width;
+    if (y1 > bb_height) y1 = bb_height;
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    for (uint64_t y = y0; y < y1; y++) {
+        if (dirty_x0[y] >= dirty_x1[y]) {
+            dirty_x0[y] = x0;
+            dirty_x1[y] = x1;
+        } else {
+            if (x0 < dirty_x0[y]) dirty_x0[y] = x0;
+            if (x1 > dirty_x1[y]) dirty_x1[y] = x1;
+        }
+    }
+
+    if (dirty_y0 >= dirty_y1) {
+        dirty_y0 = y0;
+        dirty_y1 = y1;
+    } else {
+        if (y0 < dirty_y0) dirty_y0 = y0;
+        if (y1 > dirty_y1) dirty_y1 = y1;
+    }
+}
+
+// Copy a span of pixels to video memory with 64-bit string stores
+static inline void fb_write_span(uint32_t *dst, const uint32_t *src, uint64_t pixels) {
+    uint64_t qwords = pixels / 2;
+    asm volatile ("rep movsq"
+                  : "+D"(dst), "+S"(src), "+c"(qwords)
+                  : : "memory");
+    if (pixels & 1)
+        *dst = *src;
+}
+
+// Push every dirty span of the back buffer to the framebuffer
+static void push_dirty_spans() {
+    uint32_t *fb = (uint32_t*)fb_address;
+    uint64_t pitch = fb_pitch / 4;
+
+    for (uint64_t y = dirty_y0; y < dirty_y1; y++) {
+        if (dirty_x0[y] >= dirty_x1[y])
+            continue;
+
+        // Widen the span to an even pixel so the copy is made of whole qwords
+        uint64_t x0 = dirty_x0[y] & ~1ULL;
+        uint64_t x1 = dirty_x1[y];
+        fb_write_span(&fb[y * pitch + x0], &backbuffer[y * bb_width + x0], x1 - x0);
+
+        dirty_x0[y] = 0;
+        dirty_x1[y] = 0;
+    }
+
+    dirty_y0 = 0;
+    dirty_y1 = 0;
+}
+
+// Draw pixel into the back buffer
 void put_pixel(int x, int y, uint32_t color) {
-    if (x < 0 || y < 0 || x >= fb_width || y >= fb_height)
+    if (x < 0 || y < 0 || (uint64_t)x >= bb_width || (uint64_t)y >= bb_height)
         return; // Bounds checking
-        
-    uint32_t *fb = (uint32_t*)fb_address;
-    fb[y * (fb_pitch / 4) + x] = color;
-}
-
-// Render a single character
-void draw_char(int x, int y, char c, uint32_t color) {
-    if (c < 32 || c > 126) 
-        {
-            /* Print one simple block*/
-            for (int row = 0; row < FONT_HEIGHT; row++) {
-                for (int col = 0; col < FONT_WIDTH; col++) {
-                    if (row == 0 || row == FONT_HEIGHT - 1 || col == 0 || col == FONT_WIDTH - 1) {
-                        put_pixel(x + col, y + row, color);
-                    }
+
+    backbuffer[y * bb_width + x] = color;
+    mark_dirty(x, x + 1, y, y + 1);
+}
+
+// Glyph cache: every glyph pre-expanded to 32bpp rows for a few colour pairs.
+// Index 95 holds the box drawn for characters outside the font.
+#define GLYPH_COUNT       96
+#define GLYPH_UNSUPPORTED 95
+#define GLYPH_CACHE_SLOTS 4
+
+struct glyph_cache_slot {
+    uint32_t px[GLYPH_COUNT][FONT_HEIGHT][FONT_WIDTH];
+    uint32_t fg;
+    uint32_t bg;
+    bool valid;
+};
+
+static struct glyph_cache_slot glyph_cache[GLYPH_CACHE_SLOTS] __attribute__((aligned(32)));
+static size_t glyph_cache_victim = 0;
+static size_t glyph_cache_last = 0;
+
+// Expand the whole font for one colour pair
+static void expand_glyphs(struct glyph_cache_slot *slot, uint32_t fg, uint32_t bg) {
+    for (int g = 0; g < GLYPH_COUNT; g++) {
+        for (int row = 0; row < FONT_HEIGHT; row++) {
+            for (int col = 0; col < FONT_WIDTH; col++) {
+                bool lit;
+                if (g == GLYPH_UNSUPPORTED) {
+                    /* Print one simple block*/
+                    lit = row == 0 || row == FONT_HEIGHT - 1 || col == 0 || col == FONT_WIDTH - 1;
+                } else {
+                    lit = font[g][row] & (1 << (7 - col));
                 }
+                slot->px[g][row][col] = lit ? fg : bg;
             }
-            return;
-        } // Unsupported characters
+        }
+    }
+    slot->fg = fg;
+    slot->bg = bg;
+    slot->valid = true;
+}
+
+// Find (or build) the expanded glyph set for a colour pair
+static struct glyph_cache_slot *glyph_slot(uint32_t fg, uint32_t bg) {
+    struct glyph_cache_slot *slot = &glyph_cache[glyph_cache_last];
+    if (slot->valid && slot->fg == fg && slot->bg == bg)
+        return slot;
+
+    for (size_t i = 0; i < GLYPH_CACHE_SLOTS; i++) {
+        slot = &glyph_cache[i];
+        if (slot->valid && slot->fg == fg && slot->bg == bg) {
+            glyph_cache_last = i;
+            return slot;
+        }
+    }
+
+    glyph_cache_last = glyph_cache_victim;
+    glyph_cache_victim = (glyph_cache_victim + 1) % GLYPH_CACHE_SLOTS;
+    slot = &glyph_cache[glyph_cache_last];
+    expand_glyphs(slot, fg, bg);
+    return slot;
+}
+
+// Fallback with 64-bit stores
+static void blit_glyph_scalar(uint32_t *dst, size_t stride, const uint32_t *src) {
+    for (int row = 0; row < FONT_HEIGHT; row++) {
+        uint64_t *d = (uint64_t *)dst;
+        const uint64_t *s = (const uint64_t *)src;
+        d[0] = s[0];
+        d[1] = s[1];
+        d[2] = s[2];
+        d[3] = s[3];
+        dst += stride;
+        src += FONT_WIDTH;
+    }
+}
 
-    const uint8_t *glyph = font[c - 32];
+// Copy an expanded glyph (8 rows of 32 bytes) to dst, one store per row.
+// The kernel is built without SSE, so the vector copies opt in per function
+// and only run between kernel_fpu_begin() and kernel_fpu_end().
+__attribute__((target("avx")))
+static void copy_glyph_avx(uint32_t *dst, size_t stride, const uint32_t *src) {
     for (int row = 0; row < FONT_HEIGHT; row++) {
-        for (int col = 0; col < FONT_WIDTH; col++) {
-            if (glyph[row] & (1 << (7 - col))) {
-                put_pixel(x + col, y + row, color);
+        asm volatile ("vmovdqu (%1), %%ymm0\n\t"
+                      "vmovdqu %%ymm0, (%0)"
+                      : : "r"(dst), "r"(src) : "ymm0", "memory");
+        dst += stride;
+        src += FONT_WIDTH;
+    }
+    // Dirty upper halves would slow down later SSE code
+    asm volatile ("vzeroupper" : : : "memory");
+}
+
+// Same with two 128-bit stores per row
+__attribute__((target("sse2")))
+static void copy_glyph_sse2(uint32_t *dst, size_t stride, const uint32_t *src) {
+    for (int row = 0; row < FONT_HEIGHT; row++) {
+        asm volatile ("movdqu (%1), %%xmm0\n\t"
+                      "movdqu 16(%1), %%xmm1\n\t"
+                      "movdqu %%xmm0, (%0)\n\t"
+                      "movdqu %%xmm1, 16(%0)"
+                      : : "r"(dst), "r"(src) : "xmm0", "xmm1", "memory");
+        dst += stride;
+        src += FONT_WIDTH;
+    }
+}
+
+// In interrupt context the vector registers are off limits; fall back
+static void blit_glyph_avx(uint32_t *dst, size_t stride, const uint32_t *src) {
+    if (!kernel_fpu_begin()) {
+        blit_glyph_scalar(dst, stride, src);
+        return;
+    }
+    copy_glyph_avx(dst, stride, src);
+    kernel_fpu_end();
+}
+
+static void blit_glyph_sse2(uint32_t *dst, size_t stride, const uint32_t *src) {
+    if (!kernel_fpu_begin()) {
+        blit_glyph_scalar(dst, stride, src);
+        return;
+    }
+    copy_glyph_sse2(dst, stride, src);
+    kernel_fpu_end();
+}
+
+// Picked in init_text_renderer() from the features fpu_init() enabled
+static void (*blit_glyph)(uint32_t *dst, size_t stride, const uint32_t *src) = blit_glyph_scalar;
+
+// Render a single character cell, painting both foreground and background
+void draw_char(int x, int y, char c, uint32_t fg, uint32_t bg) {
+    if (x < 0 || y < 0 || (uint64_t)x + FONT_WIDTH > bb_width || (uint64_t)y + FONT_HEIGHT > bb_height)
+        return; // Bounds checking
+
+    int g = (c < 32 || c > 126) ? GLYPH_UNSUPPORTED : c - 32; // Unsupported characters
+    struct glyph_cache_slot *slot = glyph_slot(fg, bg);
+
+    blit_glyph(&backbuffer[y * bb_width + x], bb_width, &slot->px[g][0][0]);
+    mark_dirty(x, x + FONT_WIDTH, y, y + FONT_HEIGHT);
+}
+
+// Redraw the cells that differ from what is painted, then push them out.
+// Any number of putc() calls between two flushes costs one repaint.
+void console_flush() {
+    uint64_t flags = ticket_lock_irqsave(&console_lock);
+    if (grid_dirty) {
+        // One section for the whole repaint instead of one per glyph
+        bool fpu = kernel_fpu_begin();
+        for (size_t y = 0; y < grid_rows; y++) {
+            if (!row_dirty[y])
+                continue;
+
+            struct cell *row = grid_row(y);
+            struct cell *painted = shown_row(y);
+            for (size_t x = 0; x < grid_cols; x++) {
+                if (row[x].ch == painted[x].ch && row[x].attr == painted[x].attr)
+                    continue;
+
+                draw_char(x * FONT_WIDTH, y * FONT_HEIGHT, row[x].ch,
+                          palette[row[x].attr & 0xF], palette[row[x].attr >> 4]);
+                painted[x] = row[x];
             }
+            row_dirty[y] = false;
         }
+        if (fpu)
+            kernel_fpu_end();
+        grid_dirty = false;
     }
+
+    push_dirty_spans();
+    ticket_unlock_irqrestore(&console_lock, flags);
 }
 
-// Clear screen by filling it with black
-void clear_screen() {
-    
-    uint32_t *fb = (uint32_t*)fb_address;
-    int pixels = fb_height * (fb_pitch / 4);
-    
-    for (int i = 0; i < pixels; i++) {
-        fb[i] = 0x000000; // Black
+// Forget what is painted so the next flush redraws every cell
+static void console_invalidate() {
+    for (size_t y = 0; y < grid_rows; y++) {
+        struct cell *painted = shown_row(y);
+        for (size_t x = 0; x < grid_cols; x++) {
+            painted[x].ch = 0;
+        }
+        mark_row(y);
     }
 }
 
-// Scroll screen up by one line
-void scroll_screen() {
-    
-    uint32_t *fb = (uint32_t*)fb_address;
-    int pitch = fb_pitch / 4;
+// Blank one row of text cells
+static void clear_row(struct cell *row) {
+    for (size_t x = 0; x < grid_cols; x++) {
+        row[x].ch = ' ';
+        row[x].attr = current_attr;
+    }
+}
 
-    // Copy each row up one line
-    for (int y = 0; y < fb_height - FONT_HEIGHT; y++) {
-        for (int x = 0; x < fb_width; x++) {
-            fb[y * pitch + x] = fb[(y + FONT_HEIGHT) * pitch + x];
-        }
+// Clear screen by filling it with black
+void clear_screen() {
+    uint64_t flags = ticket_lock_irqsave(&console_lock);
+    uint64_t pixels = bb_width * bb_height;
+
+    for (uint64_t i = 0; i < pixels; i++) {
+        backbuffer[i] = 0x000000; // Black
     }
 
-    // Clear last row
-    for (int y = fb_height - FONT_HEIGHT; y < fb_height; y++) {
-        for (int x = 0; x < fb_width; x++) {
-            fb[y * pitch + x] = 0x000000;
+    // The painted state is now blank cells on black
+    grid_head = 0;
+    for (size_t y = 0; y < grid_rows; y++) {
+        clear_row(&grid[y * grid_cols]);
+        struct cell *painted = shown_row(y);
+        for (size_t x = 0; x < grid_cols; x++) {
+            painted[x].ch = ' ';
+            painted[x].attr = DEFAULT_ATTR;
         }
+        mark_row(y);
     }
+
+    mark_dirty(0, bb_width, 0, bb_height);
+    ticket_unlock_irqrestore(&console_lock, flags);
 }
 
-// Print character to screen, handling scrolling and newlines
-void putc(char c) {
+// Scroll screen up by one line: the old top row becomes the new bottom row
+static void scroll_grid() {
+    grid_head = (grid_head + 1) % grid_rows;
+    clear_row(grid_row(grid_rows - 1));
+
+    // Every screen row now shows different text; the repaint in
+    // console_flush() skips the cells that happen to match.
+    for (size_t y = 0; y < grid_rows; y++) {
+        mark_row(y);
+    }
+}
+
+void scroll_screen() {
+    uint64_t flags = ticket_lock_irqsave(&console_lock);
+    scroll_grid();
+    ticket_unlock_irqrestore(&console_lock, flags);
+}
+
+// Set the colour used by subsequent output (VGA palette indices 0-15)
+void console_set_color(uint8_t fg, uint8_t bg) {
+    uint64_t flags = ticket_lock_irqsave(&console_lock);
+    current_attr = (uint8_t)((fg & 0xF) | ((bg & 0xF) << 4));
+    ticket_unlock_irqrestore(&console_lock, flags);
+}
+
+// Put a character into the text grid, handling scrolling and newlines.
+// Nothing is drawn until the next console_flush().
+static void console_putc(char c) {
     
     if (c == '\n') {
         cursor_x = 0;
@@ -208,12 +537,13 @@ void putc(char c) {
         // Tab advances by 4 spaces
         cursor_x = (cursor_x + 4) & ~3;
     } else if (c >= 32 && c <= 126) {
-        draw_char(cursor_x * FONT_WIDTH, cursor_y * FONT_HEIGHT, c, 0xFFFFFF);
+        struct cell *cell = &grid_row(cursor_y)[cursor_x];
+        cell->ch = c;
+        cell->attr = current_attr;
+        mark_row(cursor_y);
         cursor_x++;
     }
 
-    serial_putc(c);
-
     // Wrap text
     if (cursor_x >= get_screen_width()) {
         cursor_x = 0;
@@ -222,135 +552,114 @@ void putc(char c) {
 
     // Scroll if needed
     if (cursor_y >= get_screen_height()) {
-        scroll_screen();
+        scroll_grid();
         cursor_y = get_screen_height() - 1;
     }
 
 
 }
 
-// Print string
-void puts(const char *s) {
-    if (!s) return;
-    
-    while (*s) putc(*s++);
+// Put a buffer into the text grid; the caller flushes
+void console_write(const char *s, size_t len) {
+    uint64_t flags = ticket_lock_irqsave(&console_lock);
+    for (size_t i = 0; i < len; i++) console_putc(s[i]);
+    ticket_unlock_irqrestore(&console_lock, flags);
 }
 
-// Convert integer to string (base 10 or 16)
-void itoa(int value, char *str, int base) {
-    char *ptr = str, *ptr1 = str, tmp_char;
-    int tmp_value;
-
-    if (value < 0 && base == 10) {
-        *ptr++ = '-';
-        value = -value;
-    }
-
-    do {
-        tmp_value = value;
-        value /= base;
-        *ptr++ = "0123456789ABCDEF"[tmp_value % base];
-    } while (value);
-
-    *ptr-- = '\0';
-
-    while (ptr1 < ptr) {
-        tmp_char = *ptr;
-        *ptr-- = *ptr1;
-        *ptr1++ = tmp_char;
-    }
+// Print character to screen and serial
+void putc(char c) {
+    console_write(&c, 1);
+    serial_putc(c);
+    console_flush();
 }
 
+// Print string to screen and serial
+void puts(const char *s) {
+    if (!s) return;
 
-void utoa(uint64_t value, char *str, int base) {
-    char *ptr = str, *ptr1 = str, tmp_char;
-    uint64_t tmp_value;
-
-    do {
-        tmp_value = value;
-        value /= base;
-        *ptr++ = "0123456789ABCDEF"[tmp_value % base];
-    } while (value);
-
-    *ptr-- = '\0';
-
-    while (ptr1 < ptr) {
-        tmp_char = *ptr;
-        *ptr-- = *ptr1;
-        *ptr1++ = tmp_char;
-    }
+    size_t len = strlen(s);
+    console_write(s, len);
+    serial_write(s, len);
+    console_flush();
 }
 
-
-// Kernel printf implementation
+// Kernel printf implementation: formats the message and hands it to the
+// kernel log, which renders it to the console and serial.
 void kprintf(const char *fmt, ...) {
+    char line[KLOG_MSG_MAX];
     va_list args;
-    va_start(args, fmt);
-    
-    char buffer[32];
-
-    for (; *fmt; fmt++) {
-        if (*fmt == '%') {
-            fmt++;
-
-            if (*fmt == 'l') {
-                fmt++;
-                if (*fmt == 'x') { // Handle %lx
-                    utoa(va_arg(args, uint64_t), buffer, 16);
-                    puts(buffer);
-                } else if (*fmt == 'u') { // Handle %lu
-                    utoa(va_arg(args, unsigned long), buffer, 10);
-                    puts(buffer);
-                } else { // Unsupported 'l' case
-                    putc('%');
-                    putc('l');
-                    putc(*fmt);
-                }
-            } else {
-                switch (*fmt) {
-                    case 's':
-                        puts(va_arg(args, char*));
-                        break;
-                    case 'd':
-                        itoa(va_arg(args, int), buffer, 10);
-                        puts(buffer);
-                        break;
-                    case 'x':
-                        utoa(va_arg(args, unsigned int), buffer, 16);
-                        puts(buffer);
-                        break;
-                    case 'p': { // Handle %p
-                        uint64_t ptr = (uint64_t)va_arg(args, void*);
-                        puts("0x");
-                        utoa(ptr, buffer, 16);
-                        puts(buffer);
-                        break;
-                    }
-                    case 'u': // Handle %u (unsigned int)
-                        utoa(va_arg(args, unsigned int), buffer, 10);
-                        puts(buffer);
-                        break;
-                    case '%':
-                        putc('%');
-                        break;
-                    default:
-                        putc('%');
-                        putc(*fmt);
-                        break;
-                }
-            }
-        } else {
-            putc(*fmt);
-        }
-    }
 
+    // Format the whole line in one pass, then emit it with a single call
+    va_start(args, fmt);
+    int len = vsnprintf(line, sizeof(line), fmt, args);
     va_end(args);
+
+    if (len > (int)sizeof(line) - 1)
+        len = sizeof(line) - 1;
+    klog_write(line, len);
 }
 
 
 
 
-// Initialize framebuffer and clear screen
+// Carve the back buffer, dirty spans and text grids for the whole
+// framebuffer out of one run of frames, reached through the HHDM
+static bool alloc_console_buffers(uint64_t width, uint64_t height, uint64_t pitch) {
+    uint64_t cols = width / FONT_WIDTH;
+    uint64_t rows = height / FONT_HEIGHT;
+    uint64_t pixels_size = (pitch * height + 63) & ~63ULL;
+    uint64_t dirty_size = (height * sizeof(uint16_t) + 63) & ~63ULL;
+    uint64_t cells_size = (rows * cols * sizeof(struct cell) + 63) & ~63ULL;
+    uint64_t size = pixels_size + 2 * dirty_size + 2 * cells_size + rows * sizeof(bool);
+
+    // Dirty spans are kept in 16 bits
+    if (width * sizeof(uint32_t) > pitch || width > UINT16_MAX || !rows || !cols)
+        return false;
+
+    uint64_t phys = pmm_alloc_contig((size + PAGE_SIZE - 1) / PAGE_SIZE);
+    if (!phys)
+        return false;
+
+    uint8_t *p = (uint8_t *)(phys + HHDM_OFFSET);
+    backbuffer = (uint32_t *)p;
+    p += pixels_size;
+    dirty_x0 = (uint16_t *)p;
+    p += dirty_size;
+    dirty_x1 = (uint16_t *)p;
+    p += dirty_size;
+    grid = (struct cell *)p;
+    p += cells_size;
+    shown = (struct cell *)p;
+    p += cells_size;
+    row_dirty = (bool *)p;
+
+    // Fresh frames may hold anything; an empty span has x0 >= x1
+    memset(dirty_x0, 0, 2 * dirty_size);
+    memset(row_dirty, 0, rows * sizeof(bool));
+
+    bb_width = width;
+    bb_height = height;
+    grid_cols = cols;
+    grid_rows = rows;
+    return true;
+}
+
+static void use_fallback_buffers(uint64_t width, uint64_t height) {
+    backbuffer = fallback_backbuffer;
+    dirty_x0 = fallback_dirty_x0;
+    dirty_x1 = fallback_dirty_x1;
+    grid = fallback_grid;
+    shown = fallback_shown;
+    row_dirty = fallback_row_dirty;
+
+    bb_width = width < FALLBACK_MAX_WIDTH ? width : FALLBACK_MAX_WIDTH;
+    bb_height = height < FALLBACK_MAX_HEIGHT ? height : FALLBACK_MAX_HEIGHT;
+    grid_cols = bb_width / FONT_WIDTH;
+    grid_rows = bb_height / FONT_HEIGHT;
+}
+
+// Initialize framebuffer and clear screen. Needs pmm_init(); the console
+// buffers are sized to the framebuffer and allocated from the PMM.
 bool init_text_renderer(uint64_t* addr, uint64_t width, uint64_t height, uint64_t pitch) {
 
     fb_address = addr;
@@ -358,6 +667,15 @@ bool init_text_renderer(uint64_t* addr, uint64_t width, uint64_t height, uint64_
     fb_height = height;
     fb_pitch = pitch;
 
+    if (!alloc_console_buffers(width, height, pitch))
+        use_fallback_buffers(width, height);
+
+    if (fpu_has_avx) {
+        blit_glyph = blit_glyph_avx;
+    } else if (fpu_has_sse2) {
+        blit_glyph = blit_glyph_sse2;
+    }
+
     // // Check if framebuffer is available
     // if (framebuffer_request.response == NULL || 
     //     framebuffer_request.response->framebuffer_count < 1) {
@@ -375,8 +693,38 @@ bool init_text_renderer(uint64_t* addr, uint64_t width, uint64_t height, uint64_
     cursor_x = 0;
     cursor_y = 0;
 
-    serial_init();
+    serial_init(SERIAL_BAUD);
 
     kprintf("\n Framebuffer data at %p\n and pointer is of size %d\n", fb_address, sizeof(fb_address));
     return true;
-}
\ No newline at end of file
+}
+
+void text_renderer_set_framebuffer(uint64_t* addr) {
+    fb_address = addr;
+}
+
+void console_panic_unlock(void) {
+    // Serve whoever is next, including a holder this CPU interrupted
+    __atomic_store_n(&console_lock.owner, console_lock.next, __ATOMIC_RELEASE);
+}
+
+const char *console_blitter_name(void) {
+    return blit_glyph == blit_glyph_avx ? "avx" :
+           blit_glyph == blit_glyph_sse2 ? "sse2" : "scalar";
+}
+
+// Draw printable glyphs along the top row of the back buffer, then have the
+// next flush repaint the screen from the text grid
+void console_bench_glyphs(uint64_t glyphs) {
+    uint64_t flags = ticket_lock_irqsave(&console_lock);
+    bool fpu = kernel_fpu_begin();
+    size_t cols = grid_cols < 95 ? grid_cols : 95;
+    for (uint64_t i = 0; i < glyphs; i++) {
+        size_t x = i % cols;
+        draw_char(x * FONT_WIDTH, 0, (char)(32 + x), 0xFFFFFF, 0x000000);
+    }
+    if (fpu)
+        kernel_fpu_end();
+    console_invalidate();
+    ticket_unlock_irqrestore(&console_lock, flags);
+}
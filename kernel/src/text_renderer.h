@@ -2,23 +2,47 @@
 #define TEXT_RENDERER_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdbool.h>
 
-// Initialize the text renderer (sets up framebuffer and clears screen)
+// Initialize the text renderer (sets up framebuffer and clears screen);
+// the console buffers come from the PMM, so pmm_init() must have run
 bool init_text_renderer();
 
+// Point the renderer at a new mapping of the same framebuffer
+void text_renderer_set_framebuffer(uint64_t* addr);
+
 // Print a single character to the screen
 void putc(char c);
 
 // Print a string to the screen
 void puts(const char *s);
 
+// Put a buffer on the screen without flushing or touching the serial port
+void console_write(const char *s, size_t len);
+
 // Clear the entire screen
 void clear_screen();
 
 // Scroll the screen up by one line
 void scroll_screen();
 
+// Repaint changed text cells and push them to the framebuffer
+void console_flush();
+
+// Break the console lock so panic() can print whatever state it is in
+void console_panic_unlock(void);
+
+// Set the colour of subsequent output (VGA palette indices 0-15)
+void console_set_color(uint8_t fg, uint8_t bg);
+
+// Format a message into the kernel log (see klog.h)
 void kprintf(const char *fmt, ...);
 
+// Glyph blitter picked at init: "avx", "sse2" or "scalar"
+const char *console_blitter_name(void);
+
+// Draw @glyphs glyphs through the glyph cache; run by the bench registry
+void console_bench_glyphs(uint64_t glyphs);
+
 #endif // TEXT_RENDERER_H
@@ -0,0 +1,294 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "timer.h"
+#include "apic.h"
+#include "clocksource.h"
+#include "cpu.h"
+#include "idt.h"
+#include "softirq.h"
+#include "spinlock.h"
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define LEVEL_SHIFT(level) ((level) * TIMER_LEVEL_BITS)
+#define NO_TICK UINT64_MAX
+
+_Static_assert(TIMER_WHEEL_SLOTS == 64, "occupancy bitmaps are one uint64_t per level");
+
+/*
+ * Only the owning CPU adds to its wheel, runs it and programs its APIC
+ * timer, but timer_cancel() and timer_add() detach a timer from whichever
+ * wheel it is on, so every wheel has a lock. It is dropped around
+ * callbacks.
+ */
+struct timer_wheel {
+    struct ticket_lock lock;
+    struct timer *slots[TIMER_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t occupied[TIMER_LEVELS];    // Bit per non-empty slot
+    uint64_t clk;                       // Next tick to process
+    uint64_t armed_tick;                // Tick the hardware fires at, or NO_TICK
+    uint64_t pending;
+};
+
+static LOCK_CLASS(timer_lock_class, "timer");
+static struct timer_wheel timer_wheels[MAX_CPUS];
+static bool timer_ready;
+
+static inline uint64_t ns_to_tick(uint64_t ns) {
+    if (ns > UINT64_MAX - ((1ULL << TIMER_TICK_SHIFT) - 1))
+        return UINT64_MAX >> TIMER_TICK_SHIFT;
+    return (ns + (1ULL << TIMER_TICK_SHIFT) - 1) >> TIMER_TICK_SHIFT;
+}
+
+static void wheel_enqueue(struct timer_wheel *wheel, struct timer *timer) {
+    uint64_t tick = timer->tick < wheel->clk ? wheel->clk : timer->tick;
+
+    // Lowest level whose window [clk, clk + 64 buckets) holds the tick
+    int level;
+    for (level = 0; level < TIMER_LEVELS; level++) {
+        uint32_t shift = LEVEL_SHIFT(level);
+        if ((tick >> shift) - (wheel->clk >> shift) < TIMER_WHEEL_SLOTS)
+            break;
+    }
+    if (level == TIMER_LEVELS) {
+        // Park it in the last bucket; it is re-hashed when that comes due
+        level = TIMER_LEVELS - 1;
+        tick = ((wheel->clk >> LEVEL_SHIFT(level)) + SLOT_MASK) << LEVEL_SHIFT(level);
+    }
+
+    uint32_t slot = (tick >> LEVEL_SHIFT(level)) & SLOT_MASK;
+    struct timer **head = &wheel->slots[level][slot];
+    timer->next = *head;
+    if (timer->next)
+        timer->next->pprev = &timer->next;
+    *head = timer;
+    timer->pprev = head;
+    wheel->occupied[level] |= 1ULL << slot;
+}
+
+static void wheel_dequeue(struct timer_wheel *wheel, struct timer *timer) {
+    *timer->pprev = timer->next;
+    if (timer->next)
+        timer->next->pprev = timer->pprev;
+
+    // Removing the only entry of a slot clears its occupancy bit
+    uintptr_t first = (uintptr_t)&wheel->slots[0][0];
+    uintptr_t at = (uintptr_t)timer->pprev;
+    if (at >= first && at < first + sizeof(wheel->slots) && !*timer->pprev) {
+        size_t index = (at - first) / sizeof(struct timer *);
+        wheel->occupied[index / TIMER_WHEEL_SLOTS] &= ~(1ULL << (index % TIMER_WHEEL_SLOTS));
+    }
+
+    timer->next = NULL;
+    timer->pprev = NULL;
+    wheel->pending--;
+}
+
+// Detach a whole slot; the entries keep valid links to the returned list
+static struct timer *wheel_take_slot(struct timer_wheel *wheel, int level, uint32_t slot,
+                                     struct timer **list) {
+    *list = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NULL;
+    wheel->occupied[level] &= ~(1ULL << slot);
+    if (*list)
+        (*list)->pprev = list;
+    return *list;
+}
+
+/*
+ * Next tick at which something happens: a level 0 expiry, or the start of a
+ * higher level bucket that has to be cascaded. O(TIMER_LEVELS).
+ */
+static uint64_t wheel_next_tick(const struct timer_wheel *wheel) {
+    uint64_t best = NO_TICK;
+    for (int level = 0; level < TIMER_LEVELS; level++) {
+        uint64_t bits = wheel->occupied[level];
+        if (!bits)
+            continue;
+
+        // First bucket that starts at or after clk; earlier ones are done
+        uint32_t shift = LEVEL_SHIFT(level);
+        uint64_t base = (wheel->clk + (1ULL << shift) - 1) >> shift;
+        uint32_t rot = base & SLOT_MASK;
+        if (rot)
+            bits = (bits >> rot) | (bits << (TIMER_WHEEL_SLOTS - rot));
+
+        uint64_t tick = (base + __builtin_ctzll(bits)) << shift;
+        if (tick < best)
+            best = tick;
+    }
+    return best;
+}
+
+/*
+ * Process every event up to and including @now_tick. Called with interrupts
+ * disabled and the wheel locked; callbacks run unlocked with the interrupt
+ * flag of @flags, the way irq_restore() leaves it.
+ */
+static void wheel_run(struct timer_wheel *wheel, uint64_t now_tick, uint64_t flags) {
+    for (;;) {
+        uint64_t tick = wheel_next_tick(wheel);
+        if (tick > now_tick)
+            break;
+        wheel->clk = tick;
+
+        // Cascade from the top so a timer can fall through several levels
+        for (int level = TIMER_LEVELS - 1; level > 0; level--) {
+            uint32_t shift = LEVEL_SHIFT(level);
+            uint32_t slot = (tick >> shift) & SLOT_MASK;
+            if ((tick & ((1ULL << shift) - 1)) || !(wheel->occupied[level] & (1ULL << slot)))
+                continue;
+
+            struct timer *list;
+            struct timer *timer;
+            wheel_take_slot(wheel, level, slot, &list);
+            while ((timer = list)) {
+                list = timer->next;
+                wheel_enqueue(wheel, timer);
+            }
+        }
+
+        // Expire level 0. Advancing clk first keeps re-armed timers out of
+        // this slot, and a callback may cancel any timer still on the list.
+        wheel->clk = tick + 1;
+        struct timer *expiring;
+        struct timer *timer;
+        wheel_take_slot(wheel, 0, tick & SLOT_MASK, &expiring);
+        while ((timer = expiring)) {
+            wheel_dequeue(wheel, timer);
+            ticket_unlock(&wheel->lock);
+            irq_restore(flags);
+            timer->fn(timer);
+            irq_save();
+            ticket_lock(&wheel->lock);
+        }
+    }
+}
+
+// Arm the hardware for the next wheel event, if it changed. Owning CPU,
+// wheel locked.
+static void wheel_program(struct timer_wheel *wheel) {
+    uint64_t tick = wheel_next_tick(wheel);
+    if (tick == wheel->armed_tick)
+        return;
+
+    wheel->armed_tick = tick;
+    if (tick == NO_TICK) {
+        apic_timer_cancel();
+        return;
+    }
+
+    uint64_t deadline = tick << TIMER_TICK_SHIFT;
+    uint64_t now = ktime_get_ns();
+    apic_timer_set_ns(deadline > now ? deadline - now : 0);
+}
+
+// Hard-IRQ half: the one-shot has fired and disarmed itself
+static void timer_interrupt(void) {
+    timer_wheels[this_cpu_id()].armed_tick = NO_TICK;
+    raise_softirq(SOFTIRQ_TIMER);
+}
+
+static void timer_softirq(void) {
+    struct timer_wheel *wheel = &timer_wheels[this_cpu_id()];
+    uint64_t flags = ticket_lock_irqsave(&wheel->lock);
+    wheel_run(wheel, ktime_get_ns() >> TIMER_TICK_SHIFT, flags);
+    wheel_program(wheel);
+    ticket_unlock_irqrestore(&wheel->lock, flags);
+}
+
+void timer_init(void) {
+    struct timer_wheel *wheel = &timer_wheels[this_cpu_id()];
+    ticket_lock_init(&wheel->lock, &timer_lock_class);
+    wheel->clk = ktime_get_ns() >> TIMER_TICK_SHIFT;
+    wheel->armed_tick = NO_TICK;
+
+    open_softirq(SOFTIRQ_TIMER, timer_softirq);
+    apic_timer_init(timer_interrupt);
+    timer_ready = true;
+}
+
+/*
+ * Take a timer off whatever wheel it is pending on. Interrupts disabled, no
+ * wheel locked. timer->cpu only changes under the lock of the wheel it
+ * names, so look again once that lock is held.
+ */
+static bool timer_detach(struct timer *timer) {
+    // Never added, already fired or cancelled: nothing to lock
+    if (!timer_pending(timer))
+        return false;
+
+    for (;;) {
+        uint32_t cpu = __atomic_load_n(&timer->cpu, __ATOMIC_RELAXED);
+        struct timer_wheel *wheel = &timer_wheels[cpu];
+        ticket_lock(&wheel->lock);
+        if (timer->cpu != cpu) {
+            ticket_unlock(&wheel->lock);
+            continue;
+        }
+        bool pending = timer_pending(timer);
+        if (pending)
+            wheel_dequeue(wheel, timer);
+        ticket_unlock(&wheel->lock);
+        return pending;
+    }
+}
+
+void timer_add(struct timer *timer, uint64_t expires) {
+    uint64_t flags = irq_save();
+    struct timer_wheel *wheel = &timer_wheels[this_cpu_id()];
+    timer_detach(timer);
+    ticket_lock(&wheel->lock);
+
+    // An empty wheel can skip ahead so the new timer hashes low
+    if (!wheel->pending) {
+        uint64_t now_tick = ktime_get_ns() >> TIMER_TICK_SHIFT;
+        if (now_tick > wheel->clk)
+            wheel->clk = now_tick;
+    }
+
+    timer->expires = expires;
+    timer->tick = ns_to_tick(expires);
+    timer->cpu = this_cpu_id();
+    wheel_enqueue(wheel, timer);
+    wheel->pending++;
+    wheel_program(wheel);
+
+    ticket_unlock_irqrestore(&wheel->lock, flags);
+}
+
+bool timer_cancel(struct timer *timer) {
+    uint64_t flags = irq_save();
+    bool pending = timer_detach(timer);
+    irq_restore(flags);
+    return pending;
+}
+
+uint64_t timer_next_expiry(void) {
+    struct timer_wheel *wheel = &timer_wheels[this_cpu_id()];
+    uint64_t flags = ticket_lock_irqsave(&wheel->lock);
+    uint64_t tick = wheel_next_tick(wheel);
+    ticket_unlock_irqrestore(&wheel->lock, flags);
+    return tick == NO_TICK ? UINT64_MAX : tick << TIMER_TICK_SHIFT;
+}
+
+void timer_idle(void) {
+    if (!timer_ready) {
+        asm volatile ("hlt");
+        return;
+    }
+
+    asm volatile ("cli");
+    struct timer_wheel *wheel = &timer_wheels[this_cpu_id()];
+
+    // Catch up on anything that came due while we were busy
+    ticket_lock(&wheel->lock);
+    irq_enter();
+    wheel_run(wheel, ktime_get_ns() >> TIMER_TICK_SHIFT, 0);
+    irq_exit();
+    wheel_program(wheel);
+    ticket_unlock(&wheel->lock);
+
+    // STI takes effect after the next instruction, so no wakeup is lost
+    asm volatile ("sti\n\thlt" : : : "memory");
+}
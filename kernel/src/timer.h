@@ -0,0 +1,94 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Hierarchical timing wheel. Level 0 has TIMER_WHEEL_SLOTS buckets of one
+ * tick (2^TIMER_TICK_SHIFT ns, about 16 us); each further level covers
+ * TIMER_WHEEL_SLOTS times the span of the one below. A timer is hashed into
+ * the lowest level whose window contains its expiry, and is moved down
+ * (cascaded) only when the clock reaches the start of its bucket, so insert
+ * and cancel are O(1). Timers further out than the top level are clamped to
+ * its last bucket and re-hashed as they come closer.
+ */
+#define TIMER_TICK_SHIFT  14
+#define TIMER_LEVEL_BITS  6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_LEVEL_BITS)
+#define TIMER_LEVELS      7
+
+struct timer;
+typedef void (*timer_fn_t)(struct timer *timer);
+
+struct timer {
+    struct timer *next;
+    struct timer **pprev;   // NULL while the timer is not pending
+    uint64_t expires;       // ktime_get_ns() deadline
+    uint64_t tick;          // Deadline in wheel ticks, rounded up
+    uint32_t cpu;           // Wheel the timer is queued on
+    timer_fn_t fn;
+    void *data;             // Free for the owner
+};
+
+/**
+ * timer_init - Set up this CPU's wheel and take over the APIC timer.
+ *
+ * Needs clocksource_init() and apic_init(). The hardware timer is only
+ * armed for the nearest pending expiry; with no timers it stays off.
+ */
+void timer_init(void);
+
+// Prepare a timer before its first timer_add()
+static inline void timer_setup(struct timer *timer, timer_fn_t fn, void *data) {
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->cpu = 0;
+    timer->fn = fn;
+    timer->data = data;
+}
+
+/**
+ * timer_add - Arm a timer, replacing any pending expiry.
+ *
+ * @timer: Timer prepared with timer_setup().
+ * @expires: Absolute deadline in ktime_get_ns() nanoseconds.
+ *
+ * The callback runs in softirq context on this CPU (see softirq.h), no
+ * earlier than @expires and usually within one tick of it. Deadlines in the past fire
+ * on the next timer interrupt. A timer pending on another CPU moves here.
+ * Safe to call from a timer callback, but not for the same timer from two
+ * CPUs at once.
+ */
+void timer_add(struct timer *timer, uint64_t expires);
+
+/**
+ * timer_cancel - Disarm a pending timer.
+ *
+ * @timer: Timer to cancel.
+ *
+ * Returns true if the timer was pending. Works from any CPU, but does not
+ * wait for a callback that is already running elsewhere. The hardware timer
+ * is left as is; an interrupt that finds nothing to do just re-arms it.
+ */
+bool timer_cancel(struct timer *timer);
+
+static inline bool timer_pending(const struct timer *timer) {
+    return timer->pprev != NULL;
+}
+
+// Time of the next wheel event (an expiry or a cascade) in ns, or
+// UINT64_MAX when the wheel is empty
+uint64_t timer_next_expiry(void);
+
+/**
+ * timer_idle - Sleep until the next interrupt.
+ *
+ * Runs any timers that are already due, arms the hardware for the nearest
+ * wheel deadline and halts with interrupts enabled. Before timer_init() it
+ * just halts and leaves the interrupt flag alone.
+ */
+void timer_idle(void);
+
+#endif // TIMER_H
@@ -0,0 +1,208 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "tlb.h"
+#include "cpu.h"
+#include "isr.h"
+#include "apic.h"
+#include "percpu.h"
+#include "spinlock.h"
+#include "clocksource.h"
+#include "text_renderer.h"
+
+_Static_assert(MAX_CPUS <= 64, "shootdown target mask is 64 bits");
+
+struct tlb_cpu tlb_cpus[MAX_CPUS];
+
+// The request being served; one initiator at a time
+static struct {
+    uint64_t pages[TLB_BATCH_MAX];
+    uint32_t count;
+    bool full;
+    uint64_t pending;               // CPUs that still have to flush
+} tlb_request;
+
+static LOCK_CLASS(tlb_lock_class, "tlb");
+static struct ticket_lock tlb_lock = TICKET_LOCK_INIT(tlb_lock_class);
+
+static uint64_t tlb_start_ns;
+
+static void flush_pages(const uint64_t *pages, uint32_t count, bool full) {
+    if (full) {
+        flush_tlb();
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++)
+        invlpg(pages[i]);
+}
+
+// Carry out the current request if it includes this CPU
+static void tlb_service(void) {
+    uint32_t cpu = this_cpu_id();
+    uint64_t bit = 1ULL << cpu;
+    if (!(__atomic_load_n(&tlb_request.pending, __ATOMIC_ACQUIRE) & bit))
+        return;
+    flush_pages(tlb_request.pages, tlb_request.count, tlb_request.full);
+    __atomic_fetch_and(&tlb_request.pending, ~bit, __ATOMIC_RELEASE);
+}
+
+static void tlb_ipi(struct isr_frame *frame) {
+    (void)frame;
+    tlb_cpus[this_cpu_id()].ipis_received++;
+    tlb_service();
+    apic_eoi();
+}
+
+void tlb_init_cpu(void) {
+    struct tlb_cpu *tc = &tlb_cpus[this_cpu_id()];
+    if (!tlb_start_ns)
+        tlb_start_ns = ktime_get_ns();
+    isr_register(TLB_IPI_VECTOR, tlb_ipi);
+
+    // Shootdowns skipped this CPU until now; drop what it cached meanwhile
+    __atomic_store_n(&tc->state, TLB_ACTIVE, __ATOMIC_SEQ_CST);
+    flush_tlb();
+}
+
+void tlb_queue_page(uint64_t virt_addr) {
+    invlpg(virt_addr);
+
+    uint64_t flags = irq_save();
+    struct tlb_cpu *tc = &tlb_cpus[this_cpu_id()];
+    if (tc->count < TLB_BATCH_MAX)
+        tc->pages[tc->count++] = virt_addr;
+    else
+        tc->full = true;
+    irq_restore(flags);
+}
+
+/*
+ * Decide whether @cpu needs an IPI. A lazy CPU is flipped to stale with a
+ * CAS on the same word it swaps back to active when it wakes, so either
+ * it sees the stale mark and flushes, or we see it active and send an IPI.
+ */
+static bool tlb_needs_ipi(struct tlb_cpu *tc) {
+    uint32_t state = __atomic_load_n(&tc->state, __ATOMIC_SEQ_CST);
+    for (;;) {
+        if (state == TLB_OFFLINE || state == TLB_LAZY_STALE)
+            return false;
+        if (state == TLB_ACTIVE)
+            return true;
+        if (__atomic_compare_exchange_n(&tc->state, &state, TLB_LAZY_STALE, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            return false;
+    }
+}
+
+void tlb_flush_queued(void) {
+    uint64_t flags = irq_save();
+    uint32_t self = this_cpu_id();
+    struct tlb_cpu *tc = &tlb_cpus[self];
+    if (tc->batch_depth || (!tc->count && !tc->full)) {
+        irq_restore(flags);
+        return;
+    }
+
+    // Another initiator may be waiting for us meanwhile
+    while (!ticket_trylock(&tlb_lock)) {
+        tlb_service();
+        asm volatile ("pause");
+    }
+
+    for (uint32_t i = 0; i < tc->count; i++)
+        tlb_request.pages[i] = tc->pages[i];
+    tlb_request.count = tc->count;
+    tlb_request.full = tc->full;
+    tc->count = 0;
+    tc->full = false;
+
+    uint64_t targets = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++)
+        if (cpu != self && tlb_needs_ipi(&tlb_cpus[cpu]))
+            targets |= 1ULL << cpu;
+
+    if (targets) {
+        __atomic_store_n(&tlb_request.pending, targets, __ATOMIC_RELEASE);
+        for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+            if (targets & (1ULL << cpu)) {
+                apic_send_ipi(percpu_areas[cpu].apic_id, TLB_IPI_VECTOR);
+                tc->ipis_sent++;
+            }
+        }
+        while (__atomic_load_n(&tlb_request.pending, __ATOMIC_ACQUIRE))
+            asm volatile ("pause");
+
+        tc->shootdowns++;
+        tc->pages_shot += tlb_request.full ? TLB_BATCH_MAX : tlb_request.count;
+    }
+
+    ticket_unlock(&tlb_lock);
+    irq_restore(flags);
+}
+
+void tlb_batch_begin(void) {
+    tlb_cpus[this_cpu_id()].batch_depth++;
+}
+
+void tlb_batch_end(void) {
+    if (--tlb_cpus[this_cpu_id()].batch_depth == 0)
+        tlb_flush_queued();
+}
+
+// Back to active; flush everything if a shootdown passed us by
+static void tlb_wake(struct tlb_cpu *tc) {
+    if (__atomic_exchange_n(&tc->state, TLB_ACTIVE, __ATOMIC_SEQ_CST) == TLB_LAZY_STALE) {
+        flush_tlb();
+        tc->lazy_flushes++;
+    }
+}
+
+void tlb_idle_enter(void) {
+    __atomic_store_n(&tlb_cpus[this_cpu_id()].state, TLB_LAZY, __ATOMIC_SEQ_CST);
+}
+
+void tlb_idle_exit(void) {
+    tlb_wake(&tlb_cpus[this_cpu_id()]);
+}
+
+void tlb_irq_enter_lazy(void) {
+    struct tlb_cpu *tc = &tlb_cpus[this_cpu_id()];
+    tlb_wake(tc);
+    tc->irq_from_lazy = true;
+}
+
+void tlb_irq_exit_lazy(void) {
+    struct tlb_cpu *tc = &tlb_cpus[this_cpu_id()];
+    tc->irq_from_lazy = false;
+    __atomic_store_n(&tc->state, TLB_LAZY, __ATOMIC_SEQ_CST);
+}
+
+void tlb_get_stats(uint32_t cpu, struct tlb_stats *stats) {
+    struct tlb_cpu *tc = &tlb_cpus[cpu];
+    stats->shootdowns = tc->shootdowns;
+    stats->pages = tc->pages_shot;
+    stats->ipis_sent = tc->ipis_sent;
+    stats->ipis_received = tc->ipis_received;
+    stats->lazy_flushes = tc->lazy_flushes;
+}
+
+void tlb_dump_stats(void) {
+    struct tlb_stats total = { 0 };
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        struct tlb_stats stats;
+        tlb_get_stats(cpu, &stats);
+        total.shootdowns += stats.shootdowns;
+        total.pages += stats.pages;
+        total.ipis_sent += stats.ipis_sent;
+        total.ipis_received += stats.ipis_received;
+        total.lazy_flushes += stats.lazy_flushes;
+    }
+
+    uint64_t elapsed_ns = ktime_get_ns() - tlb_start_ns;
+    kprintf("TLB shootdowns: %lu (%lu/s), %lu.%02lu pages each, %lu IPIs sent, %lu received, "
+            "%lu lazy flushes\n",
+            total.shootdowns, elapsed_ns ? total.shootdowns * NSEC_PER_SEC / elapsed_ns : 0,
+            total.shootdowns ? total.pages / total.shootdowns : 0,
+            total.shootdowns ? total.pages * 100 / total.shootdowns % 100 : 0,
+            total.ipis_sent, total.ipis_received, total.lazy_flushes);
+}
@@ -0,0 +1,112 @@
+#ifndef TLB_H
+#define TLB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu.h"
+
+/*
+ * Cross-CPU TLB shootdown. All CPUs share the kernel page tables, so a PTE
+ * that is cleared or downgraded must also be flushed from every other CPU
+ * that may have cached it. Invalidations are flushed locally right away and
+ * queued per CPU; tlb_flush_queued() then sends one request covering all
+ * of them, with one IPI to each CPU that is running, and waits until every
+ * one of them has flushed.
+ *
+ * An idle CPU is in lazy mode: instead of an IPI it is marked stale and
+ * flushes its whole TLB when it wakes up (or takes an interrupt).
+ */
+
+// IPI that asks a CPU to carry out the pending shootdown
+#define TLB_IPI_VECTOR 0xF2
+
+// Pages per batch; a bigger batch becomes a full flush
+#define TLB_BATCH_MAX 32
+
+// Per-CPU lazy TLB state
+#define TLB_OFFLINE    0
+#define TLB_ACTIVE     1
+#define TLB_LAZY       2
+#define TLB_LAZY_STALE 3    // Idle, and something changed meanwhile
+
+struct tlb_cpu {
+    uint64_t pages[TLB_BATCH_MAX];  // Queued, already flushed locally
+    uint32_t count;
+    bool full;                      // Queue overflowed: flush everything
+    uint32_t batch_depth;           // tlb_batch_begin() nesting
+    uint32_t state;
+    bool irq_from_lazy;
+    uint64_t shootdowns;            // Requests sent to other CPUs
+    uint64_t pages_shot;            // Pages covered by them (TLB_BATCH_MAX for a full flush)
+    uint64_t ipis_sent;
+    uint64_t ipis_received;
+    uint64_t lazy_flushes;          // Full flushes on leaving lazy mode
+} __attribute__((aligned(64)));
+
+extern struct tlb_cpu tlb_cpus[MAX_CPUS];
+
+struct tlb_stats {
+    uint64_t shootdowns;
+    uint64_t pages;
+    uint64_t ipis_sent;
+    uint64_t ipis_received;
+    uint64_t lazy_flushes;
+};
+
+/**
+ * tlb_init_cpu - Let the executing CPU take part in shootdowns.
+ *
+ * Needs the local APIC and percpu_areas[] apic_id of this CPU.
+ */
+void tlb_init_cpu(void);
+
+/**
+ * tlb_queue_page - Invalidate a page here and queue it for the other CPUs.
+ *
+ * @virt_addr: Page whose PTE was cleared or changed.
+ *
+ * Safe with interrupts disabled and under spinlocks. Nothing reaches the
+ * other CPUs until tlb_flush_queued().
+ */
+void tlb_queue_page(uint64_t virt_addr);
+
+/**
+ * tlb_flush_queued - Shoot down everything queued on this CPU.
+ *
+ * Returns once every other active CPU has flushed. Does nothing inside a
+ * tlb_batch_begin()/tlb_batch_end() pair. Must not be called with a
+ * spinlock held: a CPU spinning on it with interrupts disabled could not
+ * answer the IPI.
+ */
+void tlb_flush_queued(void);
+
+// Collect the shootdowns of several page table updates into one; the
+// outermost tlb_batch_end() sends it
+void tlb_batch_begin(void);
+void tlb_batch_end(void);
+
+// Enter and leave lazy mode around the halt in the idle loop
+void tlb_idle_enter(void);
+void tlb_idle_exit(void);
+
+// Leave lazy mode for an interrupt; called by irq_enter()/irq_exit()
+void tlb_irq_enter_lazy(void);
+void tlb_irq_exit_lazy(void);
+
+static inline void tlb_irq_enter(void) {
+    if (tlb_cpus[this_cpu_id()].state >= TLB_LAZY)
+        tlb_irq_enter_lazy();
+}
+
+static inline void tlb_irq_exit(void) {
+    if (tlb_cpus[this_cpu_id()].irq_from_lazy)
+        tlb_irq_exit_lazy();
+}
+
+// Counters of one CPU
+void tlb_get_stats(uint32_t cpu, struct tlb_stats *stats);
+
+// Print shootdowns per second, pages per shootdown and the IPI counts
+void tlb_dump_stats(void);
+
+#endif // TLB_H
@@ -0,0 +1,84 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "trace.h"
+#include "clocksource.h"
+#include "cpu.h"
+#include "serial.h"
+#include "klog.h"
+#include "printf.h"
+
+_Static_assert(sizeof(struct trace_record) == 32, "trace_decode.py expects 32-byte records");
+
+// Per-CPU flight recorder; head counts every record ever written
+struct trace_ring {
+    struct trace_record rec[TRACE_RING_RECORDS];
+    volatile uint64_t head;
+};
+
+static struct trace_ring trace_rings[MAX_CPUS];
+
+volatile bool trace_enabled = false;
+
+void trace_record_event(uint16_t event, uint64_t arg0, uint64_t arg1) {
+    uint32_t cpu = this_cpu_id();
+    struct trace_ring *ring = &trace_rings[cpu];
+
+    // Only this CPU writes the ring; the atomic add keeps a nested
+    // interrupt from claiming the same slot.
+    uint64_t idx = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    struct trace_record *rec = &ring->rec[idx % TRACE_RING_RECORDS];
+
+    rec->tsc = rdtsc();
+    rec->event = event;
+    rec->cpu = cpu;
+    rec->reserved = 0;
+    rec->arg0 = arg0;
+    rec->arg1 = arg1;
+}
+
+void trace_enable(void) {
+    trace_enabled = true;
+}
+
+void trace_disable(void) {
+    trace_enabled = false;
+}
+
+void trace_dump(void) {
+    bool was_enabled = trace_enabled;
+    trace_enabled = false;
+
+    // Keep pending log text from interleaving with the dump
+    klog_drain();
+
+    char line[80];
+    int len = snprintf(line, sizeof(line), "TRACE-BEGIN %lu %lu\n",
+                       tsc_hz(), sizeof(struct trace_record));
+    serial_write(line, len);
+
+    uint64_t written = 0;
+    uint64_t lost = 0;
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        struct trace_ring *ring = &trace_rings[cpu];
+        uint64_t head = ring->head;
+        uint64_t first = head > TRACE_RING_RECORDS ? head - TRACE_RING_RECORDS : 0;
+        lost += first;
+
+        for (uint64_t i = first; i < head; i++) {
+            const uint8_t *bytes = (const uint8_t *)&ring->rec[i % TRACE_RING_RECORDS];
+            for (size_t b = 0; b < sizeof(struct trace_record); b++) {
+                line[b * 2] = "0123456789abcdef"[bytes[b] >> 4];
+                line[b * 2 + 1] = "0123456789abcdef"[bytes[b] & 0xF];
+            }
+            line[sizeof(struct trace_record) * 2] = '\n';
+            serial_write(line, sizeof(struct trace_record) * 2 + 1);
+            written++;
+        }
+    }
+
+    len = snprintf(line, sizeof(line), "TRACE-END %lu %lu\n", written, lost);
+    serial_write(line, len);
+
+    trace_enabled = was_enabled;
+}
@@ -0,0 +1,70 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Event IDs. tools/trace_decode.py keeps a copy of this table; add new
+ * events at the end and update both.
+ */
+enum trace_event {
+    TRACE_PMM_ALLOC = 1,    // arg0: physical address returned
+    TRACE_PMM_FREE,         // arg0: physical address freed
+    TRACE_VMM_MAP,          // arg0: virtual address, arg1: physical address | flags
+    TRACE_VMM_UNMAP,        // arg0: virtual address
+    TRACE_PAGE_FAULT,       // arg0: faulting address, arg1: error code
+};
+
+// One 32-byte binary record
+struct trace_record {
+    uint64_t tsc;
+    uint16_t event;
+    uint16_t cpu;
+    uint32_t reserved;
+    uint64_t arg0;
+    uint64_t arg1;
+};
+
+// Records per CPU ring (power of two); the oldest records are overwritten
+#define TRACE_RING_RECORDS 2048
+
+extern volatile bool trace_enabled;
+
+// Append a record to the executing CPU's ring (use the trace() macro)
+void trace_record_event(uint16_t event, uint64_t arg0, uint64_t arg1);
+
+/*
+ * Tracepoint. While tracing is off this costs one predicted-not-taken
+ * branch on a global flag; build with -DNO_TRACE to compile them out.
+ */
+#ifdef NO_TRACE
+#define trace(event, arg0, arg1) do { } while (0)
+#else
+#define trace(event, arg0, arg1)                                        \
+    do {                                                                \
+        if (__builtin_expect(trace_enabled, 0))                         \
+            trace_record_event((event), (uint64_t)(arg0), (uint64_t)(arg1)); \
+    } while (0)
+#endif
+
+// Start and stop recording
+void trace_enable(void);
+void trace_disable(void);
+
+/**
+ * trace_dump - Write all rings to the serial port.
+ *
+ * Output is line based so it survives a text capture of COM1:
+ *
+ *   TRACE-BEGIN <tsc_hz> <record_size>
+ *   <64 hex digits: one record, little endian>
+ *   ...
+ *   TRACE-END <records> <overwritten>
+ *
+ * tools/trace_decode.py turns it into text or Chrome trace JSON.
+ * Tracing is disabled while dumping.
+ */
+void trace_dump(void);
+
+#endif // TRACE_H
@@ -1,17 +1,17 @@
 #include "vmm_mngr.h"
+#include "cpu.h"
 #include "limine_requests.h"  // for hhdm_request
 #include "pmm_mngr.h"
+#include "trace.h"
+#include "string.h"
+#include "spinlock.h"
+#include "tlb.h"
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
 
-
-/* Zero out one page of memory. */
-static void zero_page(void *addr) {
-    uint8_t *p = (uint8_t *)addr;
-    for (size_t i = 0; i < PAGE_SIZE; i++)
-        p[i] = 0;
-}
+static LOCK_CLASS(vmm_lock_class, "vmm");
+struct ticket_lock vmm_lock = TICKET_LOCK_INIT(vmm_lock_class);
 
 /**
  * get_pte_ptr - Get pointer to the page table entry (PTE) for a given virtual address.
@@ -25,12 +25,8 @@ uint64_t *get_pte_ptr(virt_addr_t virt_addr) {
     uint16_t pdpt_idx = (virt_addr >> 30) & 0x1FF;
     uint16_t pd_idx   = (virt_addr >> 21) & 0x1FF;
     uint16_t pt_idx   = (virt_addr >> 12) & 0x1FF;
-    
-    return (uint64_t *)(RECURSIVE_BASE |
-           ((uint64_t)pml4_idx << 30) |
-           ((uint64_t)pdpt_idx << 21) |
-           ((uint64_t)pd_idx   << 12) |
-           (pt_idx * sizeof(uint64_t)));
+
+    return &RECURSIVE_PT(pml4_idx, pdpt_idx, pd_idx)[pt_idx];
 }
 
 /**
@@ -40,7 +36,7 @@ uint64_t *get_pte_ptr(virt_addr_t virt_addr) {
  * intermediate table (PDPT, PD, or PT), allocates a new page, zeroes it, and
  * installs it with PAGE_PRESENT and PAGE_WRITE. Finally, sets the page table entry
  * for the virtual address to map to the provided physical address along with the
- * given flags.
+ * given flags. Replacing a present mapping shoots it down on the other CPUs.
  */
 void vmm_map_recursive(virt_addr_t virt_addr, phys_addr_t phys_addr, uint64_t flags) {
     /* Extract indices for each level */
@@ -49,57 +45,68 @@ void vmm_map_recursive(virt_addr_t virt_addr, phys_addr_t phys_addr, uint64_t fl
     uint16_t pd_idx   = (virt_addr >> 21) & 0x1FF;
     uint16_t pt_idx   = (virt_addr >> 12) & 0x1FF;
 
-    /* The recursive mapping makes the current PML4 available at RECURSIVE_BASE */
-    uint64_t *pml4 = (uint64_t *)RECURSIVE_BASE;
+    uint64_t lock_flags = ticket_lock_irqsave(&vmm_lock);
+
+    /* The recursive mapping makes the current PML4 available at RECURSIVE_PML4 */
+    uint64_t *pml4 = RECURSIVE_PML4;
 
     /* Ensure the PDPT exists: if not, allocate one */
     if (!(pml4[pml4_idx] & PAGE_PRESENT)) {
         phys_addr_t new_pdpt_phys = pmm_alloc();
         uint64_t *new_pdpt = (uint64_t *)(HHDM_OFFSET + new_pdpt_phys);
-        zero_page(new_pdpt);
+        clear_page(new_pdpt);
         pml4[pml4_idx] = new_pdpt_phys | PAGE_PRESENT | PAGE_WRITE;
     }
     /* Access the PDPT table using recursive mapping */
-    uint64_t *pdpt = (uint64_t *)(RECURSIVE_BASE | ((uint64_t)pml4_idx << 30));
+    uint64_t *pdpt = RECURSIVE_PDPT(pml4_idx);
 
     /* Ensure the PD exists */
     if (!(pdpt[pdpt_idx] & PAGE_PRESENT)) {
         phys_addr_t new_pd_phys = pmm_alloc();
         uint64_t *new_pd = (uint64_t *)(HHDM_OFFSET + new_pd_phys);
-        zero_page(new_pd);
+        clear_page(new_pd);
         pdpt[pdpt_idx] = new_pd_phys | PAGE_PRESENT | PAGE_WRITE;
     }
     /* Access the PD table using recursive mapping */
-    uint64_t *pd = (uint64_t *)(RECURSIVE_BASE | ((uint64_t)pml4_idx << 30) |
-                                         ((uint64_t)pdpt_idx << 21));
+    uint64_t *pd = RECURSIVE_PD(pml4_idx, pdpt_idx);
 
     /* Ensure the PT exists */
     if (!(pd[pd_idx] & PAGE_PRESENT)) {
         phys_addr_t new_pt_phys = pmm_alloc();
         uint64_t *new_pt = (uint64_t *)(HHDM_OFFSET + new_pt_phys);
-        zero_page(new_pt);
+        clear_page(new_pt);
         pd[pd_idx] = new_pt_phys | PAGE_PRESENT | PAGE_WRITE;
     }
     /* Access the PT table using recursive mapping */
-    uint64_t *pt = (uint64_t *)(RECURSIVE_BASE | ((uint64_t)pml4_idx << 30) |
-                                         ((uint64_t)pdpt_idx << 21) |
-                                         ((uint64_t)pd_idx   << 12));
+    uint64_t *pt = RECURSIVE_PT(pml4_idx, pdpt_idx, pd_idx);
 
     /* Set the page table entry: physical address with given flags, plus present bit */
+    bool was_present = pt[pt_idx] & PAGE_PRESENT;
     pt[pt_idx] = phys_addr | flags | PAGE_PRESENT;
+    trace(TRACE_VMM_MAP, virt_addr, pt[pt_idx]);
 
-    /* Invalidate the TLB for the virtual address */
-    asm volatile ("invlpg (%0)" : : "r" (virt_addr) : "memory");
+    /* Only a replaced mapping can be cached anywhere; an empty slot never is */
+    if (was_present)
+        tlb_queue_page(virt_addr);
+    else
+        invlpg(virt_addr);
+    ticket_unlock_irqrestore(&vmm_lock, lock_flags);
+    tlb_flush_queued();
 }
 
 /**
  * vmm_unmap_recursive - Unmap a virtual address.
  *
  * Retrieves the page table entry using get_pte_ptr() and clears it. It then flushes
- * the TLB entry for that virtual address.
+ * the TLB entry for that virtual address on every CPU (see tlb.h).
  */
 void vmm_unmap_recursive(virt_addr_t virt_addr) {
     uint64_t *pte = get_pte_ptr(virt_addr);
+    trace(TRACE_VMM_UNMAP, virt_addr, 0);
+
+    uint64_t lock_flags = ticket_lock_irqsave(&vmm_lock);
     *pte = 0;
-    asm volatile ("invlpg (%0)" : : "r" (virt_addr) : "memory");
+    tlb_queue_page(virt_addr);
+    ticket_unlock_irqrestore(&vmm_lock, lock_flags);
+    tlb_flush_queued();
 }
@@ -5,6 +5,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include "limine_requests.h"
+#include "spinlock.h"
 
 /* Page size definition */
 #define PAGE_SIZE 4096
@@ -13,7 +14,10 @@
 #define PAGE_PRESENT 0x1
 #define PAGE_WRITE   0x2
 #define PAGE_USER    0x4
+#define PAGE_PWT     0x8    /* PAT index bit 0 */
+#define PAGE_PCD     0x10   /* PAT index bit 1 */
 #define PAGE_SIZE_2MB 0x80
+#define PAGE_PAT     0x80   /* PAT index bit 2 (4 KiB PTEs only) */
 
 /* PML4 indices reserved for specific purposes */
 #define RECURSIVE_INDEX 510   /* Used for the self-referencing (recursive) mapping */
@@ -22,13 +26,32 @@
 
 #define STACK_INDEX     257   /* Used for stack mappings */
 #define FRAMEBUFFER_INDEX 258 /* Used for framebuffer mappings */
+#define IOREMAP_INDEX   259   /* Used for ioremap() MMIO mappings */
 
 
 /* Define the HHDM offset (adjust this based on your system's configuration) */
 #define HHDM_OFFSET (hhdm_request.response->offset)
 
-/* Base address for the recursive mapping region */
-#define RECURSIVE_BASE ((uint64_t)RECURSIVE_INDEX << 39)
+/* Base address for the recursive mapping region (sign extended, bit 47 is set) */
+#define RECURSIVE_BASE (0xFFFF000000000000ULL | ((uint64_t)RECURSIVE_INDEX << 39))
+
+/*
+ * Virtual addresses of the paging structures through the recursive slot.
+ * Every extra pass through PML4[RECURSIVE_INDEX] lifts the view one level up.
+ * The hosted test build supplies its own RECURSIVE_PT that walks simulated
+ * tables in software.
+ */
+#ifndef RECURSIVE_PT
+#define RECURSIVE_PT(pml4_idx, pdpt_idx, pd_idx) \
+    ((uint64_t *)(RECURSIVE_BASE | ((uint64_t)(pml4_idx) << 30) | \
+                  ((uint64_t)(pdpt_idx) << 21) | ((uint64_t)(pd_idx) << 12)))
+#endif
+#define RECURSIVE_PD(pml4_idx, pdpt_idx) \
+    RECURSIVE_PT(RECURSIVE_INDEX, (pml4_idx), (pdpt_idx))
+#define RECURSIVE_PDPT(pml4_idx) \
+    RECURSIVE_PT(RECURSIVE_INDEX, RECURSIVE_INDEX, (pml4_idx))
+#define RECURSIVE_PML4 \
+    RECURSIVE_PT(RECURSIVE_INDEX, RECURSIVE_INDEX, RECURSIVE_INDEX)
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,6 +60,13 @@ extern "C" {
 /* Assume phys_addr_t is defined in pmm_mngr.h */
 typedef uint64_t virt_addr_t;
 
+/*
+ * Serializes changes to the page tables reached through the recursive slot.
+ * Taken with interrupts disabled; pmm_alloc() nests inside it, never the
+ * other way round.
+ */
+extern struct ticket_lock vmm_lock;
+
 /**
  * get_pte_ptr - Get pointer to the page table entry for a given virtual address.
  *
@@ -66,7 +96,9 @@ void vmm_map_recursive(uint64_t virt_addr, uint64_t phys_addr, uint64_t flags);
  *
  * @virt_addr: The virtual address to unmap.
  *
- * This function clears the page table entry corresponding to the virtual address.
+ * This function clears the page table entry corresponding to the virtual address
+ * and shoots it down on the other CPUs, so it must not be called with a
+ * spinlock held.
  */
 void vmm_unmap_recursive(uint64_t virt_addr);
 
@@ -1,8 +1,10 @@
 #include "vmm_mngr.h"
+#include "cpu.h"
 #include "pmm_mngr.h"
 #include "limine_requests.h"
 #include "vmm_mngr_utils.h"
 #include "text_renderer.h"
+#include "tlb.h"
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
@@ -35,13 +37,16 @@ void vmm_map_range(virt_addr_t start, size_t size, phys_addr_t phys_start, uint6
  * @start: The starting virtual address.
  * @size:  The size of the region in bytes.
  *
- * Unmaps each page in the region by calling vmm_unmap_recursive.
+ * Unmaps each page in the region by calling vmm_unmap_recursive. The other
+ * CPUs get one shootdown for the whole range.
  */
 void vmm_unmap_range(virt_addr_t start, size_t size) {
     size_t num_pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    tlb_batch_begin();
     for (size_t i = 0; i < num_pages; i++) {
         vmm_unmap_recursive(start + i * PAGE_SIZE);
     }
+    tlb_batch_end();
 }
 
 /**
@@ -70,15 +75,18 @@ mapping_info_t vmm_query_mapping(virt_addr_t virt_addr) {
  * @new_flags:  The new flag bits (besides PAGE_PRESENT) to apply.
  *
  * This function preserves the physical address stored in the PTE while replacing
- * the flag bits.
+ * the flag bits, and shoots the old entry down on every CPU.
  */
 void vmm_change_flags(virt_addr_t virt_addr, uint64_t new_flags) {
     uint64_t *pte = get_pte_ptr(virt_addr);
+    uint64_t lock_flags = ticket_lock_irqsave(&vmm_lock);
     if (*pte & PAGE_PRESENT) {
         phys_addr_t phys_addr = *pte & ~((uint64_t)0xFFF);
         *pte = phys_addr | new_flags | PAGE_PRESENT;
-        asm volatile ("invlpg (%0)" : : "r" (virt_addr) : "memory");
+        tlb_queue_page(virt_addr);
     }
+    ticket_unlock_irqrestore(&vmm_lock, lock_flags);
+    tlb_flush_queued();
 }
 
 /**
@@ -88,25 +96,22 @@ void vmm_change_flags(virt_addr_t virt_addr, uint64_t new_flags) {
  * levels (PDPT, PD, PT) via the recursive mapping and prints out non-empty entries.
  */
 void vmm_dump_page_tables(void) {
-    uint64_t *pml4 = (uint64_t *)RECURSIVE_BASE;
+    uint64_t *pml4 = RECURSIVE_PML4;
     for (int pml4_idx = 0; pml4_idx < 512; pml4_idx++) {
         if (pml4[pml4_idx] & PAGE_PRESENT) {
             kprintf("PML4[%d] = 0x%lx\n", pml4_idx, pml4[pml4_idx]);
             // Skip the recursive mapping entry to avoid infinite recursion.
             if (pml4_idx == RECURSIVE_INDEX)
                 continue;
-            uint64_t *pdpt = (uint64_t *)(RECURSIVE_BASE | ((uint64_t)pml4_idx << 30));
+            uint64_t *pdpt = RECURSIVE_PDPT(pml4_idx);
             for (int pdpt_idx = 0; pdpt_idx < 512; pdpt_idx++) {
                 if (pdpt[pdpt_idx] & PAGE_PRESENT) {
                     kprintf("  PDPT[%d] = 0x%lx\n", pdpt_idx, pdpt[pdpt_idx]);
-                    uint64_t *pd = (uint64_t *)(RECURSIVE_BASE | ((uint64_t)pml4_idx << 30) |
-                                                    ((uint64_t)pdpt_idx << 21));
+                    uint64_t *pd = RECURSIVE_PD(pml4_idx, pdpt_idx);
                     for (int pd_idx = 0; pd_idx < 512; pd_idx++) {
                         if (pd[pd_idx] & PAGE_PRESENT) {
                             kprintf("    PD[%d] = 0x%lx\n", pd_idx, pd[pd_idx]);
-                            uint64_t *pt = (uint64_t *)(RECURSIVE_BASE | ((uint64_t)pml4_idx << 30) |
-                                                            ((uint64_t)pdpt_idx << 21) |
-                                                            ((uint64_t)pd_idx << 12));
+                            uint64_t *pt = RECURSIVE_PT(pml4_idx, pdpt_idx, pd_idx);
                             for (int pt_idx = 0; pt_idx < 512; pt_idx++) {
                                 if (pt[pt_idx] & PAGE_PRESENT) {
                                     kprintf("      PT[%d] = 0x%lx\n", pt_idx, pt[pt_idx]);
@@ -0,0 +1,147 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "workqueue.h"
+#include "cpu.h"
+#include "sched.h"
+#include "klog.h"
+#include "text_renderer.h"
+
+struct work_cpu {
+    struct work *head;          // Pushed by queue_work_on() from any CPU, newest first
+    uint8_t pad[56];            // Keep remote pushes off the owner's line
+    struct work *local;         // Taken from head, oldest first; owner only
+    struct thread *worker;
+    uint32_t depth;
+    uint32_t max_depth;
+    uint64_t queued;
+    uint64_t run;
+    uint64_t cycles;
+    uint64_t batches;
+    uint64_t wakeups;
+} __attribute__((aligned(64)));
+
+static struct work_cpu work_cpus[MAX_CPUS];
+
+bool queue_work_on(uint32_t cpu, struct work *work) {
+    if (__atomic_exchange_n(&work->pending, 1, __ATOMIC_ACQUIRE))
+        return false;
+
+    struct work_cpu *wc = &work_cpus[cpu];
+    uint32_t depth = __atomic_add_fetch(&wc->depth, 1, __ATOMIC_RELAXED);
+    uint32_t max = __atomic_load_n(&wc->max_depth, __ATOMIC_RELAXED);
+    while (depth > max && !__atomic_compare_exchange_n(&wc->max_depth, &max, depth, true,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    __atomic_fetch_add(&wc->queued, 1, __ATOMIC_RELAXED);
+
+    struct work *head = __atomic_load_n(&wc->head, __ATOMIC_RELAXED);
+    do {
+        work->next = head;
+    } while (!__atomic_compare_exchange_n(&wc->head, &head, work, true,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+    // Only the first item needs a wakeup: the worker does not block while
+    // it can see any in head
+    if (!head && wc->worker) {
+        __atomic_fetch_add(&wc->wakeups, 1, __ATOMIC_RELAXED);
+        sched_wake(wc->worker);
+    }
+    return true;
+}
+
+bool queue_work(struct work *work) {
+    uint64_t flags = irq_save();
+    bool queued = queue_work_on(this_cpu_id(), work);
+    irq_restore(flags);
+    return queued;
+}
+
+// Next item to run on the owning CPU, NULL when the queue is empty
+static struct work *work_take(struct work_cpu *wc) {
+    uint64_t flags = irq_save();
+    if (!wc->local) {
+        struct work *list = __atomic_exchange_n(&wc->head, NULL, __ATOMIC_SEQ_CST);
+        while (list) {
+            struct work *next = list->next;
+            list->next = wc->local;
+            wc->local = list;
+            list = next;
+        }
+    }
+    struct work *work = wc->local;
+    if (work) {
+        wc->local = work->next;
+        __atomic_sub_fetch(&wc->depth, 1, __ATOMIC_RELAXED);
+    }
+    irq_restore(flags);
+    return work;
+}
+
+// Run up to @max items; returns how many ran
+static uint32_t work_run(struct work_cpu *wc, uint32_t max) {
+    uint32_t ran = 0;
+    struct work *work;
+    while (ran < max && (work = work_take(wc))) {
+        __atomic_store_n(&work->pending, 0, __ATOMIC_RELEASE);
+        uint64_t start = rdtsc();
+        work->func(work);
+        wc->cycles += rdtsc() - start;
+        wc->run++;
+        ran++;
+    }
+    return ran;
+}
+
+static void worker(void *arg) {
+    struct work_cpu *wc = arg;
+    for (;;) {
+        if (work_run(wc, WORK_BATCH) < WORK_BATCH) {
+            // A queue_work_on() after the last look wakes us again
+            if (!__atomic_load_n(&wc->head, __ATOMIC_SEQ_CST) && !wc->local)
+                sched_block();
+            continue;
+        }
+        wc->batches++;
+        sched_yield();
+    }
+}
+
+void workqueue_flush(void) {
+    struct work_cpu *wc = &work_cpus[this_cpu_id()];
+    while (work_run(wc, WORK_BATCH))
+        ;
+}
+
+void workqueue_init_cpu(void) {
+    struct work_cpu *wc = &work_cpus[this_cpu_id()];
+    struct thread *thread = thread_create_pinned(worker, wc, "kworker");
+    if (!thread)
+        panic("Cannot start kworker\n");
+    __atomic_store_n(&wc->worker, thread, __ATOMIC_RELEASE);
+}
+
+void workqueue_get_stats(uint32_t cpu, struct workqueue_stats *stats) {
+    struct work_cpu *wc = &work_cpus[cpu];
+    stats->queued = __atomic_load_n(&wc->queued, __ATOMIC_RELAXED);
+    stats->run = wc->run;
+    stats->cycles = wc->cycles;
+    stats->batches = wc->batches;
+    stats->wakeups = __atomic_load_n(&wc->wakeups, __ATOMIC_RELAXED);
+    stats->depth = __atomic_load_n(&wc->depth, __ATOMIC_RELAXED);
+    stats->max_depth = __atomic_load_n(&wc->max_depth, __ATOMIC_RELAXED);
+}
+
+void workqueue_dump_stats(void) {
+    kprintf("Workqueue statistics:\n");
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        struct workqueue_stats stats;
+        workqueue_get_stats(cpu, &stats);
+        if (!stats.queued)
+            continue;
+        kprintf("  CPU %u: %lu queued, %lu run, %lu cycles avg, depth %u (max %u), "
+                "%lu wakeups, %lu batches\n",
+                cpu, stats.queued, stats.run, stats.run ? stats.cycles / stats.run : 0,
+                stats.depth, stats.max_depth, stats.wakeups, stats.batches);
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Per-CPU workqueues for deferred work that runs in thread context: each
+ * CPU has a worker thread that may block and is scheduled like any other.
+ * Items can be queued from anywhere, including hard IRQ and softirq
+ * handlers, with one CAS; the worker takes the whole list at once and runs
+ * it in FIFO order. After WORK_BATCH items it yields, so a flood of work
+ * shares the CPU with the other runnable threads instead of starving them.
+ */
+
+// Items a worker runs before it lets other threads in
+#define WORK_BATCH 16
+
+struct work;
+typedef void (*work_fn_t)(struct work *work);
+
+struct work {
+    struct work *next;
+    work_fn_t func;
+    void *data;                 // Free for the owner
+    volatile uint32_t pending;  // Queued and not yet started
+};
+
+// Prepare a work item before its first queue_work()
+static inline void work_setup(struct work *work, work_fn_t func, void *data) {
+    work->next = NULL;
+    work->func = func;
+    work->data = data;
+    work->pending = 0;
+}
+
+/**
+ * queue_work_on - Queue an item on a CPU's workqueue.
+ *
+ * @cpu:  CPU whose worker runs it.
+ * @work: Item prepared with work_setup().
+ *
+ * Returns false if the item was already pending; it then runs only once.
+ * The pending flag is cleared just before @work->func is called, so the
+ * function may queue its own item again. Safe from any context and CPU.
+ */
+bool queue_work_on(uint32_t cpu, struct work *work);
+
+// queue_work_on() the calling CPU
+bool queue_work(struct work *work);
+
+/**
+ * workqueue_flush - Run this CPU's queued work in the calling thread.
+ *
+ * Returns once the queue was found empty. Thread context only; for code
+ * that must see its work done before it goes on.
+ */
+void workqueue_flush(void);
+
+// Start this CPU's worker; called by sched_init_cpu()
+void workqueue_init_cpu(void);
+
+struct workqueue_stats {
+    uint64_t queued;
+    uint64_t run;
+    uint64_t cycles;            // TSC cycles spent in work functions
+    uint64_t batches;           // Times the worker yielded with work left
+    uint64_t wakeups;           // Worker wakeups sent by queue_work_on()
+    uint32_t depth;             // Items queued right now
+    uint32_t max_depth;
+};
+
+void workqueue_get_stats(uint32_t cpu, struct workqueue_stats *stats);
+
+// Print the counters of every CPU that queued something
+void workqueue_dump_stats(void);
+
+#endif // WORKQUEUE_H
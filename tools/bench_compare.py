@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""Extract kernel benchmark results from a COM1 capture and compare them
+with a stored baseline (see kernel/src/bench.c and `make bench`).
+
+Usage:
+    tools/bench_compare.py bench-serial.log --baseline tools/bench_baseline.json
+    tools/bench_compare.py bench-serial.log --baseline ... --update
+
+Exits non-zero if the capture holds no complete run or a benchmark's median
+got slower than the baseline by more than --threshold percent. Without a
+baseline file the current results become the baseline.
+"""
+
+import argparse
+import json
+import os
+import sys
+
+
+def parse_capture(path):
+    """Return (header, results, footer) of the last complete run in the capture."""
+    run = None
+    complete = None
+    with open(path, errors="replace") as capture:
+        for raw in capture:
+            line = raw.strip()
+            if line.startswith("BENCH-BEGIN"):
+                run = {"header": json.loads(line[len("BENCH-BEGIN"):]), "results": {}}
+            elif line.startswith("BENCH-END") and run is not None:
+                run["footer"] = json.loads(line[len("BENCH-END"):])
+                complete = run
+                run = None
+            elif run is not None and line.startswith("{"):
+                try:
+                    result = json.loads(line)
+                except ValueError:
+                    continue
+                run["results"][result["name"]] = result
+    return complete
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("capture", help="serial log of the bench boot")
+    parser.add_argument("--baseline", required=True, help="baseline JSON file")
+    parser.add_argument("--results", help="write this run's results here")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="allowed slowdown of the median in percent")
+    parser.add_argument("--update", action="store_true",
+                        help="replace the baseline with this run")
+    opts = parser.parse_args()
+
+    run = parse_capture(opts.capture)
+    if run is None:
+        sys.exit("bench: no complete BENCH-BEGIN/BENCH-END block in %s" % opts.capture)
+
+    current = {"tsc_hz": run["header"].get("tsc_hz", 0), "results": run["results"]}
+    if opts.results:
+        with open(opts.results, "w") as out:
+            json.dump(current, out, indent=2, sort_keys=True)
+            out.write("\n")
+
+    if opts.update or not os.path.exists(opts.baseline):
+        with open(opts.baseline, "w") as out:
+            json.dump(current, out, indent=2, sort_keys=True)
+            out.write("\n")
+        print("bench: baseline written to %s" % opts.baseline)
+        return
+
+    with open(opts.baseline) as f:
+        baseline = json.load(f)["results"]
+
+    regressions = 0
+    print("%-24s %12s %12s %8s" % ("benchmark", "baseline", "current", "change"))
+    for name, result in sorted(current["results"].items()):
+        now = result["median_cycles"]
+        if name not in baseline:
+            print("%-24s %12s %12d %8s" % (name, "-", now, "new"))
+            continue
+        before = baseline[name]["median_cycles"]
+        change = (now - before) * 100.0 / before if before else 0.0
+        flag = ""
+        if change > opts.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        print("%-24s %12d %12d %+7.1f%%%s" % (name, before, now, change, flag))
+
+    for name in sorted(set(baseline) - set(current["results"])):
+        print("%-24s %12d %12s %8s" % (name, baseline[name]["median_cycles"], "-", "missing"))
+
+    if regressions:
+        sys.exit("bench: %d benchmark(s) slower than baseline by more than %.0f%%"
+                 % (regressions, opts.threshold))
+
+
+if __name__ == "__main__":
+    main()
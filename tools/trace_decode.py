@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""Decode a kernel trace dump (see kernel/src/trace.h) captured from COM1.
+
+The kernel only records and dumps a trace with "trace" on its command line
+(the cmdline entry in limine.conf).
+
+Usage:
+    tools/trace_decode.py output.txt              # human readable text
+    tools/trace_decode.py --chrome output.txt > trace.json
+
+The Chrome JSON loads in chrome://tracing or https://ui.perfetto.dev.
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+# Mirrors enum trace_event in kernel/src/trace.h
+EVENTS = {
+    1: ("pmm_alloc", ("phys", None)),
+    2: ("pmm_free", ("phys", None)),
+    3: ("vmm_map", ("virt", "pte")),
+    4: ("vmm_unmap", ("virt", None)),
+    5: ("page_fault", ("addr", "error")),
+}
+
+RECORD = struct.Struct("<QHHIQQ")
+
+
+def read_dump(lines):
+    """Yield (tsc_hz, records, lost) for every dump found in the capture."""
+    records = None
+    tsc_hz = 0
+    for raw in lines:
+        line = raw.strip()
+        if line.startswith("TRACE-BEGIN"):
+            fields = line.split()
+            tsc_hz = int(fields[1])
+            if int(fields[2]) != RECORD.size:
+                sys.exit("unexpected record size %s" % fields[2])
+            records = []
+        elif line.startswith("TRACE-END") and records is not None:
+            lost = int(line.split()[2])
+            yield tsc_hz, records, lost
+            records = None
+        elif records is not None and len(line) == RECORD.size * 2:
+            records.append(RECORD.unpack(bytes.fromhex(line)))
+
+
+def describe(event, arg0, arg1):
+    name, labels = EVENTS.get(event, ("event_%d" % event, ("arg0", "arg1")))
+    args = {}
+    if labels[0]:
+        args[labels[0]] = "0x%x" % arg0
+    if labels[1]:
+        args[labels[1]] = "0x%x" % arg1
+    return name, args
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("capture", nargs="?", default="-",
+                        help="serial capture (default: stdin)")
+    parser.add_argument("--chrome", action="store_true",
+                        help="emit Chrome trace event JSON")
+    parser.add_argument("--tsc-hz", type=int, default=0,
+                        help="TSC frequency when the kernel could not report it")
+    opts = parser.parse_args()
+
+    src = sys.stdin if opts.capture == "-" else open(opts.capture, errors="replace")
+    dumps = list(read_dump(src))
+    if not dumps:
+        sys.exit("no TRACE-BEGIN/TRACE-END block found")
+
+    # The last dump is the most complete one
+    tsc_hz, records, lost = dumps[-1]
+    tsc_hz = opts.tsc_hz or tsc_hz
+    records.sort(key=lambda r: r[0])
+    base = records[0][0] if records else 0
+
+    def to_us(tsc):
+        delta = tsc - base
+        return delta * 1e6 / tsc_hz if tsc_hz else delta / 1000.0
+
+    if opts.chrome:
+        events = []
+        for tsc, event, cpu, _, arg0, arg1 in records:
+            name, args = describe(event, arg0, arg1)
+            events.append({"name": name, "ph": "i", "s": "t", "ts": to_us(tsc),
+                           "pid": 0, "tid": cpu, "args": args})
+        json.dump({"traceEvents": events, "displayTimeUnit": "ns"}, sys.stdout)
+        sys.stdout.write("\n")
+        return
+
+    unit = "us" if tsc_hz else "kcycles"
+    print("# %d records, %d overwritten, times in %s" % (len(records), lost, unit))
+    for tsc, event, cpu, _, arg0, arg1 in records:
+        name, args = describe(event, arg0, arg1)
+        fields = " ".join("%s=%s" % kv for kv in args.items())
+        print("%14.3f cpu%-2d %-12s %s" % (to_us(tsc), cpu, name, fields))
+
+
+if __name__ == "__main__":
+    main()